@@ -115,7 +115,7 @@ static char *value_property_names[] = {
 - (id)getValueInternal
 {
     GailRendererCell *rendererCell = GAIL_RENDERER_CELL (_delegate);
-    GtkCellRenderer *renderer = rendererCell->renderer;
+    GtkCellRenderer *renderer = gail_renderer_cell_get_renderer (rendererCell);
     id retObject = nil;
 
     for (int i = 0; value_property_names[i]; i++) {
@@ -211,7 +211,7 @@ static char *value_property_names[] = {
 - (BOOL)isAccessibilityHidden
 {
     GailRendererCell *rendererCell = GAIL_RENDERER_CELL (_delegate);
-    GtkCellRenderer *renderer = rendererCell->renderer;
+    GtkCellRenderer *renderer = gail_renderer_cell_get_renderer (rendererCell);
     gboolean visible;
 
     g_object_get (renderer, "visible", &visible, NULL);
@@ -225,6 +225,7 @@ get_coords_in_window (GtkWidget *widget, int *x, int *y)
 
 - (id)accessibilityHitTest:(NSPoint) point
 {
+	AC_PROFILE_SCOPE (HITTEST, "-[ACAccessibilityElement accessibilityHitTest:]");
 	NSWindow *parentWindow = [self accessibilityWindow];
 	CGRect screenRect = CGRectMake (point.x, point.y, 1, 1);
 
@@ -157,11 +157,8 @@
 - (NSArray *)accessibilityRows
 {
     GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
-    NSMutableArray *children = [NSMutableArray array];
 
-    gail_treeview_add_rows(gailview, children);
-
-    return children;
+    return gail_treeview_get_rows(gailview);
 }
 
 - (NSArray *)accessibilitySelectedChildren
@@ -172,13 +169,16 @@
 - (NSArray *)accessibilitySelectedRows
 {
     GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
-    // Need to generate the rows before the selection works
-    [self accessibilityRows];
 
-    NSMutableArray *rows = [NSMutableArray array];
-    gail_treeview_add_selected_rows(gailview, rows);
+    return gail_treeview_get_selected_rows(gailview);
+}
+
+// The selected rows are read from and written to the GtkTreeSelection
+- (void)setAccessibilitySelectedRows:(NSArray *)selectedRows
+{
+    GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
 
-    return rows;
+    gail_treeview_set_selected_rows(gailview, selectedRows);
 }
 
 - (NSArray *)accessibilitySelectedColumns
@@ -195,14 +195,7 @@
 
 - (NSArray *)accessibilityVisibleRows
 {
-    /*
-    NSMutableArray *rows = [NSMutableArray array];
-
-    gail_treeview_add_visible_rows(GAIL_TREE_VIEW ([self delegate]), rows);
-
-    return rows;
-     */
-    return [self accessibilityRows];
+    return gail_treeview_get_visible_rows(GAIL_TREE_VIEW ([self delegate]));
 }
 
 - (ACAccessibilityTableHeaderElement *)headerElement
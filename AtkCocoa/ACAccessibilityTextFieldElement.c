@@ -22,6 +22,9 @@
 #import "atk-cocoa/ACAccessibilityTextFieldElement.h"
 #include "atk-cocoa/acelement.h"
 #include "atk-cocoa/acdebug.h"
+#include "atk-cocoa/acoffsetindex.h"
+#include "atk-cocoa/gailentry.h"
+#include "atk-cocoa/gailmisc.h"
 
 @implementation ACAccessibilityTextFieldElement
 
@@ -87,7 +90,13 @@
 
 - (NSInteger)accessibilityNumberOfCharacters
 {
-    return [get_entry_text([self delegate]) length];
+    AcOffsetIndex *offsets = [self offsetIndex];
+
+    if (offsets == NULL) {
+        return 0;
+    }
+
+    return ac_offset_index_get_length (offsets, AC_OFFSET_UTF16);
 }
 
 - (NSInteger)accessibilityLineForIndex:(NSInteger)index
@@ -95,6 +104,57 @@
     return 1;
 }
 
+// Cocoa's ranges are in UTF-16 and GailEntry's text is in characters. For a password
+// the text is the invisible characters, which is what's shown and counted
+- (AcOffsetIndex *)offsetIndex
+{
+    AcElement *delegate = [self delegate];
+
+    if (!GAIL_IS_ENTRY (delegate) || GAIL_ENTRY (delegate)->textutil == NULL) {
+        return NULL;
+    }
+
+    return gail_text_util_get_offset_index (GAIL_ENTRY (delegate)->textutil);
+}
+
+// The characters covered by range, after clamping it to the text
+- (void)getCharacterRange:(NSRange)range start:(int *)start end:(int *)end
+{
+    AcOffsetIndex *offsets = [self offsetIndex];
+
+    if (offsets == NULL) {
+        *start = *end = 0;
+        return;
+    }
+
+    *start = ac_offset_index_convert (offsets, (int)range.location, AC_OFFSET_UTF16, AC_OFFSET_CHARS);
+    *end = ac_offset_index_convert (offsets, (int)NSMaxRange (range), AC_OFFSET_UTF16, AC_OFFSET_CHARS);
+}
+
+- (NSString *)stringForRange:(NSRange)range
+{
+    GtkEntry *widget = [self getEntry];
+    AcOffsetIndex *offsets = [self offsetIndex];
+    int start, end;
+
+    if (widget == NULL || offsets == NULL) {
+        return @"";
+    }
+
+    [self getCharacterRange:range start:&start end:&end];
+
+    if (!gtk_entry_get_visibility (widget)) {
+        return [@"" stringByPaddingToLength:end - start withString:@"•" startingAtIndex:0];
+    }
+
+    int startIndex = ac_offset_index_convert (offsets, start, AC_OFFSET_CHARS, AC_OFFSET_BYTES);
+    int endIndex = ac_offset_index_convert (offsets, end, AC_OFFSET_CHARS, AC_OFFSET_BYTES);
+
+    return [[NSString alloc] initWithBytes:ac_offset_index_get_text (offsets) + startIndex
+                                    length:endIndex - startIndex
+                                  encoding:NSUTF8StringEncoding];
+}
+
 - (GtkEntry *)getEntry
 {
     GObject *widget = ac_element_get_owner ([self delegate]);
@@ -117,12 +177,11 @@ get_entry_text (AcElement *element)
         return @"";
     }
 
-    NSString *value = nsstring_from_cstring (gtk_entry_get_text(GTK_ENTRY (widget)));
-
     if (!gtk_entry_get_visibility (GTK_ENTRY (widget))){
-        value = [@"" stringByPaddingToLength:value.length withString: @"•" startingAtIndex:0];
+        return [@"" stringByPaddingToLength:gtk_entry_get_text_length (GTK_ENTRY (widget)) withString: @"•" startingAtIndex:0];
     }
-    return value;
+
+    return nsstring_from_cstring (gtk_entry_get_text(GTK_ENTRY (widget)));
 }
 
 - (NSString *)accessibilityValueDescription
@@ -142,21 +201,17 @@ get_entry_text (AcElement *element)
 
 - (NSRange)accessibilityRangeForLine:(NSInteger)line
 {
-    return NSRangeFromString(get_entry_text(AC_ELEMENT ([self delegate])));
+    return NSMakeRange (0, [self accessibilityNumberOfCharacters]);
 }
 
 - (NSString *)accessibilityStringForRange:(NSRange)range
 {
-    NSString *ret = get_entry_text([self delegate]);
-
-    return [ret substringWithRange:range];
+    return [self stringForRange:range];
 }
 
 - (NSAttributedString *)accessibilityAttributedStringForRange:(NSRange)range
 {
-    NSString *ret = get_entry_text([self delegate]);
-
-    return [[NSAttributedString alloc] initWithString:[ret substringWithRange:range]];
+    return [[NSAttributedString alloc] initWithString:[self stringForRange:range]];
 }
 
 #define PADDING 2
@@ -164,12 +219,14 @@ get_entry_text (AcElement *element)
 {
     GtkEntry *widget = [self getEntry];
     PangoLayout *layout = gtk_entry_get_layout(GTK_ENTRY (widget));
+    AcOffsetIndex *layoutOffsets = gail_misc_layout_get_offset_index (layout);
     PangoRectangle first_rect, last_rect;
+    int start, end;
 
-    pango_layout_index_to_pos (layout, (int)range.location, &first_rect);
-    pango_layout_index_to_pos (layout, (int)(range.location + range.length - 1), &last_rect);
-
-    NSString *t = get_entry_text([self delegate]);
+    // Pango wants byte indices into the layout, which shows the invisible characters of a password
+    [self getCharacterRange:range start:&start end:&end];
+    pango_layout_index_to_pos (layout, ac_offset_index_convert (layoutOffsets, start, AC_OFFSET_CHARS, AC_OFFSET_BYTES), &first_rect);
+    pango_layout_index_to_pos (layout, ac_offset_index_convert (layoutOffsets, MAX (end - 1, start), AC_OFFSET_CHARS, AC_OFFSET_BYTES), &last_rect);
 
     NSRect first = NSMakeRect(first_rect.x / PANGO_SCALE, first_rect.y / PANGO_SCALE,
                               first_rect.width / PANGO_SCALE, first_rect.height / PANGO_SCALE);
@@ -196,22 +253,26 @@ get_entry_text (AcElement *element)
 - (NSRange)accessibilitySelectedTextRange
 {
     GtkEntry *widget = [self getEntry];
+    AcOffsetIndex *offsets = [self offsetIndex];
     int start, end;
 
+    if (offsets == NULL) {
+        return NSMakeRange(0, 0);
+    }
+
     if (!gtk_editable_get_selection_bounds(GTK_EDITABLE (widget), &start, &end)) {
-        return NSMakeRange(start, 0);
+        end = start;
     }
 
+    start = ac_offset_index_convert (offsets, start, AC_OFFSET_CHARS, AC_OFFSET_UTF16);
+    end = ac_offset_index_convert (offsets, end, AC_OFFSET_CHARS, AC_OFFSET_UTF16);
+
     return NSMakeRange(start, end - start);
 }
 
 - (NSString *)accessibilitySelectedText
 {
-    GtkEntry *widget = [self getEntry];
-    NSRange range = [self accessibilitySelectedTextRange];
-
-    NSString *ret = get_entry_text ([self delegate]);
-    return [ret substringWithRange:range];
+    return [self stringForRange:[self accessibilitySelectedTextRange]];
 }
 
 @end
@@ -21,7 +21,9 @@
 #include <gtk/gtk.h>
 #include "atk-cocoa/acelement.h"
 #include "atk-cocoa/acdebug.h"
+#include "atk-cocoa/acutils.h"
 #include "atk-cocoa/gailtextview.h"
+#include "atk-cocoa/acoffsetindex.h"
 
 @implementation ACAccessibilityTextViewElement {
 }
@@ -35,12 +37,86 @@
 	return [super initWithDelegate:delegate];
 }
 
-- (NSInteger)accessibilityNumberOfCharacters
+// Cocoa counts in UTF-16 and the buffer in characters, they only differ outside the BMP
+- (AcUtf16Index *)offsetIndex
+{
+    return gail_text_view_get_offset_index (GAIL_TEXT_VIEW ([self delegate]));
+}
+
+- (int)characterOffsetForIndex:(NSInteger)index
+{
+    AcUtf16Index *offsets = [self offsetIndex];
+
+    if (offsets == NULL) {
+        return 0;
+    }
+
+    return ac_utf16_index_convert (offsets, (int)index, AC_OFFSET_UTF16, AC_OFFSET_CHARS);
+}
+
+- (NSInteger)indexForCharacterOffset:(int)offset
+{
+    AcUtf16Index *offsets = [self offsetIndex];
+
+    if (offsets == NULL) {
+        return 0;
+    }
+
+    return ac_utf16_index_convert (offsets, offset, AC_OFFSET_CHARS, AC_OFFSET_UTF16);
+}
+
+- (NSRange)rangeForCharacterOffsets:(int)start end:(int)end
+{
+    NSInteger location = [self indexForCharacterOffset:start];
+
+    return NSMakeRange (location, [self indexForCharacterOffset:end] - location);
+}
+
+- (NSString *)snapshot
 {
+    return gail_text_view_get_snapshot (GAIL_TEXT_VIEW ([self delegate]));
+}
+
+// Ranges are in the buffer's offsets, which the snapshot only shares when nothing in the
+// buffer is hidden or a pixbuf. Otherwise only the range is copied out of the buffer
+- (NSString *)stringForRange:(NSRange)range
+{
+    GailTextView *gailView = GAIL_TEXT_VIEW ([self delegate]);
+
+    if (!gailView->snapshot_is_partial) {
+        NSString *snapshot = [self snapshot];
+
+        if (gail_text_view_snapshot_matches_offsets (gailView)) {
+            NSUInteger length = [snapshot length];
+            NSUInteger location = MIN (range.location, length);
+
+            return [snapshot substringWithRange:NSMakeRange (location, MIN (range.length, length - location))];
+        }
+    }
+
     GtkTextView *textview = GTK_TEXT_VIEW (ac_element_get_owner ([self delegate]));
     GtkTextBuffer *buffer = gtk_text_view_get_buffer (textview);
+    GtkTextIter startIter, endIter;
+
+    gtk_text_buffer_get_iter_at_offset (buffer, &startIter, [self characterOffsetForIndex:range.location]);
+    gtk_text_buffer_get_iter_at_offset (buffer, &endIter, [self characterOffsetForIndex:NSMaxRange (range)]);
+
+    char *text = gtk_text_buffer_get_text (buffer, &startIter, &endIter, FALSE);
+    NSString *retString = nsstring_from_cstring (text);
+    g_free (text);
 
-    return gtk_text_buffer_get_char_count(buffer);
+    return retString;
+}
+
+- (NSInteger)accessibilityNumberOfCharacters
+{
+    AcUtf16Index *offsets = [self offsetIndex];
+
+    if (offsets == NULL) {
+        return 0;
+    }
+
+    return ac_utf16_index_get_length (offsets, AC_OFFSET_UTF16);
 }
 
 - (NSInteger)accessibilityInsertionPointLineNumber
@@ -59,16 +135,7 @@
 
 - (NSString *)accessibilityStringForRange:(NSRange)range
 {
-    GtkTextView *textview = GTK_TEXT_VIEW (ac_element_get_owner ([self delegate]));
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer (textview);
-    GtkTextIter startIter, endIter;
-
-    gtk_text_buffer_get_iter_at_offset (buffer, &startIter, (int)range.location);
-    gtk_text_buffer_get_iter_at_offset (buffer, &endIter, (int)(range.location + range.length));
-
-    char *text = gtk_text_buffer_get_text (buffer, &startIter, &endIter, FALSE);
-    NSString *retString = nsstring_from_cstring (text);
-    g_free (text);
+    NSString *retString = [self stringForRange:range];
 
     //NSLog (@"Requested range %@: %@", NSStringFromRange(range), retString);
     return retString;
@@ -80,7 +147,7 @@
     GtkTextBuffer *buffer = gtk_text_view_get_buffer (textview);
     GtkTextIter lineIter;
 
-    gtk_text_buffer_get_iter_at_offset (buffer, &lineIter, (int)index);
+    gtk_text_buffer_get_iter_at_offset (buffer, &lineIter, [self characterOffsetForIndex:index]);
 
     return gtk_text_iter_get_line (&lineIter);
 }
@@ -92,8 +159,9 @@
     GtkTextIter lineIter;
 
     gtk_text_buffer_get_iter_at_line (buffer, &lineIter, (int)lineNumber);
-    
-    return NSMakeRange (gtk_text_iter_get_offset (&lineIter), gtk_text_iter_get_chars_in_line (&lineIter));
+
+    int start = gtk_text_iter_get_offset (&lineIter);
+    return [self rangeForCharacterOffsets:start end:start + gtk_text_iter_get_chars_in_line (&lineIter)];
 }
 
 - (NSRect)accessibilityFrameForRange:(NSRange)range
@@ -104,8 +172,11 @@
     GdkRectangle startRect, endRect;
     int startWinX, endWinX, startWinY, endWinY;
 
-    gtk_text_buffer_get_iter_at_offset (buffer, &startIter, (int)range.location);
-    gtk_text_buffer_get_iter_at_offset (buffer, &endIter, (int)(range.location + (range.length - 1)));
+    int start = [self characterOffsetForIndex:range.location];
+    int end = [self characterOffsetForIndex:NSMaxRange (range)];
+
+    gtk_text_buffer_get_iter_at_offset (buffer, &startIter, start);
+    gtk_text_buffer_get_iter_at_offset (buffer, &endIter, MAX (end - 1, start));
 
     gtk_text_view_get_iter_location (textview, &startIter, &startRect);
     gtk_text_view_get_iter_location (textview, &endIter, &endRect);
@@ -123,19 +194,11 @@
     return rect;
 }
 
+// The snapshot changes with the buffer, so callers get a copy of it. The copy is kept
+// until the next edit
 - (NSString *)accessibilityValue
 {
-    GtkTextView *textview = GTK_TEXT_VIEW (ac_element_get_owner ([self delegate]));
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer (textview);
-    GtkTextIter startIter, endIter;
-
-    gtk_text_buffer_get_bounds (buffer, &startIter, &endIter);
-    char *text = gtk_text_buffer_get_text (buffer, &startIter, &endIter, FALSE);
-
-    NSString *retString = nsstring_from_cstring (text);
-    g_free (text);
-
-    return retString;
+    return gail_text_view_get_value (GAIL_TEXT_VIEW ([self delegate]));
 }
 
 - (NSRange)accessibilitySelectedTextRange
@@ -159,7 +222,7 @@
     }
 
     //NSLog (@"Selected text range %@", NSStringFromRange(NSMakeRange(start, length)));
-    return NSMakeRange(start, length);
+    return [self rangeForCharacterOffsets:start end:start + length];
 }
 
 - (void)setAccessibilitySelectedTextRange:(NSRange)accessibilitySelectedTextRange
@@ -169,19 +232,13 @@
 
 - (NSString *)accessibilitySelectedText
 {
-    GtkTextView *textview = GTK_TEXT_VIEW (ac_element_get_owner ([self delegate]));
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer (textview);
-    GtkTextIter startIter, endIter;
-    NSString *result = nil;
-
-    if (gtk_text_buffer_get_selection_bounds(buffer, &startIter, &endIter)) {
-        char *text = gtk_text_buffer_get_text(buffer, &startIter, &endIter, FALSE);
-        result = nsstring_from_cstring(text);
+    NSRange range = [self accessibilitySelectedTextRange];
 
-        g_free (text);
+    if (range.length == 0) {
+        return nil;
     }
 
-    return result;
+    return [self stringForRange:range];
 }
 
 // The compiler will complain that accessibilityFrame is not defined
@@ -95,6 +95,22 @@
     return _columnElement;
 }
 
+- (void)prepareForReuse
+{
+    // The cell may be handed to another row, so clients have to drop it as the cell of this one
+    if (_rowElement != nil) {
+        NSAccessibilityPostNotification (self, NSAccessibilityUIElementDestroyedNotification);
+    }
+
+    _rowElement = nil;
+    _children = nil;
+    _visibleChildren = nil;
+    _updateChildren = YES;
+
+    [self setAccessibilityParent:nil];
+    [self setAccessibilitySelected:NO];
+}
+
 - (GdkRectangle)frameInGtkWindowSpace
 {
     GdkRectangle cellSpace;
@@ -0,0 +1,77 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#import "atk-cocoa/ACAccessibilityTreeColumnCellArray.h"
+#import "atk-cocoa/ACAccessibilityTreeColumnElement.h"
+#import "atk-cocoa/ACAccessibilityTreeRowElement.h"
+
+@implementation ACAccessibilityTreeColumnCellArray {
+    NSArray *_rows;
+    NSUInteger _count;
+    ACAccessibilityTreeColumnElement *_columnElement;
+    NSAccessibilityElement *_placeholder;
+}
+
+- (instancetype)initWithRows:(NSArray *)rows columnElement:(ACAccessibilityTreeColumnElement *)columnElement
+{
+    self = [super init];
+    _rows = rows;
+    _count = [rows count];
+    _columnElement = columnElement;
+
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+// Rows that have been removed from the model since the array was made, or a column
+// that has lost its renderers, have no cells. NSArray can't hold nil and the accessibility
+// clients don't expect NSNull, so they get the same empty cell every time and the other indices stay put.
+- (id)placeholderCell
+{
+    if (_placeholder == nil) {
+        _placeholder = [NSAccessibilityElement accessibilityElementWithRole:NSAccessibilityCellRole
+                                                                      frame:NSZeroRect
+                                                                      label:nil
+                                                                     parent:nil];
+    }
+
+    return _placeholder;
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    id row, cell = nil;
+
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"Cell index %lu out of range (%lu cells)", (unsigned long)index, (unsigned long)_count];
+    }
+
+    row = [_rows objectAtIndex:index];
+    if ([row isKindOfClass:[ACAccessibilityTreeRowElement class]]) {
+        cell = [(ACAccessibilityTreeRowElement *)row cellForColumn:_columnElement];
+    }
+
+    return cell ?: [self placeholderCell];
+}
+
+@end
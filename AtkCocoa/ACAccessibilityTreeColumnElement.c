@@ -19,14 +19,19 @@
 
 #import "atk-cocoa/ACAccessibilityTreeColumnElement.h"
 #import "atk-cocoa/ACAccessibilityTreeColumnHeaderElement.h"
+#import "atk-cocoa/ACAccessibilityTreeCellElement.h"
 
 #include "atk-cocoa/gailtreeview.h"
 
 @implementation ACAccessibilityTreeColumnElement {
     GtkTreeViewColumn *_column;
     ACAccessibilityTreeColumnHeaderElement *_customHeaderElement;
+    NSMutableArray *_reusableCells;
 }
 
+// Enough cells for a screenful of rows, anything beyond that is released
+#define MAX_REUSABLE_CELLS 256
+
 - (instancetype)initWithDelegate:(AcElement *)delegate treeColumn:(GtkTreeViewColumn *)column
 {
     self = [super initWithDelegate:delegate];
@@ -53,6 +58,13 @@
 {
     GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
 
+    return gail_treeview_get_column_elements(gailview, self);
+}
+
+- (NSArray *)accessibilityVisibleChildren
+{
+    GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
+
     NSMutableArray *children = [NSMutableArray array];
 
     gail_treeview_add_column_elements(gailview, self, children);
@@ -101,6 +113,30 @@
     return _column;
 }
 
+- (ACAccessibilityTreeCellElement *)dequeueReusableCell
+{
+    ACAccessibilityTreeCellElement *cell = [_reusableCells lastObject];
+
+    if (cell != nil) {
+        [_reusableCells removeLastObject];
+    }
+
+    return cell;
+}
+
+- (void)enqueueReusableCell:(ACAccessibilityTreeCellElement *)cell
+{
+    [cell prepareForReuse];
+
+    if (_reusableCells == nil) {
+        _reusableCells = [NSMutableArray array];
+    }
+
+    if ([_reusableCells count] < MAX_REUSABLE_CELLS) {
+        [_reusableCells addObject:cell];
+    }
+}
+
 // Clear any actions that the accessibility system might try to inherit from the parent TreeView
 - (NSArray *)accessibilityActionNames
 {
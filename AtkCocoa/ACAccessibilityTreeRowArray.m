@@ -0,0 +1,141 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#import "atk-cocoa/ACAccessibilityTreeRowArray.h"
+#import "atk-cocoa/ACAccessibilityTreeRowElement.h"
+
+@implementation ACAccessibilityTreeRowArray {
+    ACAccessibilityTreeRowElement *_root;
+    NSUInteger _count;
+    NSUInteger _generation;
+    NSAccessibilityElement *_placeholder;
+
+    // Only for arrays of some of the rows, the ranges of their flattened indices
+    // and the position in the array that each range starts at
+    NSRange *_ranges;
+    NSUInteger *_rangeStarts;
+    NSUInteger _nRanges;
+}
+
+- (instancetype)initWithRootRow:(ACAccessibilityTreeRowElement *)root
+{
+    self = [super init];
+    _root = root;
+    _count = [root descendantCount];
+    _generation = [root rowGeneration];
+
+    return self;
+}
+
+- (instancetype)initWithRootRow:(ACAccessibilityTreeRowElement *)root indexes:(NSIndexSet *)indexes
+{
+    __block NSUInteger n = 0, start = 0;
+
+    self = [super init];
+    _root = root;
+    _count = [indexes count];
+    _generation = [root rowGeneration];
+
+    // The index set can be a single range for any number of rows, so only its ranges are copied
+    [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+        n++;
+    }];
+
+    _nRanges = n;
+    _ranges = g_new (NSRange, n);
+    _rangeStarts = g_new (NSUInteger, n);
+
+    n = 0;
+    [indexes enumerateRangesUsingBlock:^(NSRange range, BOOL *stop) {
+        _ranges[n] = range;
+        _rangeStarts[n] = start;
+        start += range.length;
+        n++;
+    }];
+
+    return self;
+}
+
+- (void)dealloc
+{
+    g_free (_ranges);
+    g_free (_rangeStarts);
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+// Clients iterate over the array from AppKit, where an exception can't be thrown,
+// so a row that can't be found is answered with an empty row rather than a range error
+- (id)placeholderRow
+{
+    if (_placeholder == nil) {
+        _placeholder = [NSAccessibilityElement accessibilityElementWithRole:NSAccessibilityRowRole
+                                                                      frame:NSZeroRect
+                                                                      label:nil
+                                                                     parent:nil];
+    }
+
+    return _placeholder;
+}
+
+- (NSUInteger)flattenedIndexAtIndex:(NSUInteger)index
+{
+    NSUInteger low = 0, high = _nRanges;
+
+    if (_ranges == NULL) {
+        return index;
+    }
+
+    // The last range that starts at or before index
+    while (high - low > 1) {
+        NSUInteger mid = low + (high - low) / 2;
+
+        if (_rangeStarts[mid] <= index) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    return _ranges[low].location + (index - _rangeStarts[low]);
+}
+
+- (id)objectAtIndex:(NSUInteger)index
+{
+    ACAccessibilityTreeRowElement *row = nil;
+    NSUInteger flattenedIndex;
+
+    if (index >= _count) {
+        [NSException raise:NSRangeException format:@"Row index %lu out of range (%lu rows)", (unsigned long)index, (unsigned long)_count];
+    }
+
+    // Once rows have come or gone the indices no longer line up with when the array was made,
+    // and the row now at the index may not be the one that was there, or even selected
+    if (_generation == [_root rowGeneration]) {
+        flattenedIndex = [self flattenedIndexAtIndex:index];
+        row = [_root rowAtFlattenedIndex:(int)flattenedIndex];
+    }
+
+    return row ?: [self placeholderRow];
+}
+
+@end
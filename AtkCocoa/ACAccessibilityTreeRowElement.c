@@ -18,40 +18,40 @@
  */
 
 #import "atk-cocoa/ACAccessibilityTreeRowElement.h"
+#import "atk-cocoa/ACAccessibilityTreeCellElement.h"
+#import "atk-cocoa/ACAccessibilityTreeColumnElement.h"
 #include "atk-cocoa/gailtreeview.h"
+#include "atk-cocoa/acindextree.h"
+#include "atk-cocoa/acdebug.h"
 
 #include <gtk/gtk.h>
 
 @implementation ACAccessibilityTreeRowElement {
-    GtkTreeRowReference *_row;
+    GtkTreeRowReference *_row; // Only for rows that aren't in the row tree, the rest use their position in it
     BOOL _isRoot;
     GtkWidget *_view;
 
     int _descendantCount; // The total of all children, grandchildren, underneath this node
-    GSequence *_children;
+    AcIndexTree *_children; // Weighted by the size of each child's subtree, so flattened indices are O(log n)
     __weak ACAccessibilityTreeRowElement *_parent;
-    GSequenceIter *_iterInParent;
+    AcIndexTreeNode *_nodeInParent;
     BOOL _rowIsDirty;
+    int _hasChildRows; // -1 until GailTreeView sets it from the model, kept up to date by its model handlers
 
     NSArray *_childCells;
+    NSMapTable *_columnCells; // Every cell made so far, keyed by its column element
+    NSMutableArray *_visibleRows; // Owned and updated in place, rather than copied on every change
+
+    ACAccessibilityTreeRowFactory _rowFactory; // Only set on the root node
+    NSUInteger _rowGeneration; // Only used on the root node, changes whenever rows are added, removed or moved
 }
 
 - (BOOL)respondsToSelector:(SEL)aSelector
 {
     if (aSelector == @selector(isAccessibilityDisclosed) ||
         aSelector == @selector(setAccessibilityDisclosed:)) {
-        GtkTreeIter iter;
-
-        GtkTreePath *path = [self rowPath];
-        if (path == NULL) {
-            return NO;
-        }
-
-        GtkTreeModel *model = gtk_tree_row_reference_get_model(_row);
-        gtk_tree_model_get_iter(model, &iter, path);
-        gtk_tree_path_free(path);
-
-        return gtk_tree_model_iter_has_child(model, &iter);
+        // This is asked constantly, so it has to be cheap and can't go to the model
+        return _hasChildRows > 0;
     }
 
     return [super respondsToSelector:aSelector];
@@ -74,6 +74,7 @@
     _children = NULL;
     _parent = nil;
     _rowIsDirty = YES;
+    _hasChildRows = -1;
 
     return self;
 }
@@ -81,15 +82,13 @@
 - (NSString *)description
 {
     char *rowPath;
-    if (_row) {
-        GtkTreePath *path = gtk_tree_row_reference_get_path(_row);
-        if (path) {
-            rowPath = gtk_tree_path_to_string(path);
-        } else {
-            rowPath = g_strdup ("No path");
-        }
+    GtkTreePath *path = _isRoot ? NULL : [self rowPath];
+
+    if (path) {
+        rowPath = gtk_tree_path_to_string(path);
+        gtk_tree_path_free(path);
     } else {
-        rowPath = g_strdup ("No row");
+        rowPath = g_strdup (_isRoot ? "Root" : "No path");
     }
 
     NSString *ret = [NSString stringWithFormat:@"Row %p %s - %s (%p)", self, rowPath,
@@ -114,11 +113,57 @@
     return _childCells;
 }
 
+- (ACAccessibilityTreeCellElement *)cellForColumn:(ACAccessibilityTreeColumnElement *)columnElement
+{
+    ACAccessibilityTreeCellElement *cell = [_columnCells objectForKey:columnElement];
+
+    if (cell) {
+        return cell;
+    }
+
+    cell = gail_treeview_make_row_cell (GAIL_TREE_VIEW([self delegate]), self, columnElement);
+    if (cell == nil) {
+        return nil;
+    }
+
+    if (_columnCells == nil) {
+        _columnCells = [NSMapTable strongToStrongObjectsMapTable];
+    }
+    [_columnCells setObject:cell forKey:columnElement];
+
+    return cell;
+}
+
+- (void)removeCellsForColumns:(NSArray *)columnElements
+{
+    for (ACAccessibilityTreeColumnElement *columnElement in columnElements) {
+        ACAccessibilityTreeCellElement *cell = [_columnCells objectForKey:columnElement];
+
+        if (cell) {
+            [cell prepareForReuse];
+            [_columnCells removeObjectForKey:columnElement];
+        }
+    }
+
+    // The cells of the other columns are kept, but the order of them may have changed
+    _childCells = nil;
+}
+
+- (void)recycleChildCells
+{
+    for (ACAccessibilityTreeCellElement *cell in [_columnCells objectEnumerator]) {
+        [[cell columnElement] enqueueReusableCell:cell];
+    }
+
+    _columnCells = nil;
+    _childCells = nil;
+}
+
 - (NSArray *)accessibilityChildren
 {
     GailTreeView *gailview = GAIL_TREE_VIEW([self delegate]);
 
-    // Need to invalidate this cache when a column is added or removed
+    // The cells are recycled when the row scrolls out of view or the columns change
     if (_childCells) {
         return _childCells;
     }
@@ -158,11 +203,75 @@
 
 - (GtkTreePath *)rowPath
 {
-    if (_row == NULL) {
+    ACAccessibilityTreeRowElement *row;
+    GtkTreePath *path;
+    int *indices;
+    int depth, i;
+
+    if (_isRoot) {
         return NULL;
     }
 
-    return gtk_tree_row_reference_get_path(_row);
+    if (_nodeInParent == NULL) {
+        return _row ? gtk_tree_row_reference_get_path (_row) : NULL;
+    }
+
+    // This is the path in the row tree, GailTreeView brings the tree up to date with the model
+    // before it hands out any rows, and applies the changes while idle, so it is never synced here
+    depth = 0;
+    for (row = self; row->_parent != nil; row = row->_parent) {
+        depth++;
+    }
+
+    // Part of a subtree that has been removed
+    if (!row->_isRoot) {
+        return NULL;
+    }
+
+    indices = g_newa (int, depth);
+    for (row = self, i = depth - 1; row->_parent != nil; row = row->_parent, i--) {
+        indices[i] = ac_index_tree_node_get_position (row->_nodeInParent);
+    }
+
+    path = gtk_tree_path_new ();
+    for (i = 0; i < depth; i++) {
+        gtk_tree_path_append_index (path, indices[i]);
+    }
+
+    return path;
+}
+
+- (BOOL)getRowIter:(GtkTreeIter *)iter
+{
+    GtkTreeModel *model;
+    GtkTreePath *path;
+    gboolean ret;
+
+    if (_view == NULL || (model = gtk_tree_view_get_model (GTK_TREE_VIEW (_view))) == NULL) {
+        return NO;
+    }
+
+    path = [self rowPath];
+    if (path == NULL) {
+        return NO;
+    }
+
+    ret = gtk_tree_model_get_iter (model, iter, path);
+    gtk_tree_path_free (path);
+
+    return ret;
+}
+
+// Set from the model when the row is made and when the model signals a change, so the
+// tree never has to be looked up in the model, which may be ahead of it
+- (BOOL)hasChildRows
+{
+    return _hasChildRows > 0;
+}
+
+- (void)setHasChildRows:(BOOL)hasChildRows
+{
+    _hasChildRows = hasChildRows ? 1 : 0;
 }
 
 - (BOOL)rowIsDirty
@@ -369,32 +478,60 @@
 
     // If the descendant count is not the same as the number of children
     // then there's some grandchildren out there
-    return (_descendantCount != g_sequence_get_length (_children));
+    return (_descendantCount != ac_index_tree_get_length (_children));
+}
+
+- (NSArray *)accessibilityVisibleRows
+{
+    return _visibleRows;
+}
+
+- (void)setAccessibilityVisibleRows:(NSArray *)visibleRows
+{
+    if (visibleRows == nil) {
+        _visibleRows = nil;
+        return;
+    }
+
+    if (_visibleRows == nil) {
+        _visibleRows = [NSMutableArray arrayWithCapacity:[visibleRows count]];
+    }
+    [_visibleRows setArray:visibleRows];
 }
 
 - (void)addVisibleRow:(ACAccessibilityTreeRowElement *)child
 {
-    NSMutableArray *visibleChildren = [[self accessibilityVisibleRows] mutableCopy];
-    if (visibleChildren == nil) {
-        visibleChildren = [NSMutableArray array];
+    NSUInteger idx;
+
+    if (_visibleRows == nil) {
+        _visibleRows = [NSMutableArray array];
     }
-    [visibleChildren addObject:child];
-    [self setAccessibilityVisibleRows:visibleChildren];
+
+    // Keep the visible rows in the same order as the children. Placeholders don't have an
+    // element, so the row goes after the children before it that do.
+    idx = (NSUInteger)ac_index_tree_node_get_filled_position (child->_nodeInParent);
+    [_visibleRows insertObject:child atIndex:idx];
 }
 
+#define GET_DATA(node) ((__bridge ACAccessibilityTreeRowElement *)ac_index_tree_node_get_data ((node)))
+
 static void
 remove_child (gpointer data)
 {
+    // Placeholder rows have no element
+    if (data == NULL) {
+        return;
+    }
+
     ACAccessibilityTreeRowElement *e = (__bridge ACAccessibilityTreeRowElement *)data;
     e->_parent = nil;
+    e->_nodeInParent = NULL;
 
     CFBridgingRelease(data);
 }
 
 - (void)insertChild:(ACAccessibilityTreeRowElement *)child atIndex:(int)idx
 {
-    GSequenceIter *iter;
-
     //  NSLog (@"InsertChild:atIndex: - %@ - %d", child, idx);
     // g_print ("   Parent: %p\n", self);
     // g_print ("   Child: %p\n", child);
@@ -403,44 +540,181 @@ remove_child (gpointer data)
     // } else {
         // g_print ("   Fake Root node\n");
     // }
-    // g_print ("   Children count: %d\n", _children ? g_sequence_get_length (_children) + 1 : -1);
+    // g_print ("   Children count: %d\n", _children ? ac_index_tree_get_length (_children) + 1 : -1);
 
     if (_children == NULL) {
-        _children = g_sequence_new(remove_child);
+        _children = ac_index_tree_new (remove_child);
     }
 
-    iter = g_sequence_get_iter_at_pos (_children, idx);
-    child->_iterInParent = g_sequence_insert_before (iter, (void *)CFBridgingRetain (child));
-
+    child->_nodeInParent = ac_index_tree_insert (_children, idx, (void *)CFBridgingRetain (child), child->_descendantCount + 1);
     child->_parent = self;
 
-    [self adjustDescendantCountBy:1];
+    [self adjustDescendantCountBy:child->_descendantCount + 1];
     [self addVisibleRow:child];
 }
 
 - (void)appendChild:(ACAccessibilityTreeRowElement *)child
 {
     if (_children == NULL) {
-        _children = g_sequence_new (remove_child);
+        _children = ac_index_tree_new (remove_child);
     }
 
-    child->_iterInParent = g_sequence_append (_children, (void *)CFBridgingRetain (child));
+    child->_nodeInParent = ac_index_tree_append (_children, (void *)CFBridgingRetain (child), child->_descendantCount + 1);
     child->_parent = self;
 
-    [self adjustDescendantCountBy:1];
+    [self adjustDescendantCountBy:child->_descendantCount + 1];
     [self addVisibleRow:child];
 }
 
-- (void)removeVisibleRow:(ACAccessibilityTreeRowElement *)child
+- (void)insertChildren:(NSArray *)children atIndex:(int)idx
+{
+    AcIndexTreeNode **nodes;
+    gpointer *data;
+    int *weights;
+    int count, i, total;
+
+    count = (int)[children count];
+    if (count == 0) {
+        return;
+    }
+
+    if (_children == NULL) {
+        _children = ac_index_tree_new (remove_child);
+    }
+
+    data = g_new (gpointer, count);
+    weights = g_new (int, count);
+    nodes = g_new (AcIndexTreeNode *, count);
+
+    total = 0;
+    for (i = 0; i < count; i++) {
+        ACAccessibilityTreeRowElement *child = children[i];
+
+        data[i] = (void *)CFBridgingRetain (child);
+        weights[i] = child->_descendantCount + 1;
+        total += weights[i];
+    }
+
+    ac_index_tree_insert_many (_children, idx, data, weights, count, nodes);
+
+    for (i = 0; i < count; i++) {
+        ACAccessibilityTreeRowElement *child = children[i];
+
+        child->_nodeInParent = nodes[i];
+        child->_parent = self;
+    }
+
+    // The counts up to the root and the visible rows are only updated once for the whole run
+    [self adjustDescendantCountBy:total];
+
+    if (_visibleRows == nil) {
+        _visibleRows = [NSMutableArray arrayWithCapacity:count];
+    }
+    idx = (NSUInteger)ac_index_tree_node_get_filled_position (nodes[0]);
+    [_visibleRows insertObjects:children atIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange (idx, count)]];
+
+    g_free (data);
+    g_free (weights);
+    g_free (nodes);
+}
+
+- (void)recycleDescendantCells
+{
+    if (_children == NULL) {
+        return;
+    }
+
+    for (AcIndexTreeNode *node = ac_index_tree_get_first (_children); node; node = ac_index_tree_node_next (node)) {
+        ACAccessibilityTreeRowElement *child = GET_DATA (node);
+
+        // Placeholders never had any cells
+        if (child == nil) {
+            continue;
+        }
+
+        [child recycleChildCells];
+        [child recycleDescendantCells];
+    }
+}
+
+- (void)insertPlaceholderChildrenAtIndex:(int)idx count:(int)count
+{
+    if (count <= 0) {
+        return;
+    }
+
+    if (_children == NULL) {
+        _children = ac_index_tree_new (remove_child);
+    }
+
+    // Placeholders take up one row in the index but don't get an element until somebody asks for them
+    ac_index_tree_insert_many (_children, idx, NULL, NULL, count, NULL);
+
+    [self adjustDescendantCountBy:count];
+}
+
+- (ACAccessibilityTreeRowElement *)rootRow
 {
-    NSMutableArray *visibleChildren = [[self accessibilityVisibleRows] mutableCopy];
-    [visibleChildren removeObject:child];
-    [self setAccessibilityVisibleRows:visibleChildren];
+    ACAccessibilityTreeRowElement *row = self;
+
+    while (row->_parent != nil) {
+        row = row->_parent;
+    }
+
+    return row;
+}
+
+- (ACAccessibilityTreeRowElement *)materializeChildNode:(AcIndexTreeNode *)node
+{
+    ACAccessibilityTreeRowElement *root, *child;
+
+    child = (__bridge ACAccessibilityTreeRowElement *)ac_index_tree_node_get_data (node);
+    if (child != nil) {
+        return child;
+    }
+
+    root = [self rootRow];
+    if (root->_rowFactory == nil) {
+        return nil;
+    }
+
+    child = root->_rowFactory (self, ac_index_tree_node_get_position (node));
+    if (child == nil) {
+        return nil;
+    }
+
+    // The placeholder already accounts for the row in the descendant counts
+    ac_index_tree_node_set_data (node, (void *)CFBridgingRetain (child));
+    child->_nodeInParent = node;
+    child->_parent = self;
+
+    [self addVisibleRow:child];
+
+    return child;
+}
+
+- (ACAccessibilityTreeRowFactory)rowFactory
+{
+    return _rowFactory;
+}
+
+- (void)setRowFactory:(ACAccessibilityTreeRowFactory)rowFactory
+{
+    _rowFactory = [rowFactory copy];
+}
+
+- (void)removeVisibleRow:(ACAccessibilityTreeRowElement *)child atIndexHint:(NSUInteger)idx
+{
+    if (idx < [_visibleRows count] && _visibleRows[idx] == child) {
+        [_visibleRows removeObjectAtIndex:idx];
+    } else {
+        [_visibleRows removeObjectIdenticalTo:child];
+    }
 }
 
 - (void)removeChildAtIndex:(int)idx
 {
-    GSequenceIter *iter;
+    AcIndexTreeNode *node;
     ACAccessibilityTreeRowElement *child;
 
     // NSLog (@"removeChildAtIndex: - %d", idx);
@@ -448,23 +722,24 @@ remove_child (gpointer data)
         return;
     }
 
-    iter = g_sequence_get_iter_at_pos (_children, idx);
-    if (iter == g_sequence_get_end_iter (_children)) {
+    node = ac_index_tree_get_nth (_children, idx);
+    if (node == NULL) {
         return;
     }
 
-    child = (__bridge ACAccessibilityTreeRowElement *)g_sequence_get (iter);
-    child->_parent = nil;
-
-    g_sequence_remove (iter);
+    child = (__bridge ACAccessibilityTreeRowElement *)ac_index_tree_node_get_data (node);
+    if (child != nil) {
+        [self removeChild:child];
+        return;
+    }
 
-    if (g_sequence_get_length (_children) == 0) {
-        g_sequence_free (_children);
+    ac_index_tree_remove (_children, node);
+    if (ac_index_tree_get_length (_children) == 0) {
+        ac_index_tree_free (_children);
         _children = NULL;
     }
 
     [self adjustDescendantCountBy:-1];
-    [self removeVisibleRow:child];
 }
 
 int
@@ -492,25 +767,27 @@ last_path_index (const char *path)
 
 - (void)removeChild:(ACAccessibilityTreeRowElement *)child
 {
-    GtkTreePath *path;
-    char *pathString;
-    int idx;
+    int subtreeSize, position;
 
     // NSLog (@"RemoveChild: - %@ from %@", child, self);
-    if (_children == NULL) {
+    if (_children == NULL || child->_parent != self) {
         return;
     }
 
-    g_sequence_remove (child->_iterInParent);
-    child->_iterInParent = NULL;
+    subtreeSize = child->_descendantCount + 1;
+    // Where the child is in the visible rows, which only hold the children that have elements
+    position = ac_index_tree_node_get_filled_position (child->_nodeInParent);
+
+    ac_index_tree_remove (_children, child->_nodeInParent);
+    child->_nodeInParent = NULL;
 
-    if (g_sequence_get_length (_children) == 0) {
-        g_sequence_free (_children);
+    if (ac_index_tree_get_length (_children) == 0) {
+        ac_index_tree_free (_children);
         _children = NULL;
     }
 
-    [self adjustDescendantCountBy:-1];
-    [self removeVisibleRow:child];
+    [self adjustDescendantCountBy:-subtreeSize];
+    [self removeVisibleRow:child atIndexHint:position];
 }
 
 - (void)removeFromParent
@@ -525,96 +802,186 @@ last_path_index (const char *path)
 
 - (void)removeAllChildren
 {
-    int childCount;
+    AcIndexTree *children;
+    int removedCount;
 
     if (_children == NULL) {
         return;
     }
 
-    childCount = g_sequence_get_length (_children);
-    g_sequence_free (_children);
+    children = _children;
+    removedCount = ac_index_tree_get_weight (children);
     _children = NULL;
+    ac_index_tree_free (children);
 
-    [self adjustDescendantCountBy:-childCount];
+    [self adjustDescendantCountBy:-removedCount];
 
     // Remove all visible children
-    [self setAccessibilityVisibleRows:nil];
+    [_visibleRows removeAllObjects];
 }
 
-#define GET_DATA(iter) ((__bridge ACAccessibilityTreeRowElement *)g_sequence_get ((iter)))
 - (ACAccessibilityTreeRowElement *)childAtIndex:(int)idx
 {
-    GSequenceIter *iter;
+    AcIndexTreeNode *node;
 
-    // g_print ("Child at index: %d (%p) - %d\n", idx, self, _children ? g_sequence_get_length (_children) : 0);
+    // g_print ("Child at index: %d (%p) - %d\n", idx, self, _children ? ac_index_tree_get_length (_children) : 0);
     if (_children == NULL) {
         // g_print ("   No children\n");
         return NULL;
     }
 
-    iter = g_sequence_get_iter_at_pos (_children, idx);
+    node = ac_index_tree_get_nth (_children, idx);
+    if (node == NULL) {
+        return nil;
+    }
+
+    return [self materializeChildNode:node];
+}
+
+- (ACAccessibilityTreeRowElement *)existingChildAtIndex:(int)idx
+{
+    AcIndexTreeNode *node;
+
+    if (_children == NULL) {
+        return nil;
+    }
+
+    node = ac_index_tree_get_nth (_children, idx);
+    if (node == NULL) {
+        return nil;
+    }
+
+    return GET_DATA (node);
+}
+
+- (ACAccessibilityTreeRowElement *)rowAtFlattenedIndex:(int)idx
+{
+    ACAccessibilityTreeRowElement *row = self;
+
+    // Walk down the tree, at each level picking the child whose subtree contains idx
+    while (row->_children != NULL) {
+        int childOffset;
+        AcIndexTreeNode *node = ac_index_tree_find_offset (row->_children, idx, &childOffset);
+
+        if (node == NULL) {
+            return nil;
+        }
 
-    return GET_DATA (iter);
+        row = [row materializeChildNode:node];
+        if (row == nil) {
+            return nil;
+        }
+        idx -= childOffset;
+
+        if (idx == 0) {
+            return row;
+        }
+
+        // Skip over the row itself to get to its children
+        idx--;
+    }
+
+    return nil;
+}
+
+- (int)flattenedIndexOfIndices:(const int *)indices depth:(int)depth
+{
+    ACAccessibilityTreeRowElement *row = self;
+    int idx = -1;
+
+    for (int i = 0; i < depth; i++) {
+        AcIndexTreeNode *node;
+
+        if (row == nil || row->_children == NULL) {
+            return -1;
+        }
+
+        node = ac_index_tree_get_nth (row->_children, indices[i]);
+        if (node == NULL) {
+            return -1;
+        }
+
+        // Step over the parent row and then over the subtrees of the siblings before us
+        idx += 1 + ac_index_tree_node_get_offset (node);
+
+        // Placeholders don't have any children, so that is only a problem if there are more indices
+        row = GET_DATA (node);
+    }
+
+    return idx;
 }
 
 - (ACAccessibilityTreeRowElement *)childAtPath:(const char *)path
 {
-    ACAccessibilityTreeRowElement *child;
-    GSequenceIter *iter;
-    char *pathCopy, *p;
-    BOOL end;
-    int idx;
+    return [self childAtPath:path materialize:YES];
+}
+
+- (ACAccessibilityTreeRowElement *)existingChildAtPath:(const char *)path
+{
+    return [self childAtPath:path materialize:NO];
+}
+
+- (ACAccessibilityTreeRowElement *)childAtPath:(const char *)path materialize:(BOOL)materialize
+{
+    ACAccessibilityTreeRowElement *child = self;
+    const char *p = path;
 
     // g_print ("Child at path: %s (%p)\n", path ? path : "<null>", self);
     if (path == NULL) {
         return nil;
     }
 
-    pathCopy = g_strdup (path);
-    p = pathCopy;
+    // Parse the path in place, one index at a time
+    while (child != nil) {
+        char *end;
+        int idx = (int) strtol (p, &end, 10);
 
-    while (*p != ':' && *p != '\0') {
-        p++;
-    }
-    if (*p == '\0') {
-        end = YES;
-    } else {
-        *p = '\0';
-        end = NO;
-    }
+        if (end == p) {
+            return nil;
+        }
 
-    idx = atoi (pathCopy);
-    // g_print ("   Idx: %d (%s) - %s\n", idx, pathCopy, path);
-    child = [self childAtIndex:idx];
-    if (!end) {
-        char *nextPath = p + 1;
+        child = materialize ? [child childAtIndex:idx] : [child existingChildAtIndex:idx];
+        if (*end != ':') {
+            break;
+        }
 
-        // Recurse down until we reach the end of the path
-        // g_print ("   Checking child: %p for %s\n", child, nextPath);
-        child = [child childAtPath:nextPath];
-    } else {
-        // g_print ("At end\n");
+        p = end + 1;
     }
 
-    g_free (pathCopy);
     // g_print ("Returning %p\n", child);
     return child;
 }
 
+- (ACAccessibilityTreeRowElement *)childAtIndices:(const int *)indices depth:(int)depth materialize:(BOOL)materialize
+{
+    ACAccessibilityTreeRowElement *child = self;
+
+    for (int i = 0; i < depth && child != nil; i++) {
+        child = materialize ? [child childAtIndex:indices[i]] : [child existingChildAtIndex:indices[i]];
+    }
+
+    return child;
+}
+
 - (void)foreachChild:(void(^)(ACAccessibilityTreeRowElement *parent, ACAccessibilityTreeRowElement *child, void *userData))handler userData:(void *)userdata
 {
-    GSequenceIter *iter, *endIter;
+    AcIndexTreeNode *node;
 
     if (_children == NULL) {
         return;
     }
 
-    iter = g_sequence_get_begin_iter (_children);
-    endIter = g_sequence_get_end_iter (_children);
-    while (iter != endIter) {
-        ACAccessibilityTreeRowElement *element = GET_DATA (iter);
-        handler (self, GET_DATA (iter), userdata);
-        iter = g_sequence_iter_next (iter);
+    node = ac_index_tree_get_first (_children);
+    while (node != NULL) {
+        // Get the next node first, in case the handler removes this child
+        AcIndexTreeNode *next = ac_index_tree_node_next (node);
+        ACAccessibilityTreeRowElement *element = GET_DATA (node);
+
+        // Placeholder rows have no element to visit
+        if (element != nil) {
+            handler (self, element, userdata);
+        }
+        node = next;
     }
 }
 
@@ -622,58 +989,44 @@ last_path_index (const char *path)
 {
     _descendantCount += count;
     if (_parent != nil) {
+        // Keep our weight in the parent's index tree in sync with the size of our subtree
+        ac_index_tree_node_set_weight (_nodeInParent, _descendantCount + 1);
         [_parent adjustDescendantCountBy:count];
+    } else {
+        _rowGeneration++;
     }
 }
 
+- (NSUInteger)rowGeneration
+{
+    return [self rootRow]->_rowGeneration;
+}
+
 - (int)descendantCount
 {
     return _descendantCount;
 }
 
-- (int)indexInParent
+- (int)flattenedOffsetOfChildAtIndex:(int)idx
 {
-    int idx = 0;
-    GSequenceIter *siblingsIter;
+    AcIndexTreeNode *node = _children ? ac_index_tree_get_nth (_children, idx) : NULL;
 
-    if (_parent == nil) {
-        return 0;
-    }
-
-    // If none of the parent's children have descendants
-    // then the index in the parent is simply the last digit of the child's path
-    // so we don't need to iterate over all the children
-    if (![_parent childrenHaveDescendants]) {
-        GtkTreePath *path = [self rowPath];
-        if (path == NULL) {
-            // Row reference is now invalid. Probably during destruction
-            return 0;
-        }
-        char *pathString = gtk_tree_path_to_string (path);
-        gtk_tree_path_free (path);
-
-        idx = last_path_index (pathString);
-        g_free (pathString);
+    return node ? ac_index_tree_node_get_offset (node) : -1;
+}
 
-        return idx;
-    }
+- (int)childCount
+{
+    return _children ? ac_index_tree_get_length (_children) : 0;
+}
 
-    siblingsIter = _iterInParent;
-    if (g_sequence_iter_is_begin (siblingsIter)) {
+- (int)indexInParent
+{
+    if (_parent == nil || _nodeInParent == NULL) {
         return 0;
     }
 
-    while ((siblingsIter = g_sequence_iter_prev(siblingsIter))) {
-        idx++;
-        ACAccessibilityTreeRowElement *e = GET_DATA (siblingsIter);
-        idx += e->_descendantCount;
-
-        if (g_sequence_iter_is_begin(siblingsIter)) {
-            break;
-        }
-    }
-
-    return idx;
+    // The offset of our node is the sum of the subtree sizes of all our previous siblings
+    return ac_index_tree_node_get_offset (_nodeInParent);
 }
 
 - (int)indexFromPath:(const char *)path
@@ -684,37 +1037,33 @@ last_path_index (const char *path)
 
 - (void)reorderChildrenToNewIndicies:(int *)indicies
 {
-    GSequence *childrenCopy;
-    GSequenceIter *orig, *end;
-
     if (_children == NULL) {
         return;
     }
 
-    childrenCopy = g_sequence_new (remove_child);
-    for (int i = 0; i < g_sequence_get_length (_children); i++) {
-        GSequenceIter *idx = g_sequence_get_iter_at_pos (_children, indicies[i]);
+    // The children keep their nodes and their weights, so there's nothing to fix up in the rest of the tree
+    if (!ac_index_tree_reorder (_children, indicies)) {
+        g_warning ("Invalid reorder for row %p", self);
+        return;
+    }
 
-        if (g_sequence_iter_is_end (idx)) {
-            return;
-        }
+    [self rootRow]->_rowGeneration++;
 
-        ACAccessibilityTreeRowElement *e = GET_DATA (idx);
+    // The visible rows follow the children's order, which is already O(n) to change
+    [_visibleRows removeAllObjects];
+    for (AcIndexTreeNode *node = ac_index_tree_get_first (_children); node; node = ac_index_tree_node_next (node)) {
+        ACAccessibilityTreeRowElement *child = GET_DATA (node);
 
-        if (e == NULL) {
-            continue;
+        if (child != nil) {
+            [_visibleRows addObject:child];
         }
-        e->_iterInParent = g_sequence_append (childrenCopy, (void *) CFBridgingRetain (e));
     }
-
-    g_sequence_free (_children);
-    _children = childrenCopy;
 }
 
 - (void)dumpChildrenRecursive:(BOOL)recurse
 {
     GtkTreePath *path = [self rowPath];
-    g_print ("%s (%d)\n", path ? gtk_tree_path_to_string (path) : "<null>", _children ? g_sequence_get_length (_children): 0 );
+    g_print ("%s (%d)\n", path ? gtk_tree_path_to_string (path) : "<null>", _children ? ac_index_tree_get_length (_children): 0 );
 
     if (_children == NULL) {
         return;
@@ -723,13 +1072,17 @@ last_path_index (const char *path)
     if (!recurse) {
         return;
     }
-    for (int i = 0; i < g_sequence_get_length (_children); i++) {
-        ACAccessibilityTreeRowElement *e = GET_DATA (g_sequence_get_iter_at_pos (_children, i));
+    for (AcIndexTreeNode *node = ac_index_tree_get_first (_children); node; node = ac_index_tree_node_next (node)) {
+        ACAccessibilityTreeRowElement *e = GET_DATA (node);
+        if (e == nil) {
+            g_print ("<placeholder>\n");
+            continue;
+        }
         [e dumpChildrenRecursive:YES];
     }
 }
 
-- (void)recursiveFlattenTreeIntoArray:(NSMutableArray *)arr addingSelf:(BOOL)addSelf currentIndex:(int *)index
+- (void)recursiveFlattenTreeIntoArray:(NSMutableArray *)arr addingSelf:(BOOL)addSelf currentIndex:(int *)index materialize:(BOOL)materialize
 {
     if (addSelf) {
         [self setAccessibilityIndex:*index];
@@ -738,25 +1091,41 @@ last_path_index (const char *path)
         (*index)++;
     }
 
-    if (_children == NULL || g_sequence_get_length (_children) == 0) {
+    if (_children == NULL) {
         return;
     }
 
-    GSequenceIter *iter = g_sequence_get_begin_iter (_children);
+    for (AcIndexTreeNode *node = ac_index_tree_get_first (_children); node; node = ac_index_tree_node_next (node)) {
+        ACAccessibilityTreeRowElement *r;
 
-    while (!g_sequence_iter_is_end (iter)) {
-        ACAccessibilityTreeRowElement *r = GET_DATA (iter);
+        // Placeholders have no children, so they only take up their own slot
+        if (!materialize && GET_DATA (node) == nil) {
+            [arr addObject:[NSNull null]];
+            (*index)++;
+            continue;
+        }
+
+        r = [self materializeChildNode:node];
+        if (r == nil) {
+            continue;
+        }
 
-        [r recursiveFlattenTreeIntoArray:arr addingSelf:YES currentIndex:index];
-        iter = g_sequence_iter_next (iter);
+        [r recursiveFlattenTreeIntoArray:arr addingSelf:YES currentIndex:index materialize:materialize];
     }
 }
 
 - (void)flattenTreeInto:(NSMutableArray *)arr
 {
+    // Flattening needs every row, so any placeholders get their elements now
+    [self flattenTreeInto:arr materialize:YES];
+}
+
+- (void)flattenTreeInto:(NSMutableArray *)arr materialize:(BOOL)materialize
+{
+    AC_PROFILE_SCOPE (TREEWIDGET, "flattenTreeInto:");
     int index = 1;
     // Don't want to add the fake root node to the tree.
-    [self recursiveFlattenTreeIntoArray:arr addingSelf:NO currentIndex:&index];
+    [self recursiveFlattenTreeIntoArray:arr addingSelf:NO currentIndex:&index materialize:materialize];
 }
 
 - (NSArray *)flattenTree
@@ -769,7 +1138,7 @@ last_path_index (const char *path)
 
     int index = 1;
     // Don't want to add the fake root node to the tree.
-    [self recursiveFlattenTreeIntoArray:flat addingSelf:NO currentIndex:&index];
+    [self recursiveFlattenTreeIntoArray:flat addingSelf:NO currentIndex:&index materialize:YES];
 
     return flat;
 }
@@ -0,0 +1,436 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib-object.h>
+#include <glib-unix.h>
+#ifdef __APPLE__
+#include <mach/mach_time.h>
+#endif
+#include "atk-cocoa/acdebug.h"
+
+#define ATKCOCOA_PROFILE_ENV "ATKCOCOA_PROFILE"
+#define ATKCOCOA_PROFILE_FILE_ENV "ATKCOCOA_PROFILE_FILE"
+#define ATKCOCOA_TRACE_ENV "ATKCOCOA_TRACE"
+#define ATKCOCOA_TRACE_FILE_ENV "ATKCOCOA_TRACE_FILE"
+
+/* Must be a power of two */
+#define TRACE_RING_SIZE (1 << 16)
+#define TRACE_WRITE_INTERVAL_US (100 * 1000)
+
+guint ac_profile_flags = 0;
+guint ac_trace_flags = 0;
+
+/* A slot is complete when its sequence is the index it was written at + 1. The writer
+ * thread checks it again after copying the slot out, in case it was overwritten meanwhile */
+typedef struct {
+  guint64 sequence;
+  AcProfileSite *site;
+  const char *type_name;
+  guint64 start;
+  guint64 duration;
+  guint32 thread_id;
+} TraceEvent;
+
+static TraceEvent *trace_ring = NULL;
+static guint64 trace_head = 0; /* Next index to write, shared by every thread */
+static guint64 trace_tail = 0; /* Next index to read, only used by the writer thread */
+static guint64 trace_dropped = 0;
+static guint64 trace_start = 0;
+static guint32 trace_next_thread_id = 0;
+static gboolean trace_running = FALSE;
+static gboolean trace_first_event = TRUE;
+static GThread *trace_thread = NULL;
+static FILE *trace_file = NULL;
+
+/* Sites are pushed onto this list the first time they record anything */
+static AcProfileSite *profile_sites = NULL;
+static const GDebugKey *profile_keys = NULL;
+static guint profile_n_keys = 0;
+
+guint64
+ac_profile_now (void)
+{
+#ifdef __APPLE__
+  static mach_timebase_info_data_t timebase;
+
+  if (timebase.denom == 0) {
+    mach_timebase_info (&timebase);
+  }
+  return mach_absolute_time () * timebase.numer / timebase.denom;
+#else
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+#endif
+}
+
+/* Four buckets per power of two, which keeps the percentiles within 25% */
+static guint
+bucket_for_value (guint64 value)
+{
+  guint exponent;
+
+  if (value < 4) {
+    return (guint)value;
+  }
+
+  exponent = 63 - __builtin_clzll (value);
+  return 4 * (exponent - 1) + ((value >> (exponent - 2)) & 3);
+}
+
+static guint64
+bucket_lower_bound (guint bucket)
+{
+  guint exponent;
+
+  if (bucket < 4) {
+    return bucket;
+  }
+
+  exponent = bucket / 4 + 1;
+  return (G_GUINT64_CONSTANT (4) | (bucket % 4)) << (exponent - 2);
+}
+
+static void
+register_site (AcProfileSite *site)
+{
+  AcProfileSite *head;
+  gint unregistered = 0;
+
+  if (!__atomic_compare_exchange_n (&site->registered, &unregistered, 1, FALSE,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+
+  head = __atomic_load_n (&profile_sites, __ATOMIC_ACQUIRE);
+  do {
+    site->next = head;
+  } while (!__atomic_compare_exchange_n (&profile_sites, &head, site, TRUE,
+                                         __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+
+void
+ac_profile_record (AcProfileSite *site,
+                   guint64 value)
+{
+  guint64 max;
+
+  if (G_UNLIKELY (__atomic_load_n (&site->registered, __ATOMIC_RELAXED) == 0)) {
+    register_site (site);
+  }
+
+  __atomic_add_fetch (&site->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&site->total, value, __ATOMIC_RELAXED);
+
+  max = __atomic_load_n (&site->max, __ATOMIC_RELAXED);
+  while (value > max &&
+         !__atomic_compare_exchange_n (&site->max, &max, value, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+
+  if (site->is_timer) {
+    __atomic_add_fetch (&site->buckets[bucket_for_value (value)], 1, __ATOMIC_RELAXED);
+  }
+}
+
+static guint64
+site_percentile (AcProfileSite *site,
+                 guint64 count,
+                 double percentile)
+{
+  guint64 target, seen = 0;
+  guint64 max = __atomic_load_n (&site->max, __ATOMIC_RELAXED);
+  guint i;
+
+  target = (guint64)(count * percentile + 0.5);
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (i = 0; i < AC_PROFILE_N_BUCKETS; i++) {
+    seen += __atomic_load_n (&site->buckets[i], __ATOMIC_RELAXED);
+    if (seen >= target) {
+      // The top of the bucket, which is never more than the largest time seen
+      guint64 upper = i + 1 < AC_PROFILE_N_BUCKETS ? bucket_lower_bound (i + 1) - 1 : max;
+      return MIN (upper, max);
+    }
+  }
+
+  return max;
+}
+
+static const char *
+category_name (guint category)
+{
+  guint i;
+
+  for (i = 0; i < profile_n_keys; i++) {
+    if (profile_keys[i].value == category) {
+      return profile_keys[i].key;
+    }
+  }
+
+  return "other";
+}
+
+static void
+dump_site (FILE *out,
+           AcProfileSite *site)
+{
+  guint64 count = __atomic_load_n (&site->count, __ATOMIC_RELAXED);
+  guint64 total = __atomic_load_n (&site->total, __ATOMIC_RELAXED);
+
+  if (count == 0) {
+    return;
+  }
+
+  if (site->is_timer) {
+    fprintf (out, "%-12s %-40s %10" G_GUINT64_FORMAT " calls  p50 %10.3f  p99 %10.3f  max %10.3f  total %12.3f ms\n",
+             category_name (site->category), site->name, count,
+             site_percentile (site, count, 0.50) / 1e6,
+             site_percentile (site, count, 0.99) / 1e6,
+             __atomic_load_n (&site->max, __ATOMIC_RELAXED) / 1e6,
+             total / 1e6);
+  } else {
+    fprintf (out, "%-12s %-40s %10" G_GUINT64_FORMAT " times  total %12" G_GUINT64_FORMAT "  max %10" G_GUINT64_FORMAT "\n",
+             category_name (site->category), site->name, count, total,
+             __atomic_load_n (&site->max, __ATOMIC_RELAXED));
+  }
+}
+
+void
+ac_profile_dump (void)
+{
+  const char *path = g_getenv (ATKCOCOA_PROFILE_FILE_ENV);
+  FILE *out = stderr;
+  AcProfileSite *site;
+  guint i;
+
+  if (ac_profile_flags == 0) {
+    return;
+  }
+
+  if (path != NULL) {
+    out = fopen (path, "a");
+    if (out == NULL) {
+      g_warning ("Cannot open %s for the profile", path);
+      return;
+    }
+  }
+
+  fprintf (out, "ATK-Cocoa profile (times in ms)\n");
+
+  // Grouped by category, in the order of the debug keys
+  for (i = 0; i < profile_n_keys; i++) {
+    for (site = __atomic_load_n (&profile_sites, __ATOMIC_ACQUIRE); site; site = site->next) {
+      if (site->category == profile_keys[i].value) {
+        dump_site (out, site);
+      }
+    }
+  }
+
+  if (out != stderr) {
+    fclose (out);
+  }
+}
+
+/* Scopes are written as one complete event when they end, which halves the events and
+ * can't leave an unmatched begin in the trace when the ring drops some */
+void
+ac_trace_event (AcProfileSite *site,
+                const char *type_name,
+                guint64 start,
+                guint64 duration)
+{
+  static __thread guint32 thread_id = 0;
+  TraceEvent *event;
+  guint64 index;
+
+  if (G_UNLIKELY (thread_id == 0)) {
+    thread_id = __atomic_add_fetch (&trace_next_thread_id, 1, __ATOMIC_RELAXED);
+  }
+
+  index = __atomic_fetch_add (&trace_head, 1, __ATOMIC_ACQ_REL);
+  event = &trace_ring[index & (TRACE_RING_SIZE - 1)];
+
+  // Mark the slot as being written before filling it in. The fence keeps the stores below
+  // from being seen before the mark
+  __atomic_store_n (&event->sequence, 0, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  event->site = site;
+  event->type_name = type_name;
+  event->start = start;
+  event->duration = duration;
+  event->thread_id = thread_id;
+  __atomic_store_n (&event->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+static void
+write_trace_event (const TraceEvent *event)
+{
+  // The names are string literals and GType names, so nothing needs escaping
+  fprintf (trace_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u",
+           trace_first_event ? "" : ",\n",
+           event->site->name, category_name (event->site->category),
+           (event->start - trace_start) / 1000.0, event->duration / 1000.0, (int)getpid (), event->thread_id);
+  if (event->type_name) {
+    fprintf (trace_file, ",\"args\":{\"type\":\"%s\"}", event->type_name);
+  }
+  fputc ('}', trace_file);
+
+  trace_first_event = FALSE;
+}
+
+/* Writes out everything that has been completed since the last time */
+static void
+drain_trace_ring (void)
+{
+  guint64 head = __atomic_load_n (&trace_head, __ATOMIC_ACQUIRE);
+
+  // The writers have lapped us, so the oldest events are gone
+  if (head - trace_tail > TRACE_RING_SIZE) {
+    trace_dropped += head - trace_tail - TRACE_RING_SIZE;
+    trace_tail = head - TRACE_RING_SIZE;
+  }
+
+  for (; trace_tail < head; trace_tail++) {
+    TraceEvent *slot = &trace_ring[trace_tail & (TRACE_RING_SIZE - 1)];
+    TraceEvent event;
+    guint64 sequence = __atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE);
+
+    if (sequence == 0 || sequence < trace_tail + 1) {
+      // Still being written, pick it up next time
+      break;
+    }
+
+    event = *slot;
+    // Keeps the copy above from being read after the check below
+    __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    if (sequence != trace_tail + 1 || __atomic_load_n (&slot->sequence, __ATOMIC_RELAXED) != sequence) {
+      trace_dropped++;
+      continue;
+    }
+
+    write_trace_event (&event);
+  }
+
+  fflush (trace_file);
+}
+
+static gpointer
+trace_writer_thread (gpointer data)
+{
+  while (__atomic_load_n (&trace_running, __ATOMIC_ACQUIRE)) {
+    g_usleep (TRACE_WRITE_INTERVAL_US);
+    drain_trace_ring ();
+  }
+
+  return NULL;
+}
+
+static void
+stop_trace (void)
+{
+  ac_trace_flags = 0;
+
+  __atomic_store_n (&trace_running, FALSE, __ATOMIC_RELEASE);
+  g_thread_join (trace_thread);
+
+  drain_trace_ring ();
+  fputs ("\n]\n", trace_file);
+  fclose (trace_file);
+
+  if (trace_dropped > 0) {
+    g_printerr ("ATK-Cocoa trace dropped %" G_GUINT64_FORMAT " events\n", trace_dropped);
+  }
+}
+
+static void
+start_trace (const GDebugKey *keys,
+             guint n_keys)
+{
+  const char *path = g_getenv (ATKCOCOA_TRACE_FILE_ENV);
+  const char *categories = g_getenv (ATKCOCOA_TRACE_ENV);
+  guint i;
+
+  if (path == NULL) {
+    return;
+  }
+
+  trace_file = fopen (path, "w");
+  if (trace_file == NULL) {
+    g_warning ("Cannot open %s for the trace", path);
+    return;
+  }
+
+  if (categories) {
+    ac_trace_flags = g_parse_debug_string (categories, keys, n_keys);
+  } else {
+    for (i = 0; i < n_keys; i++) {
+      ac_trace_flags |= keys[i].value;
+    }
+  }
+
+  trace_ring = g_new0 (TraceEvent, TRACE_RING_SIZE);
+  trace_start = ac_profile_now ();
+  fputs ("[\n", trace_file);
+
+  trace_running = TRUE;
+  trace_thread = g_thread_new ("atkcocoa-trace", trace_writer_thread, NULL);
+  atexit (stop_trace);
+}
+
+static gboolean
+dump_on_signal (gpointer data)
+{
+  ac_profile_dump ();
+  return TRUE;
+}
+
+void
+ac_profile_init (const GDebugKey *keys,
+                 guint n_keys)
+{
+  const char *profile = g_getenv (ATKCOCOA_PROFILE_ENV);
+
+  profile_keys = keys;
+  profile_n_keys = n_keys;
+
+  start_trace (keys, n_keys);
+
+  if (profile == NULL) {
+    return;
+  }
+
+  ac_profile_flags = g_parse_debug_string (profile, keys, n_keys);
+  if (ac_profile_flags == 0) {
+    return;
+  }
+
+  // The signal is handled on the main loop, so the dump doesn't run inside a signal handler
+  g_unix_signal_add (SIGUSR1, dump_on_signal, NULL);
+  atexit (ac_profile_dump);
+}
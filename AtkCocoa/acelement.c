@@ -442,6 +442,8 @@ ac_element_add_child (AcElement *parent,
 	id<NSAccessibility> parent_element, child_element;
 	id<NSAccessibility> realChildAdded;
 
+	AC_PROFILE_SCOPE_FOR (TREE, "ac_element_add_child", child);
+
 	g_return_if_fail (AC_IS_ELEMENT (parent));
 	g_return_if_fail (AC_IS_ELEMENT (child));
 
@@ -608,6 +610,8 @@ ac_element_remove_child (AcElement *parent,
     GtkWidget *childWidget;
 	id<NSAccessibility> parent_element, child_element;
 
+	AC_PROFILE_SCOPE_FOR (TREE, "ac_element_remove_child", child);
+
 	g_return_if_fail (AC_IS_ELEMENT (parent));
 	g_return_if_fail (AC_IS_ELEMENT (child));
 
@@ -883,6 +887,7 @@ ac_element_notify (AcElement *element,
 				   NSString *notificationName,
 				   NSDictionary *userInfo)
 {
+	AC_PROFILE_SCOPE_FOR (WIDGETS, "ac_element_notify", element);
 	id realElement = ac_element_get_accessibility_element (element);
     if (realElement == NULL) {
         return;
@@ -0,0 +1,580 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "atk-cocoa/acindextree.h"
+
+/* The tree is a treap: ordered by position, heap ordered by a random priority,
+ * which keeps it balanced in expectation without any rotations bookkeeping. */
+struct _AcIndexTreeNode {
+  AcIndexTreeNode *left;
+  AcIndexTreeNode *right;
+  AcIndexTreeNode *parent;
+
+  guint32 priority;
+  int count; /* Number of nodes in this subtree */
+  int filled; /* Number of nodes with data in this subtree */
+  int weight;
+  int total; /* Sum of the weights in this subtree */
+
+  gpointer data;
+};
+
+struct _AcIndexTree {
+  AcIndexTreeNode *root;
+  GDestroyNotify data_destroy;
+  guint32 seed;
+};
+
+#define NODE_COUNT(n) ((n) ? (n)->count : 0)
+#define NODE_TOTAL(n) ((n) ? (n)->total : 0)
+#define NODE_FILLED(n) ((n) ? (n)->filled : 0)
+
+static guint32
+next_priority (AcIndexTree *tree)
+{
+  /* xorshift32 */
+  guint32 x = tree->seed;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  tree->seed = x;
+
+  return x;
+}
+
+static void
+node_update (AcIndexTreeNode *node)
+{
+  node->count = 1 + NODE_COUNT (node->left) + NODE_COUNT (node->right);
+  node->total = node->weight + NODE_TOTAL (node->left) + NODE_TOTAL (node->right);
+  node->filled = (node->data != NULL) + NODE_FILLED (node->left) + NODE_FILLED (node->right);
+
+  if (node->left) {
+    node->left->parent = node;
+  }
+  if (node->right) {
+    node->right->parent = node;
+  }
+}
+
+/* Splits the first @position nodes of @node into @left and the rest into @right */
+static void
+node_split (AcIndexTreeNode *node,
+            int position,
+            AcIndexTreeNode **left,
+            AcIndexTreeNode **right)
+{
+  if (node == NULL) {
+    *left = NULL;
+    *right = NULL;
+    return;
+  }
+
+  if (NODE_COUNT (node->left) < position) {
+    node_split (node->right, position - NODE_COUNT (node->left) - 1, &node->right, right);
+    node_update (node);
+    *left = node;
+  } else {
+    node_split (node->left, position, left, &node->left);
+    node_update (node);
+    *right = node;
+  }
+
+  if (*left) {
+    (*left)->parent = NULL;
+  }
+  if (*right) {
+    (*right)->parent = NULL;
+  }
+}
+
+static AcIndexTreeNode *
+node_merge (AcIndexTreeNode *left,
+            AcIndexTreeNode *right)
+{
+  if (left == NULL) {
+    return right;
+  }
+
+  if (right == NULL) {
+    return left;
+  }
+
+  if (left->priority > right->priority) {
+    left->right = node_merge (left->right, right);
+    node_update (left);
+    return left;
+  }
+
+  right->left = node_merge (left, right->left);
+  node_update (right);
+  return right;
+}
+
+static void
+set_root (AcIndexTree *tree,
+          AcIndexTreeNode *root)
+{
+  tree->root = root;
+  if (root) {
+    root->parent = NULL;
+  }
+}
+
+static void
+node_free_recursive (AcIndexTree *tree,
+                     AcIndexTreeNode *node)
+{
+  if (node == NULL) {
+    return;
+  }
+
+  node_free_recursive (tree, node->left);
+  node_free_recursive (tree, node->right);
+
+  if (tree->data_destroy) {
+    tree->data_destroy (node->data);
+  }
+  g_slice_free (AcIndexTreeNode, node);
+}
+
+AcIndexTree *
+ac_index_tree_new (GDestroyNotify data_destroy)
+{
+  AcIndexTree *tree = g_slice_new0 (AcIndexTree);
+
+  tree->data_destroy = data_destroy;
+  tree->seed = g_random_int () | 1;
+
+  return tree;
+}
+
+void
+ac_index_tree_free (AcIndexTree *tree)
+{
+  AcIndexTreeNode *root;
+
+  if (tree == NULL) {
+    return;
+  }
+
+  // Detach the nodes first so that destroy notifiers never see a half freed tree
+  root = tree->root;
+  tree->root = NULL;
+
+  node_free_recursive (tree, root);
+  g_slice_free (AcIndexTree, tree);
+}
+
+int
+ac_index_tree_get_length (AcIndexTree *tree)
+{
+  return NODE_COUNT (tree->root);
+}
+
+int
+ac_index_tree_get_weight (AcIndexTree *tree)
+{
+  return NODE_TOTAL (tree->root);
+}
+
+AcIndexTreeNode *
+ac_index_tree_insert (AcIndexTree *tree,
+                      int position,
+                      gpointer data,
+                      int weight)
+{
+  AcIndexTreeNode *node, *left, *right;
+
+  position = CLAMP (position, 0, NODE_COUNT (tree->root));
+
+  node = g_slice_new0 (AcIndexTreeNode);
+  node->priority = next_priority (tree);
+  node->weight = weight;
+  node->data = data;
+  node_update (node);
+
+  node_split (tree->root, position, &left, &right);
+  set_root (tree, node_merge (node_merge (left, node), right));
+
+  return node;
+}
+
+static void
+node_update_recursive (AcIndexTreeNode *node)
+{
+  if (node == NULL) {
+    return;
+  }
+
+  node_update_recursive (node->left);
+  node_update_recursive (node->right);
+  node_update (node);
+}
+
+void
+ac_index_tree_insert_many (AcIndexTree *tree,
+                           int position,
+                           gpointer *data,
+                           const int *weights,
+                           int n_nodes,
+                           AcIndexTreeNode **nodes)
+{
+  AcIndexTreeNode **spine, **run, *left, *right;
+  int i, depth;
+
+  if (n_nodes <= 0) {
+    return;
+  }
+
+  position = CLAMP (position, 0, NODE_COUNT (tree->root));
+
+  run = nodes ? nodes : g_new (AcIndexTreeNode *, n_nodes);
+  spine = g_new (AcIndexTreeNode *, n_nodes);
+  depth = 0;
+
+  // The nodes are already in order, so the run can be built as a treap in one pass
+  // by keeping its right spine as a stack, rather than split and merged in one at a time
+  for (i = 0; i < n_nodes; i++) {
+    AcIndexTreeNode *node, *last = NULL;
+
+    node = g_slice_new0 (AcIndexTreeNode);
+    node->priority = next_priority (tree);
+    node->weight = weights ? weights[i] : 1;
+    node->data = data ? data[i] : NULL;
+    run[i] = node;
+
+    while (depth > 0 && spine[depth - 1]->priority < node->priority) {
+      last = spine[--depth];
+    }
+
+    node->left = last;
+    if (depth > 0) {
+      spine[depth - 1]->right = node;
+    }
+    spine[depth++] = node;
+  }
+
+  node_update_recursive (spine[0]);
+
+  node_split (tree->root, position, &left, &right);
+  set_root (tree, node_merge (node_merge (left, spine[0]), right));
+
+  g_free (spine);
+  if (run != nodes) {
+    g_free (run);
+  }
+}
+
+AcIndexTreeNode *
+ac_index_tree_append (AcIndexTree *tree,
+                      gpointer data,
+                      int weight)
+{
+  return ac_index_tree_insert (tree, NODE_COUNT (tree->root), data, weight);
+}
+
+void
+ac_index_tree_remove (AcIndexTree *tree,
+                      AcIndexTreeNode *node)
+{
+  AcIndexTreeNode *parent, *replacement;
+  gpointer data;
+
+  g_return_if_fail (node != NULL);
+
+  // Replace the node by the merge of its two children and fix up the counts
+  // on the way back to the root
+  parent = node->parent;
+  replacement = node_merge (node->left, node->right);
+
+  if (parent == NULL) {
+    set_root (tree, replacement);
+  } else {
+    if (parent->left == node) {
+      parent->left = replacement;
+    } else {
+      parent->right = replacement;
+    }
+
+    if (replacement) {
+      replacement->parent = parent;
+    }
+
+    for (; parent; parent = parent->parent) {
+      node_update (parent);
+    }
+  }
+
+  data = node->data;
+  g_slice_free (AcIndexTreeNode, node);
+
+  if (tree->data_destroy) {
+    tree->data_destroy (data);
+  }
+}
+
+gboolean
+ac_index_tree_reorder (AcIndexTree *tree,
+                       const int *new_order)
+{
+  AcIndexTreeNode **nodes, *node, *root;
+  guint8 *seen;
+  int length, i;
+
+  length = NODE_COUNT (tree->root);
+  if (length == 0) {
+    return TRUE;
+  }
+
+  // Anything other than a permutation would merge a node twice and orphan another
+  seen = g_new0 (guint8, (length + 7) / 8);
+  for (i = 0; i < length; i++) {
+    int old_position = new_order[i];
+
+    if (old_position < 0 || old_position >= length ||
+        (seen[old_position / 8] & (1 << (old_position % 8)))) {
+      g_free (seen);
+      return FALSE;
+    }
+
+    seen[old_position / 8] |= 1 << (old_position % 8);
+  }
+  g_free (seen);
+
+  nodes = g_new (AcIndexTreeNode *, length);
+  for (node = ac_index_tree_get_first (tree), i = 0; node; node = ac_index_tree_node_next (node), i++) {
+    nodes[i] = node;
+  }
+
+  // The weights don't change so there is no need to walk the parent tree,
+  // just rebuild the node structure in the new order.
+  root = NULL;
+  for (i = 0; i < length; i++) {
+    node = nodes[new_order[i]];
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = NULL;
+    node_update (node);
+
+    root = node_merge (root, node);
+  }
+
+  set_root (tree, root);
+  g_free (nodes);
+
+  return TRUE;
+}
+
+AcIndexTreeNode *
+ac_index_tree_get_first (AcIndexTree *tree)
+{
+  AcIndexTreeNode *node = tree->root;
+
+  if (node == NULL) {
+    return NULL;
+  }
+
+  while (node->left) {
+    node = node->left;
+  }
+
+  return node;
+}
+
+AcIndexTreeNode *
+ac_index_tree_get_nth (AcIndexTree *tree,
+                       int position)
+{
+  AcIndexTreeNode *node = tree->root;
+
+  if (position < 0 || position >= NODE_COUNT (node)) {
+    return NULL;
+  }
+
+  while (node) {
+    int leftCount = NODE_COUNT (node->left);
+
+    if (position < leftCount) {
+      node = node->left;
+    } else if (position == leftCount) {
+      return node;
+    } else {
+      position -= leftCount + 1;
+      node = node->right;
+    }
+  }
+
+  return NULL;
+}
+
+AcIndexTreeNode *
+ac_index_tree_find_offset (AcIndexTree *tree,
+                           int offset,
+                           int *node_offset)
+{
+  AcIndexTreeNode *node = tree->root;
+  int base = 0;
+
+  if (offset < 0 || offset >= NODE_TOTAL (node)) {
+    return NULL;
+  }
+
+  while (node) {
+    int leftTotal = NODE_TOTAL (node->left);
+
+    if (offset < leftTotal) {
+      node = node->left;
+    } else if (offset < leftTotal + node->weight) {
+      if (node_offset) {
+        *node_offset = base + leftTotal;
+      }
+      return node;
+    } else {
+      offset -= leftTotal + node->weight;
+      base += leftTotal + node->weight;
+      node = node->right;
+    }
+  }
+
+  return NULL;
+}
+
+gpointer
+ac_index_tree_node_get_data (AcIndexTreeNode *node)
+{
+  return node->data;
+}
+
+void
+ac_index_tree_node_set_data (AcIndexTreeNode *node,
+                             gpointer data)
+{
+  int delta = (data != NULL) - (node->data != NULL);
+
+  node->data = data;
+  if (delta == 0) {
+    return;
+  }
+
+  for (; node; node = node->parent) {
+    node->filled += delta;
+  }
+}
+
+int
+ac_index_tree_node_get_weight (AcIndexTreeNode *node)
+{
+  return node->weight;
+}
+
+void
+ac_index_tree_node_set_weight (AcIndexTreeNode *node,
+                               int weight)
+{
+  int delta = weight - node->weight;
+
+  if (delta == 0) {
+    return;
+  }
+
+  node->weight = weight;
+  for (; node; node = node->parent) {
+    node->total += delta;
+  }
+}
+
+int
+ac_index_tree_node_get_position (AcIndexTreeNode *node)
+{
+  int position = NODE_COUNT (node->left);
+
+  for (; node->parent; node = node->parent) {
+    if (node->parent->right == node) {
+      position += NODE_COUNT (node->parent->left) + 1;
+    }
+  }
+
+  return position;
+}
+
+int
+ac_index_tree_node_get_filled_position (AcIndexTreeNode *node)
+{
+  int position = NODE_FILLED (node->left);
+
+  for (; node->parent; node = node->parent) {
+    if (node->parent->right == node) {
+      position += NODE_FILLED (node->parent->left) + (node->parent->data != NULL);
+    }
+  }
+
+  return position;
+}
+
+int
+ac_index_tree_node_get_offset (AcIndexTreeNode *node)
+{
+  int offset = NODE_TOTAL (node->left);
+
+  for (; node->parent; node = node->parent) {
+    if (node->parent->right == node) {
+      offset += NODE_TOTAL (node->parent->left) + node->parent->weight;
+    }
+  }
+
+  return offset;
+}
+
+AcIndexTreeNode *
+ac_index_tree_node_next (AcIndexTreeNode *node)
+{
+  if (node->right) {
+    node = node->right;
+    while (node->left) {
+      node = node->left;
+    }
+    return node;
+  }
+
+  while (node->parent && node->parent->right == node) {
+    node = node->parent;
+  }
+
+  return node->parent;
+}
+
+AcIndexTreeNode *
+ac_index_tree_node_prev (AcIndexTreeNode *node)
+{
+  if (node->left) {
+    node = node->left;
+    while (node->right) {
+      node = node->right;
+    }
+    return node;
+  }
+
+  while (node->parent && node->parent->left == node) {
+    node = node->parent;
+  }
+
+  return node->parent;
+}
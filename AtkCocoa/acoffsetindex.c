@@ -0,0 +1,517 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "atk-cocoa/acoffsetindex.h"
+
+/* The most characters between two checkpoints, and so the longest walk a conversion makes */
+#define CHECKPOINT_STRIDE 64
+
+typedef struct {
+  int offsets[AC_OFFSET_N_UNITS];
+} AcOffsetPosition;
+
+struct _AcOffsetIndex {
+  GString *text;
+  AcOffsetPosition end;
+
+  /* Sorted, the first one is always the start of the text and none of them is at the end */
+  GArray *checkpoints;
+};
+
+#define CHECKPOINT(index, i) (g_array_index ((index)->checkpoints, AcOffsetPosition, (i)))
+
+/* Moves pos over the character at it */
+static void
+position_next (AcOffsetIndex *index,
+               AcOffsetPosition *pos)
+{
+  const char *p = index->text->str + pos->offsets[AC_OFFSET_BYTES];
+  guchar c = (guchar)*p;
+
+  if (c < 0x80)
+    {
+      pos->offsets[AC_OFFSET_BYTES]++;
+      pos->offsets[AC_OFFSET_UTF16]++;
+    }
+  else
+    {
+      pos->offsets[AC_OFFSET_BYTES] += g_utf8_skip[c];
+      // Characters outside the BMP take a surrogate pair, and their UTF-8 is 4 bytes
+      pos->offsets[AC_OFFSET_UTF16] += (c >= 0xf0) ? 2 : 1;
+    }
+  pos->offsets[AC_OFFSET_CHARS]++;
+}
+
+static int
+position_step (AcOffsetIndex *index,
+               AcOffsetPosition *pos,
+               AcOffsetUnit unit)
+{
+  AcOffsetPosition next = *pos;
+
+  position_next (index, &next);
+  return next.offsets[unit] - pos->offsets[unit];
+}
+
+/* Walks pos forward as far as it can go without passing offset in unit */
+static void
+position_walk (AcOffsetIndex *index,
+               AcOffsetPosition *pos,
+               AcOffsetUnit unit,
+               int offset)
+{
+  while (pos->offsets[AC_OFFSET_CHARS] < index->end.offsets[AC_OFFSET_CHARS] &&
+         pos->offsets[unit] + position_step (index, pos, unit) <= offset)
+    position_next (index, pos);
+}
+
+/* The last checkpoint at or before offset in unit */
+static guint
+find_checkpoint (AcOffsetIndex *index,
+                 int offset,
+                 AcOffsetUnit unit)
+{
+  guint low = 0, high = index->checkpoints->len;
+
+  while (high - low > 1)
+    {
+      guint mid = (low + high) / 2;
+
+      if (CHECKPOINT (index, mid).offsets[unit] <= offset)
+        low = mid;
+      else
+        high = mid;
+    }
+
+  return low;
+}
+
+static AcOffsetPosition
+find_position (AcOffsetIndex *index,
+               int offset,
+               AcOffsetUnit unit)
+{
+  AcOffsetPosition pos;
+
+  pos = CHECKPOINT (index, find_checkpoint (index, offset, unit));
+  position_walk (index, &pos, unit, offset);
+
+  return pos;
+}
+
+/* Adds checkpoints between checkpoint i and the one after it, or the end of the text,
+ * so they are no more than CHECKPOINT_STRIDE characters apart */
+static void
+lay_out_checkpoints (AcOffsetIndex *index,
+                     guint i)
+{
+  AcOffsetPosition pos = CHECKPOINT (index, i);
+  int limit;
+  GArray *added;
+
+  if (i + 1 < index->checkpoints->len)
+    limit = CHECKPOINT (index, i + 1).offsets[AC_OFFSET_CHARS];
+  else
+    limit = index->end.offsets[AC_OFFSET_CHARS];
+
+  if (limit - pos.offsets[AC_OFFSET_CHARS] <= CHECKPOINT_STRIDE)
+    return;
+
+  added = g_array_new (FALSE, FALSE, sizeof (AcOffsetPosition));
+  while (TRUE)
+    {
+      position_walk (index, &pos, AC_OFFSET_CHARS, pos.offsets[AC_OFFSET_CHARS] + CHECKPOINT_STRIDE);
+      if (pos.offsets[AC_OFFSET_CHARS] >= limit)
+        break;
+      g_array_append_val (added, pos);
+    }
+
+  g_array_insert_vals (index->checkpoints, i + 1, added->data, added->len);
+  g_array_free (added, TRUE);
+}
+
+static void
+shift_checkpoints (AcOffsetIndex *index,
+                   guint first,
+                   const AcOffsetPosition *delta)
+{
+  guint i;
+  int unit;
+
+  for (i = first; i < index->checkpoints->len; i++)
+    {
+      for (unit = 0; unit < AC_OFFSET_N_UNITS; unit++)
+        CHECKPOINT (index, i).offsets[unit] += delta->offsets[unit];
+    }
+}
+
+AcOffsetIndex *
+ac_offset_index_new (const char *text,
+                     int n_bytes)
+{
+  AcOffsetIndex *index = g_slice_new0 (AcOffsetIndex);
+
+  index->text = g_string_new (NULL);
+  index->checkpoints = g_array_new (FALSE, FALSE, sizeof (AcOffsetPosition));
+  ac_offset_index_set_text (index, text, n_bytes);
+
+  return index;
+}
+
+void
+ac_offset_index_free (AcOffsetIndex *index)
+{
+  if (index == NULL)
+    return;
+
+  g_string_free (index->text, TRUE);
+  g_array_free (index->checkpoints, TRUE);
+  g_slice_free (AcOffsetIndex, index);
+}
+
+void
+ac_offset_index_set_text (AcOffsetIndex *index,
+                          const char *text,
+                          int n_bytes)
+{
+  AcOffsetPosition start = { { 0, 0, 0 } };
+
+  if (text == NULL)
+    n_bytes = 0;
+  else if (n_bytes < 0)
+    n_bytes = (int)strlen (text);
+
+  g_string_truncate (index->text, 0);
+  g_string_append_len (index->text, text, n_bytes);
+
+  // The end is only known in bytes until the text has been walked
+  index->end.offsets[AC_OFFSET_BYTES] = n_bytes;
+  index->end.offsets[AC_OFFSET_CHARS] = G_MAXINT;
+  index->end.offsets[AC_OFFSET_UTF16] = G_MAXINT;
+
+  g_array_set_size (index->checkpoints, 0);
+  g_array_append_val (index->checkpoints, start);
+
+  // Walk to the end, dropping a checkpoint every CHECKPOINT_STRIDE characters
+  while (start.offsets[AC_OFFSET_BYTES] < n_bytes)
+    {
+      position_next (index, &start);
+      if (start.offsets[AC_OFFSET_CHARS] % CHECKPOINT_STRIDE == 0 &&
+          start.offsets[AC_OFFSET_BYTES] < n_bytes)
+        g_array_append_val (index->checkpoints, start);
+    }
+  index->end = start;
+}
+
+void
+ac_offset_index_insert (AcOffsetIndex *index,
+                        int offset,
+                        const char *text,
+                        int n_bytes)
+{
+  AcOffsetPosition pos, delta = { { 0, 0, 0 } };
+  const char *p;
+  guint i;
+  int unit;
+
+  if (n_bytes < 0)
+    n_bytes = (int)strlen (text);
+  if (n_bytes == 0)
+    return;
+
+  offset = CLAMP (offset, 0, index->end.offsets[AC_OFFSET_CHARS]);
+  pos = find_position (index, offset, AC_OFFSET_CHARS);
+
+  delta.offsets[AC_OFFSET_BYTES] = n_bytes;
+  for (p = text; p < text + n_bytes; p = g_utf8_next_char (p))
+    {
+      delta.offsets[AC_OFFSET_CHARS]++;
+      delta.offsets[AC_OFFSET_UTF16] += ((guchar)*p >= 0xf0) ? 2 : 1;
+    }
+
+  g_string_insert_len (index->text, pos.offsets[AC_OFFSET_BYTES], text, n_bytes);
+  for (unit = 0; unit < AC_OFFSET_N_UNITS; unit++)
+    index->end.offsets[unit] += delta.offsets[unit];
+
+  // The checkpoints after the insertion move with the text after it
+  i = find_checkpoint (index, offset, AC_OFFSET_CHARS);
+  shift_checkpoints (index, i + 1, &delta);
+  lay_out_checkpoints (index, i);
+}
+
+void
+ac_offset_index_delete (AcOffsetIndex *index,
+                        int start,
+                        int end)
+{
+  AcOffsetPosition start_pos, end_pos, delta;
+  guint first, last;
+  int unit;
+
+  start = CLAMP (start, 0, index->end.offsets[AC_OFFSET_CHARS]);
+  end = CLAMP (end, 0, index->end.offsets[AC_OFFSET_CHARS]);
+  if (start > end)
+    {
+      int tmp = start;
+      start = end;
+      end = tmp;
+    }
+  if (start == end)
+    return;
+
+  start_pos = find_position (index, start, AC_OFFSET_CHARS);
+  end_pos = find_position (index, end, AC_OFFSET_CHARS);
+
+  for (unit = 0; unit < AC_OFFSET_N_UNITS; unit++)
+    {
+      delta.offsets[unit] = start_pos.offsets[unit] - end_pos.offsets[unit];
+      index->end.offsets[unit] += delta.offsets[unit];
+    }
+
+  g_string_erase (index->text, start_pos.offsets[AC_OFFSET_BYTES],
+                  end_pos.offsets[AC_OFFSET_BYTES] - start_pos.offsets[AC_OFFSET_BYTES]);
+
+  // Checkpoints in the deleted text go, including one at its end as that becomes start.
+  // The first checkpoint is at 0, so it is never one of them
+  first = find_checkpoint (index, start, AC_OFFSET_CHARS) + 1;
+  last = first;
+  while (last < index->checkpoints->len &&
+         CHECKPOINT (index, last).offsets[AC_OFFSET_CHARS] <= end)
+    last++;
+  g_array_remove_range (index->checkpoints, first, last - first);
+
+  shift_checkpoints (index, first, &delta);
+
+  // Nothing can be left at the end of the text
+  if (first < index->checkpoints->len &&
+      CHECKPOINT (index, first).offsets[AC_OFFSET_CHARS] >= index->end.offsets[AC_OFFSET_CHARS])
+    g_array_set_size (index->checkpoints, first);
+
+  lay_out_checkpoints (index, first - 1);
+}
+
+const char *
+ac_offset_index_get_text (AcOffsetIndex *index)
+{
+  return index->text->str;
+}
+
+int
+ac_offset_index_get_length (AcOffsetIndex *index,
+                            AcOffsetUnit unit)
+{
+  return index->end.offsets[unit];
+}
+
+int
+ac_offset_index_convert (AcOffsetIndex *index,
+                         int offset,
+                         AcOffsetUnit from,
+                         AcOffsetUnit to)
+{
+  AcOffsetPosition pos;
+
+  if (offset <= 0)
+    return 0;
+  if (offset >= index->end.offsets[from])
+    return index->end.offsets[to];
+
+  // Every unit is the same in ASCII, and characters and UTF-16 agree inside the BMP
+  if (index->end.offsets[AC_OFFSET_BYTES] == index->end.offsets[AC_OFFSET_CHARS])
+    return offset;
+  if (from != AC_OFFSET_BYTES && to != AC_OFFSET_BYTES &&
+      index->end.offsets[AC_OFFSET_CHARS] == index->end.offsets[AC_OFFSET_UTF16])
+    return offset;
+
+  pos = find_position (index, offset, from);
+  return pos.offsets[to];
+}
+
+struct _AcUtf16Index {
+  int n_chars;
+  GArray *wide; /* int character offsets of the characters outside the BMP, sorted */
+};
+
+#define WIDE(index, i) (g_array_index ((index)->wide, int, (i)))
+
+/* Adds the characters outside the BMP in text, which starts at offset, to wide. Returns
+ * the number of characters in text */
+static int
+collect_wide_chars (GArray *wide,
+                    int offset,
+                    const char *text,
+                    int n_bytes)
+{
+  const char *p;
+  int n_chars = 0;
+
+  if (text == NULL)
+    return 0;
+  if (n_bytes < 0)
+    n_bytes = (int)strlen (text);
+
+  for (p = text; p < text + n_bytes; p = g_utf8_next_char (p))
+    {
+      if ((guchar)*p >= 0xf0)
+        {
+          int wide_offset = offset + n_chars;
+          g_array_append_val (wide, wide_offset);
+        }
+      n_chars++;
+    }
+
+  return n_chars;
+}
+
+/* The number of characters outside the BMP before offset */
+static guint
+count_wide_chars_before (AcUtf16Index *index,
+                         int offset)
+{
+  guint low = 0, high = index->wide->len;
+
+  while (low < high)
+    {
+      guint mid = (low + high) / 2;
+
+      if (WIDE (index, mid) < offset)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  return low;
+}
+
+AcUtf16Index *
+ac_utf16_index_new (const char *text,
+                    int n_bytes)
+{
+  AcUtf16Index *index = g_slice_new0 (AcUtf16Index);
+
+  index->wide = g_array_new (FALSE, FALSE, sizeof (int));
+  index->n_chars = collect_wide_chars (index->wide, 0, text, n_bytes);
+
+  return index;
+}
+
+void
+ac_utf16_index_free (AcUtf16Index *index)
+{
+  if (index == NULL)
+    return;
+
+  g_array_free (index->wide, TRUE);
+  g_slice_free (AcUtf16Index, index);
+}
+
+void
+ac_utf16_index_insert (AcUtf16Index *index,
+                       int offset,
+                       const char *text,
+                       int n_bytes)
+{
+  GArray *added;
+  guint first, i;
+  int n_chars;
+
+  offset = CLAMP (offset, 0, index->n_chars);
+
+  added = g_array_new (FALSE, FALSE, sizeof (int));
+  n_chars = collect_wide_chars (added, offset, text, n_bytes);
+
+  first = count_wide_chars_before (index, offset);
+  for (i = first; i < index->wide->len; i++)
+    WIDE (index, i) += n_chars;
+  g_array_insert_vals (index->wide, first, added->data, added->len);
+  index->n_chars += n_chars;
+
+  g_array_free (added, TRUE);
+}
+
+void
+ac_utf16_index_delete (AcUtf16Index *index,
+                       int start,
+                       int end)
+{
+  guint first, last, i;
+
+  start = CLAMP (start, 0, index->n_chars);
+  end = CLAMP (end, 0, index->n_chars);
+  if (start > end)
+    {
+      int tmp = start;
+      start = end;
+      end = tmp;
+    }
+  if (start == end)
+    return;
+
+  first = count_wide_chars_before (index, start);
+  last = count_wide_chars_before (index, end);
+  g_array_remove_range (index->wide, first, last - first);
+  for (i = first; i < index->wide->len; i++)
+    WIDE (index, i) -= end - start;
+  index->n_chars -= end - start;
+}
+
+int
+ac_utf16_index_get_length (AcUtf16Index *index,
+                           AcOffsetUnit unit)
+{
+  return index->n_chars + (unit == AC_OFFSET_UTF16 ? (int)index->wide->len : 0);
+}
+
+int
+ac_utf16_index_convert (AcUtf16Index *index,
+                        int offset,
+                        AcOffsetUnit from,
+                        AcOffsetUnit to)
+{
+  guint low = 0, high = index->wide->len;
+
+  if (offset <= 0)
+    return 0;
+  if (offset >= ac_utf16_index_get_length (index, from))
+    return ac_utf16_index_get_length (index, to);
+  if (from == to || index->wide->len == 0)
+    return offset;
+
+  if (from == AC_OFFSET_CHARS)
+    return offset + (int)count_wide_chars_before (index, offset);
+
+  // The wide character i takes up UTF-16 units WIDE (i) + i and the one after. Find how many
+  // are wholly before offset, then step back to the start of one that offset is inside
+  while (low < high)
+    {
+      guint mid = (low + high) / 2;
+
+      if (WIDE (index, mid) + (int)mid + 2 <= offset)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+
+  if (low < index->wide->len && WIDE (index, low) + (int)low + 1 == offset)
+    return WIDE (index, low);
+
+  return offset - (int)low;
+}
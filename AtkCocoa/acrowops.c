@@ -0,0 +1,340 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "atk-cocoa/acrowops.h"
+
+typedef enum {
+  ROW_OP_CHANGED,
+  ROW_OP_INSERTED,
+  ROW_OP_DELETED,
+  ROW_OP_REORDERED,
+  ROW_OP_CHILD_TOGGLED
+} RowOpType;
+
+/* A model change waiting to be applied to the mirror */
+typedef struct {
+  RowOpType type;
+  GtkTreePath *path;
+  gpointer element; /* Made by make_element when the row was inserted */
+  gint *new_order;
+  gboolean has_child; /* Whether the row had children at the time of a ROW_OP_CHILD_TOGGLED */
+} RowOp;
+
+struct _AcRowOps {
+  GtkTreeView *view;
+  AcRowOpsFuncs funcs;
+  gpointer user_data;
+
+  GQueue queue;
+  guint idle_id;
+  guint pending_selection_changes;
+  gboolean flushing;
+};
+
+static void
+row_op_free (AcRowOps *ops,
+             RowOp *op)
+{
+  gtk_tree_path_free (op->path);
+  if (op->element && ops->funcs.free_element) {
+    ops->funcs.free_element (op->element);
+  }
+  g_free (op->new_order);
+
+  g_slice_free (RowOp, op);
+}
+
+static gboolean
+flush_idle (gpointer data)
+{
+  AcRowOps *ops = data;
+
+  ops->idle_id = 0;
+  ac_row_ops_flush (ops);
+
+  return FALSE;
+}
+
+static void
+schedule_flush (AcRowOps *ops)
+{
+  if (ops->idle_id == 0) {
+    ops->idle_id = g_idle_add (flush_idle, ops);
+  }
+}
+
+static RowOp *
+queue_row_op (AcRowOps *ops,
+              RowOpType type,
+              GtkTreePath *path)
+{
+  RowOp *op = g_slice_new0 (RowOp);
+
+  op->type = type;
+  op->path = gtk_tree_path_copy (path);
+  g_queue_push_tail (&ops->queue, op);
+
+  schedule_flush (ops);
+
+  return op;
+}
+
+AcRowOps *
+ac_row_ops_new (GtkTreeView *view,
+                const AcRowOpsFuncs *funcs,
+                gpointer user_data)
+{
+  AcRowOps *ops = g_slice_new0 (AcRowOps);
+
+  ops->view = view;
+  ops->funcs = *funcs;
+  ops->user_data = user_data;
+  g_queue_init (&ops->queue);
+
+  return ops;
+}
+
+void
+ac_row_ops_free (AcRowOps *ops)
+{
+  if (ops == NULL) {
+    return;
+  }
+
+  ac_row_ops_discard (ops);
+  g_slice_free (AcRowOps, ops);
+}
+
+void
+ac_row_ops_row_changed (AcRowOps *ops,
+                        GtkTreeModel *model,
+                        GtkTreePath *path,
+                        GtkTreeIter *iter)
+{
+  queue_row_op (ops, ROW_OP_CHANGED, path);
+}
+
+/* A row can only be seen if all of its ancestors are expanded */
+static gboolean
+row_is_visible (AcRowOps *ops,
+                GtkTreeModel *model,
+                GtkTreeIter *iter)
+{
+  GtkTreeIter child = *iter, parent;
+
+  while (gtk_tree_model_iter_parent (model, &parent, &child)) {
+    GtkTreePath *path = gtk_tree_model_get_path (model, &parent);
+    gboolean expanded = gtk_tree_view_row_expanded (ops->view, path);
+
+    gtk_tree_path_free (path);
+    if (!expanded) {
+      return FALSE;
+    }
+
+    child = parent;
+  }
+
+  return TRUE;
+}
+
+void
+ac_row_ops_row_inserted (AcRowOps *ops,
+                         GtkTreeModel *model,
+                         GtkTreePath *path,
+                         GtkTreeIter *iter)
+{
+  GtkTreePath *parent_path;
+  RowOp *op;
+
+  /*
+   * A row insert is not necessarily visible.  For example,
+   * a row can be draged & dropped into another row, which
+   * causes an insert on the model that isn't visible in the
+   * view.
+   */
+  if (row_is_visible (ops, model, iter)) {
+    op = queue_row_op (ops, ROW_OP_INSERTED, path);
+
+    // The row may have changed by the time the queue is run, so anything it needs is made now
+    if (ops->funcs.make_element) {
+      op->element = ops->funcs.make_element (model, path, iter, ops->user_data);
+    }
+    return;
+  }
+
+  /*
+   * The row has been inserted inside another row.  This can
+   * cause a row that previously couldn't be expanded to now
+   * be expandable, whatever it had before.
+   */
+  parent_path = gtk_tree_path_copy (path);
+  gtk_tree_path_up (parent_path);
+
+  if (gtk_tree_path_get_depth (parent_path) > 0) {
+    queue_row_op (ops, ROW_OP_CHILD_TOGGLED, parent_path)->has_child = TRUE;
+  }
+
+  gtk_tree_path_free (parent_path);
+}
+
+void
+ac_row_ops_row_deleted (AcRowOps *ops,
+                        GtkTreeModel *model,
+                        GtkTreePath *path)
+{
+  queue_row_op (ops, ROW_OP_DELETED, path);
+
+  // The parent might have lost its last child. The row is already gone from the model,
+  // so the parent can be asked now
+  if (gtk_tree_path_get_depth (path) > 1) {
+    GtkTreePath *parent_path = gtk_tree_path_copy (path);
+    GtkTreeIter parent_iter;
+    RowOp *op;
+
+    gtk_tree_path_up (parent_path);
+    op = queue_row_op (ops, ROW_OP_CHILD_TOGGLED, parent_path);
+    op->has_child = gtk_tree_model_get_iter (model, &parent_iter, parent_path) &&
+      gtk_tree_model_iter_has_child (model, &parent_iter);
+    gtk_tree_path_free (parent_path);
+  }
+}
+
+void
+ac_row_ops_row_has_child_toggled (AcRowOps *ops,
+                                  GtkTreeModel *model,
+                                  GtkTreePath *path,
+                                  GtkTreeIter *iter)
+{
+  queue_row_op (ops, ROW_OP_CHILD_TOGGLED, path)->has_child = gtk_tree_model_iter_has_child (model, iter);
+}
+
+void
+ac_row_ops_rows_reordered (AcRowOps *ops,
+                           GtkTreeModel *model,
+                           GtkTreePath *path,
+                           GtkTreeIter *iter,
+                           gint *new_order)
+{
+  RowOp *op;
+  int n_children;
+
+  n_children = gtk_tree_model_iter_n_children (model, gtk_tree_path_get_depth (path) > 0 ? iter : NULL);
+  if (new_order == NULL || n_children <= 0) {
+    return;
+  }
+
+  // new_order belongs to the signal emission, so the op keeps a copy
+  op = queue_row_op (ops, ROW_OP_REORDERED, path);
+  op->new_order = g_new (gint, n_children);
+  memcpy (op->new_order, new_order, n_children * sizeof (gint));
+}
+
+void
+ac_row_ops_selection_changed (AcRowOps *ops)
+{
+  ops->pending_selection_changes++;
+  schedule_flush (ops);
+}
+
+void
+ac_row_ops_flush (AcRowOps *ops)
+{
+  AcRowOpsBatch batch = { 0, };
+  RowOp *op;
+
+  // Applying the changes can call back into the mirror's owner, which must not start another flush
+  if (ops->flushing) {
+    return;
+  }
+
+  if (ops->idle_id > 0) {
+    g_source_remove (ops->idle_id);
+    ops->idle_id = 0;
+  }
+
+  ops->flushing = TRUE;
+
+  while ((op = g_queue_pop_head (&ops->queue))) {
+    switch (op->type) {
+    case ROW_OP_CHANGED:
+      ops->funcs.changed (op->path, ops->user_data);
+      break;
+
+    case ROW_OP_INSERTED:
+      if (ops->funcs.inserted (op->path, op->element, ops->user_data)) {
+        batch.n_count_changes++;
+      }
+      batch.n_moves++;
+      break;
+
+    case ROW_OP_DELETED:
+      if (ops->funcs.deleted (op->path, ops->user_data)) {
+        batch.n_count_changes++;
+      }
+      batch.n_moves++;
+      break;
+
+    case ROW_OP_REORDERED:
+      ops->funcs.reordered (op->path, op->new_order, ops->user_data);
+      batch.n_moves++;
+      break;
+
+    case ROW_OP_CHILD_TOGGLED:
+      ops->funcs.child_toggled (op->path, op->has_child, ops->user_data);
+      break;
+    }
+
+    row_op_free (ops, op);
+    batch.n_ops++;
+  }
+
+  batch.n_selection_changes = ops->pending_selection_changes;
+  ops->pending_selection_changes = 0;
+
+  ops->flushing = FALSE;
+
+  if (ops->funcs.flushed) {
+    ops->funcs.flushed (&batch, ops->user_data);
+  }
+}
+
+void
+ac_row_ops_discard (AcRowOps *ops)
+{
+  RowOp *op;
+
+  if (ops->idle_id > 0) {
+    g_source_remove (ops->idle_id);
+    ops->idle_id = 0;
+  }
+
+  while ((op = g_queue_pop_head (&ops->queue))) {
+    row_op_free (ops, op);
+  }
+
+  ops->pending_selection_changes = 0;
+}
+
+gboolean
+ac_row_ops_is_pending (AcRowOps *ops)
+{
+  return ops->flushing || !g_queue_is_empty (&ops->queue);
+}
@@ -32,5 +32,8 @@
 - (void)addDisclosureButton;
 - (void)removeDisclosureButton;
 
+// Unbinds the cell from its row so it can be added to another one
+- (void)prepareForReuse;
+
 - (ACAccessibilityTreeColumnElement *)columnElement;
 @end
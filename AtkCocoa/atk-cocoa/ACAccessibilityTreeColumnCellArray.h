@@ -0,0 +1,32 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class ACAccessibilityTreeColumnElement;
+
+// A read only view of one column's cells, one for each row in rows.
+// A cell is only made, without making the cells of the row's other columns,
+// when it is accessed. The count is fixed when the array is made, and a row without
+// a cell is given an empty placeholder cell.
+@interface ACAccessibilityTreeColumnCellArray : NSArray
+
+- (instancetype)initWithRows:(NSArray *)rows columnElement:(ACAccessibilityTreeColumnElement *)columnElement;
+
+@end
@@ -22,10 +22,16 @@
 #include "acelement.h"
 #include <gtk/gtk.h>
 
+@class ACAccessibilityTreeCellElement;
+
 @interface ACAccessibilityTreeColumnElement : ACAccessibilityElement
 
 - (instancetype)initWithDelegate:(AcElement *)delegate treeColumn:(GtkTreeViewColumn *)column;
 - (GtkTreeViewColumn *)column;
 - (id<NSAccessibility>)columnHeaderElement;
 
+// Cells of rows that have scrolled out of view are kept here to be bound to the next rows that need them
+- (ACAccessibilityTreeCellElement *)dequeueReusableCell;
+- (void)enqueueReusableCell:(ACAccessibilityTreeCellElement *)cell;
+
 @end
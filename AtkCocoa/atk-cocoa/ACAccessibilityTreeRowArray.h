@@ -0,0 +1,34 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class ACAccessibilityTreeRowElement;
+
+// A read only view of the flattened rows underneath a root row element.
+// The count is the root's descendant count when the array is made and rows are only
+// looked up (and created if they are still placeholders) when they are accessed.
+// Once rows have been added, removed or moved, every index gives an empty placeholder row.
+@interface ACAccessibilityTreeRowArray : NSArray
+
+- (instancetype)initWithRootRow:(ACAccessibilityTreeRowElement *)root;
+// Only the rows at the flattened indices in indexes, in order
+- (instancetype)initWithRootRow:(ACAccessibilityTreeRowElement *)root indexes:(NSIndexSet *)indexes;
+
+@end
@@ -22,39 +22,88 @@
 #include "acelement.h"
 #include <gtk/gtk.h>
 
+@class ACAccessibilityTreeRowElement;
+@class ACAccessibilityTreeCellElement;
+@class ACAccessibilityTreeColumnElement;
+
+// Creates the element for a placeholder row at index in parent
+typedef ACAccessibilityTreeRowElement *(^ACAccessibilityTreeRowFactory)(ACAccessibilityTreeRowElement *parent, int index);
+
 @interface ACAccessibilityTreeRowElement : ACAccessibilityElement
 
 @property (readwrite) BOOL rowIsDirty;
 
+// Only used on the root node, to create elements for placeholder rows when they are first requested
+@property (readwrite, copy) ACAccessibilityTreeRowFactory rowFactory;
+
+// row is only needed for rows that are used outside of the row tree, it can be NULL
 - (instancetype)initWithDelegate:(AcElement *)delegate treeRow:(GtkTreeRowReference *)row treeView:(GtkTreeView *)treeView;
 - (GtkTreeRowReference *)rowReference;
+// The path comes from the row's position in the row tree, in O(depth * log n)
 - (GtkTreePath *)rowPath;
+- (BOOL)getRowIter:(GtkTreeIter *)iter;
+
+// Whether the row has children in the model, whether or not it is expanded. Only asks the model
+// the first time after it has been invalidated
+- (BOOL)hasChildRows;
+- (void)setHasChildRows:(BOOL)hasChildRows;
 - (void)addChildRowElement:(ACAccessibilityTreeRowElement *)child;
 - (void)removeChildRowElement:(ACAccessibilityTreeRowElement *)child;
 
 - (NSArray *)childCells;
+// The row's cell in a single column, made without making the cells for the other columns
+- (ACAccessibilityTreeCellElement *)cellForColumn:(ACAccessibilityTreeColumnElement *)columnElement;
+// Returns the cells to their column's pool. They are made again if the row's children are requested
+- (void)recycleChildCells;
+- (void)recycleDescendantCells;
+// Drops the cells for columns that have gone, and lets the cells be put in order again for the ones that are left
+- (void)removeCellsForColumns:(NSArray *)columnElements;
 
 // Treat Row element like a tree
 - (ACAccessibilityTreeRowElement *)parent;
 - (void)insertChild:(ACAccessibilityTreeRowElement *)child atIndex:(int)idx;
 - (void)appendChild:(ACAccessibilityTreeRowElement *)child;
+// Inserts a run of children, fixing up the descendant counts and visible rows once for all of them
+- (void)insertChildren:(NSArray *)children atIndex:(int)idx;
 - (void)removeChild:(ACAccessibilityTreeRowElement *)child;
 - (void)removeChildAtIndex:(int)idx;
 - (void)removeFromParent;
 - (void)removeAllChildren;
 - (ACAccessibilityTreeRowElement *)childAtIndex:(int)idx;
 
+// Placeholder rows are counted in the tree but only get an element when
+// they are requested through childAtIndex:, childAtPath: or rowAtFlattenedIndex:
+- (void)insertPlaceholderChildrenAtIndex:(int)idx count:(int)count;
+- (ACAccessibilityTreeRowElement *)existingChildAtIndex:(int)idx;
+- (ACAccessibilityTreeRowElement *)existingChildAtPath:(const char *)path;
+
+// The descendant at idx in the depth first flattening of this row's subtree, in O(depth * log n)
+- (ACAccessibilityTreeRowElement *)rowAtFlattenedIndex:(int)idx;
+// The reverse of rowAtFlattenedIndex:, without making elements for any placeholders. -1 if there is no such row
+- (int)flattenedIndexOfIndices:(const int *)indices depth:(int)depth;
+
 // path should be  in 0:1:2:3 format
 - (ACAccessibilityTreeRowElement *)childAtPath:(const char *)path;
 
+// indices as returned by gtk_tree_path_get_indices. A depth of 0 returns self
+- (ACAccessibilityTreeRowElement *)childAtIndices:(const int *)indices depth:(int)depth materialize:(BOOL)materialize;
+
 - (void)foreachChild:(void(^)(ACAccessibilityTreeRowElement *parent, ACAccessibilityTreeRowElement *child, void *userData))handler userData:(void *)userdata;
 - (int)descendantCount;
+// Changes whenever rows are added to, removed from or moved inside the root's tree
+- (NSUInteger)rowGeneration;
+- (int)childCount;
+// Where the child's subtree starts among the rows below this one, -1 if there is no such child
+- (int)flattenedOffsetOfChildAtIndex:(int)idx;
+- (int)indexInParent;
 
 - (void)reorderChildrenToNewIndicies:(int *)indicies;
 int last_path_index (const char *path);
 - (void)dumpChildrenRecursive:(BOOL)recurse;
 
 - (void)flattenTreeInto:(NSMutableArray *)arr;
+// Without materializing, each placeholder is flattened to NSNull rather than given an element
+- (void)flattenTreeInto:(NSMutableArray *)arr materialize:(BOOL)materialize;
 - (NSArray *)flattenTree;
 
 @end
@@ -17,6 +17,9 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#ifndef __AC_DEBUG_H__
+#define __AC_DEBUG_H__
+
 #include <glib.h>
 
 G_BEGIN_DECLS
@@ -41,4 +44,102 @@ typedef enum {
 
 extern guint ac_debug_flags;
 
+/*
+ * Profiling. AC_PROFILE_SCOPE times the rest of the enclosing block and AC_PROFILE_COUNT
+ * adds to a counter, both filed under a debug category. They are turned on per category
+ * with ATKCOCOA_PROFILE, which takes the same keys as ATKCOCOA_DEBUG_OPTIONS, and cost
+ * one test of ac_profile_flags when the category is off.
+ *
+ * The totals are dumped when the process exits or gets SIGUSR1, to ATKCOCOA_PROFILE_FILE
+ * or stderr.
+ *
+ * The same scopes are written as complete events in Chrome's trace format to
+ * ATKCOCOA_TRACE_FILE when it is set, for the categories in ATKCOCOA_TRACE or all of them.
+ * Events go to a ring buffer that a thread of its own writes out, so the main loop never
+ * waits on the file. AC_PROFILE_SCOPE_FOR also names the type of the object the work is for.
+ */
+#define AC_PROFILE_N_BUCKETS 256
+
+typedef struct _AcProfileSite AcProfileSite;
+struct _AcProfileSite {
+	guint category;
+	const char *name;
+	gboolean is_timer;
+
+	/* Everything below is only touched with atomics */
+	gint registered;
+	AcProfileSite *next;
+	guint64 count;
+	guint64 total; /* ns for timers */
+	guint64 max;
+	guint64 buckets[AC_PROFILE_N_BUCKETS]; /* Log-linear histogram of the times */
+};
+
+typedef struct {
+	AcProfileSite *site;
+	guint64 start;
+	gboolean traced;
+	const char *type_name; /* Taken at the start, as the object may be gone by the end */
+} AcProfileScope;
+
+extern guint ac_profile_flags;
+extern guint ac_trace_flags;
+
+void ac_profile_init (const GDebugKey *keys,
+                      guint n_keys);
+guint64 ac_profile_now (void);
+void ac_profile_record (AcProfileSite *site,
+                        guint64 value);
+void ac_profile_dump (void);
+void ac_trace_event (AcProfileSite *site,
+                     const char *type_name,
+                     guint64 start,
+                     guint64 duration);
+
+static inline AcProfileScope
+ac_profile_scope_begin (AcProfileSite *site,
+                        gpointer object)
+{
+	AcProfileScope scope = { site, 0, FALSE, NULL };
+
+	if (G_UNLIKELY ((ac_profile_flags | ac_trace_flags) & site->category)) {
+		scope.start = ac_profile_now ();
+		if (ac_trace_flags & site->category) {
+			scope.traced = TRUE;
+			// Type names are interned by GType, so they outlive the object
+			scope.type_name = object ? G_OBJECT_TYPE_NAME (object) : NULL;
+		}
+	}
+	return scope;
+}
+
+static inline void
+ac_profile_scope_end (AcProfileScope *scope)
+{
+	if (G_UNLIKELY (scope->start != 0)) {
+		guint64 now = ac_profile_now ();
+
+		if (scope->traced) {
+			ac_trace_event (scope->site, scope->type_name, scope->start, now - scope->start);
+		}
+		if (ac_profile_flags & scope->site->category) {
+			ac_profile_record (scope->site, now - scope->start);
+		}
+	}
+}
+
+#define AC_PROFILE_SCOPE_FOR(type, timer_name, object) \
+	static AcProfileSite G_PASTE (ac_profile_site_, __LINE__) = { .category = AC_DEBUG_##type, .name = timer_name, .is_timer = TRUE }; \
+	AcProfileScope G_PASTE (ac_profile_scope_, __LINE__) __attribute__ ((cleanup (ac_profile_scope_end))) = \
+		ac_profile_scope_begin (&G_PASTE (ac_profile_site_, __LINE__), (object))
+
+#define AC_PROFILE_SCOPE(type, timer_name) AC_PROFILE_SCOPE_FOR (type, timer_name, NULL)
+
+#define AC_PROFILE_COUNT(type, counter_name, n) G_STMT_START { \
+	static AcProfileSite ac_profile_counter = { .category = AC_DEBUG_##type, .name = counter_name, .is_timer = FALSE }; \
+	if (G_UNLIKELY (ac_profile_flags & AC_DEBUG_##type)) \
+		{ ac_profile_record (&ac_profile_counter, (n)); }	} G_STMT_END
+
 G_END_DECLS
+
+#endif /* __AC_DEBUG_H__ */
@@ -0,0 +1,91 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AC_INDEX_TREE_H__
+#define __AC_INDEX_TREE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * AcIndexTree is an ordered sequence, like GSequence, where every node also carries
+ * an integer weight. Each node of the underlying balanced tree keeps the number of nodes
+ * and the total weight of its subtree, so positions, weighted offsets and lookups
+ * by either of them are all O(log n).
+ *
+ * The row mirror uses the weight to hold the size of the subtree a row heads
+ * (1 + its descendant count), so the flattened index of a row is the weighted offset
+ * of its node plus the flattened index of its parent.
+ */
+typedef struct _AcIndexTree AcIndexTree;
+typedef struct _AcIndexTreeNode AcIndexTreeNode;
+
+AcIndexTree *ac_index_tree_new (GDestroyNotify data_destroy);
+void ac_index_tree_free (AcIndexTree *tree);
+
+int ac_index_tree_get_length (AcIndexTree *tree);
+int ac_index_tree_get_weight (AcIndexTree *tree);
+
+AcIndexTreeNode *ac_index_tree_insert (AcIndexTree *tree,
+                                       int position,
+                                       gpointer data,
+                                       int weight);
+AcIndexTreeNode *ac_index_tree_append (AcIndexTree *tree,
+                                       gpointer data,
+                                       int weight);
+/* Inserts n_nodes nodes at position in O(n_nodes + log n). data and weights can be NULL for
+ * NULL data and a weight of 1. If nodes is not NULL it is filled in with the new nodes, in order */
+void ac_index_tree_insert_many (AcIndexTree *tree,
+                                int position,
+                                gpointer *data,
+                                const int *weights,
+                                int n_nodes,
+                                AcIndexTreeNode **nodes);
+void ac_index_tree_remove (AcIndexTree *tree,
+                           AcIndexTreeNode *node);
+
+/* new_order follows the GtkTreeModel::rows-reordered convention:
+ * new_order[new_position] == old_position */
+gboolean ac_index_tree_reorder (AcIndexTree *tree,
+                                const int *new_order);
+
+AcIndexTreeNode *ac_index_tree_get_first (AcIndexTree *tree);
+AcIndexTreeNode *ac_index_tree_get_nth (AcIndexTree *tree,
+                                        int position);
+AcIndexTreeNode *ac_index_tree_find_offset (AcIndexTree *tree,
+                                            int offset,
+                                            int *node_offset);
+
+gpointer ac_index_tree_node_get_data (AcIndexTreeNode *node);
+void ac_index_tree_node_set_data (AcIndexTreeNode *node,
+                                  gpointer data);
+int ac_index_tree_node_get_weight (AcIndexTreeNode *node);
+void ac_index_tree_node_set_weight (AcIndexTreeNode *node,
+                                    int weight);
+int ac_index_tree_node_get_position (AcIndexTreeNode *node);
+/* The number of nodes before node that have data */
+int ac_index_tree_node_get_filled_position (AcIndexTreeNode *node);
+int ac_index_tree_node_get_offset (AcIndexTreeNode *node);
+AcIndexTreeNode *ac_index_tree_node_next (AcIndexTreeNode *node);
+AcIndexTreeNode *ac_index_tree_node_prev (AcIndexTreeNode *node);
+
+G_END_DECLS
+
+#endif /* __AC_INDEX_TREE_H__ */
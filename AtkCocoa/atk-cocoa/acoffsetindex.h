@@ -0,0 +1,107 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AC_OFFSET_INDEX_H__
+#define __AC_OFFSET_INDEX_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * AcOffsetIndex translates positions in a UTF-8 string between the units the different
+ * layers count in: Pango uses byte indices, GTK+ and ATK use character offsets and Cocoa
+ * uses UTF-16 code units in its NSRanges.
+ *
+ * The index keeps a copy of the text and checkpoints, no more than a fixed number of characters
+ * apart, where the position is known in all three units. A conversion binary searches the
+ * checkpoints and walks the text from the nearest one, so it is O(log n). Edits only shift the
+ * checkpoints after them and lay new ones out around the edited text.
+ */
+typedef enum {
+  AC_OFFSET_BYTES,
+  AC_OFFSET_CHARS,
+  AC_OFFSET_UTF16,
+
+  AC_OFFSET_N_UNITS
+} AcOffsetUnit;
+
+typedef struct _AcOffsetIndex AcOffsetIndex;
+
+/* n_bytes can be -1 if text is nul-terminated */
+AcOffsetIndex *ac_offset_index_new (const char *text,
+                                    int n_bytes);
+void ac_offset_index_free (AcOffsetIndex *index);
+
+void ac_offset_index_set_text (AcOffsetIndex *index,
+                               const char *text,
+                               int n_bytes);
+/* Edits are positioned in characters, the way GTK+ reports them */
+void ac_offset_index_insert (AcOffsetIndex *index,
+                             int offset,
+                             const char *text,
+                             int n_bytes);
+void ac_offset_index_delete (AcOffsetIndex *index,
+                             int start,
+                             int end);
+
+const char *ac_offset_index_get_text (AcOffsetIndex *index);
+int ac_offset_index_get_length (AcOffsetIndex *index,
+                                AcOffsetUnit unit);
+
+/* offset is clamped to the text. An offset inside a character, such as the second half of
+ * a surrogate pair, gives the position of the start of that character */
+int ac_offset_index_convert (AcOffsetIndex *index,
+                             int offset,
+                             AcOffsetUnit from,
+                             AcOffsetUnit to);
+
+/*
+ * AcUtf16Index translates between characters and UTF-16 code units without keeping the text,
+ * for text that lives somewhere it can't be walked cheaply, such as a GtkTextBuffer. The two
+ * units only differ at characters outside the BMP, which take a surrogate pair, so the index
+ * is the sorted character offsets of those. Conversions binary search them and edits shift
+ * the ones after the edit.
+ */
+typedef struct _AcUtf16Index AcUtf16Index;
+
+AcUtf16Index *ac_utf16_index_new (const char *text,
+                                  int n_bytes);
+void ac_utf16_index_free (AcUtf16Index *index);
+
+void ac_utf16_index_insert (AcUtf16Index *index,
+                            int offset,
+                            const char *text,
+                            int n_bytes);
+void ac_utf16_index_delete (AcUtf16Index *index,
+                            int start,
+                            int end);
+
+/* unit is AC_OFFSET_CHARS or AC_OFFSET_UTF16 */
+int ac_utf16_index_get_length (AcUtf16Index *index,
+                               AcOffsetUnit unit);
+/* Clamped the same way as ac_offset_index_convert() */
+int ac_utf16_index_convert (AcUtf16Index *index,
+                            int offset,
+                            AcOffsetUnit from,
+                            AcOffsetUnit to);
+
+G_END_DECLS
+
+#endif /* __AC_OFFSET_INDEX_H__ */
@@ -0,0 +1,115 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AC_ROW_OPS_H__
+#define __AC_ROW_OPS_H__
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+/*
+ * AcRowOps is the queue between a GtkTreeView's model and its row mirror. Model signals can
+ * arrive in their thousands when rows are added or removed in bulk, so rather than updating
+ * the mirror for each one, the model handlers queue the changes along with anything that has
+ * to be read from the model while the signal is being emitted. The queue is applied in one
+ * batch when the main loop is next idle, or when it is flushed.
+ *
+ * The mirror itself is behind AcRowOpsFuncs, so the handlers and the batching are plain GTK
+ * and build without the NSAccessibility side.
+ */
+typedef struct _AcRowOps AcRowOps;
+
+typedef struct {
+  guint n_ops;
+  guint n_moves; /* Inserts, deletes and reorders, which move the rows after them */
+  guint n_count_changes; /* Ops that changed the number of rows in the mirror */
+  guint n_selection_changes;
+} AcRowOpsBatch;
+
+typedef struct {
+  /* Called while a row-inserted for a row that can be seen is being emitted, for anything that
+   * has to be made before the model changes again. Can be NULL */
+  gpointer (*make_element) (GtkTreeModel *model,
+                            GtkTreePath *path,
+                            GtkTreeIter *iter,
+                            gpointer user_data);
+  GDestroyNotify free_element;
+
+  /* The ops, applied in the order they were queued. path is the path at the time of the
+   * signal, which stays right as long as the ops before it have been applied.
+   * inserted and deleted return TRUE if the number of rows in the mirror changed */
+  void (*changed) (GtkTreePath *path,
+                   gpointer user_data);
+  gboolean (*inserted) (GtkTreePath *path,
+                        gpointer element,
+                        gpointer user_data);
+  gboolean (*deleted) (GtkTreePath *path,
+                       gpointer user_data);
+  void (*reordered) (GtkTreePath *path,
+                     gint *new_order,
+                     gpointer user_data);
+  void (*child_toggled) (GtkTreePath *path,
+                         gboolean has_child,
+                         gpointer user_data);
+
+  /* Called after every flush, once the queue is empty again */
+  void (*flushed) (const AcRowOpsBatch *batch,
+                   gpointer user_data);
+} AcRowOpsFuncs;
+
+AcRowOps *ac_row_ops_new (GtkTreeView *view,
+                          const AcRowOpsFuncs *funcs,
+                          gpointer user_data);
+void ac_row_ops_free (AcRowOps *ops);
+
+/* The model handlers, to be called from the GtkTreeModel signals of the view's model */
+void ac_row_ops_row_changed (AcRowOps *ops,
+                             GtkTreeModel *model,
+                             GtkTreePath *path,
+                             GtkTreeIter *iter);
+void ac_row_ops_row_inserted (AcRowOps *ops,
+                              GtkTreeModel *model,
+                              GtkTreePath *path,
+                              GtkTreeIter *iter);
+void ac_row_ops_row_deleted (AcRowOps *ops,
+                             GtkTreeModel *model,
+                             GtkTreePath *path);
+void ac_row_ops_row_has_child_toggled (AcRowOps *ops,
+                                       GtkTreeModel *model,
+                                       GtkTreePath *path,
+                                       GtkTreeIter *iter);
+void ac_row_ops_rows_reordered (AcRowOps *ops,
+                                GtkTreeModel *model,
+                                GtkTreePath *path,
+                                GtkTreeIter *iter,
+                                gint *new_order);
+/* Selecting a range emits GtkTreeSelection::changed per row, so they are only counted */
+void ac_row_ops_selection_changed (AcRowOps *ops);
+
+/* Applies everything queued now. Does nothing if called while the queue is being applied */
+void ac_row_ops_flush (AcRowOps *ops);
+/* Drops everything queued without applying it */
+void ac_row_ops_discard (AcRowOps *ops);
+/* TRUE while there are changes the mirror doesn't have yet, including while they're applied */
+gboolean ac_row_ops_is_pending (AcRowOps *ops);
+
+G_END_DECLS
+
+#endif /* __AC_ROW_OPS_H__ */
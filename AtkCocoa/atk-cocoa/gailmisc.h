@@ -23,6 +23,7 @@
 #include <glib-object.h>
 #include <gtk/gtk.h>
 #include <pango/pango.h>
+#include "acoffsetindex.h"
 
 G_BEGIN_DECLS
 
@@ -36,6 +37,15 @@ AtkAttributeSet* gail_misc_layout_get_run_attributes
                                                    gint              offset,
                                                    gint              *start_offset,
                                                    gint              *end_offset);
+AtkAttributeSet* gail_misc_layout_get_run_attributes_unindexed
+                                                  (AtkAttributeSet   *attrib_set,
+                                                   PangoLayout       *layout,
+                                                   gchar             *text,
+                                                   gint              offset,
+                                                   gint              *start_offset,
+                                                   gint              *end_offset);
+
+AcOffsetIndex*   gail_misc_layout_get_offset_index (PangoLayout     *layout);
 
 AtkAttributeSet* gail_misc_get_default_attributes (AtkAttributeSet   *attrib_set,
                                                    PangoLayout       *layout,
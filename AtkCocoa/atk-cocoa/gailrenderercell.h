@@ -39,6 +39,9 @@ struct _GailRendererCell
 {
   GailCell parent;
   GtkCellRenderer *renderer;
+
+  /* When the renderer is shared, the values this cell has put into it, one for each shared property */
+  GValue *bound_values;
 };
 
 GType gail_renderer_cell_get_type (void);
@@ -48,11 +51,38 @@ struct _GailRendererCellClass
   GailCellClass parent_class;
   gchar **property_list;
   gboolean (*update_cache)(GailRendererCell *cell, gboolean emit_change_signal);
+
+  /* Set by cell classes whose renderer only holds the values copied into it from property_list,
+   * so it can be shared by the cells of a column. Everything that is read from the renderer has to be in the list */
+  gboolean share_renderer;
 };
 
 gboolean
 gail_renderer_cell_update_cache (GailRendererCell *cell, gboolean emit_change_signal);
 
+void gail_renderer_cell_share_renderer (GailRendererCell  *cell,
+                                        GtkTreeViewColumn *column);
+GtkCellRenderer *gail_renderer_cell_get_renderer (GailRendererCell *cell);
+
+/* For copying new values into the cell's renderer. entries are the positions in the class'
+ * property_list that are about to be set, in order. A shared renderer only gets the cell's
+ * own values back first if some of the shared properties aren't in entries */
+GtkCellRenderer *gail_renderer_cell_begin_transfer (GailRendererCell *cell,
+                                                    const guint      *entries,
+                                                    guint             n_entries);
+/* values are what was set for entries, unset for any that couldn't be. With a shared renderer
+ * they are kept as the cell's values instead of being read back from the renderer. They are
+ * all unset afterwards */
+void gail_renderer_cell_end_transfer (GailRendererCell *cell,
+                                      const guint      *entries,
+                                      GValue           *values,
+                                      guint             n_entries);
+/* Makes the cell's bound value for property refer to string rather than hold a copy of it.
+ * string has to be equal to the value and stay alive until the next transfer */
+void gail_renderer_cell_bind_static_string (GailRendererCell *cell,
+                                            const gchar      *property,
+                                            const gchar      *string);
+
 AtkObject *gail_renderer_cell_new (void);
 
 G_END_DECLS
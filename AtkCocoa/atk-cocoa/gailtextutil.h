@@ -22,6 +22,7 @@
 
 #include <glib-object.h>
 #include <gtk/gtk.h>
+#include "acoffsetindex.h"
 
 G_BEGIN_DECLS
 
@@ -57,6 +58,14 @@ struct _GailTextUtil
   GObject parent;
 
   GtkTextBuffer *buffer;
+
+  /* When set up from a string the text is kept as it is, and the buffer is only
+   * created for the boundaries that need GtkTextIter to work them out */
+  gchar    *text;
+  gint      n_bytes;
+  gint      n_chars;
+  gboolean  single_line;
+  AcOffsetIndex *offsets; /* Made the first time an offset has to be translated */
 };
 
 struct _GailTextUtilClass
@@ -81,6 +90,9 @@ gchar*        gail_text_util_get_text      (GailTextUtil    *textutil,
 gchar*        gail_text_util_get_substring (GailTextUtil    *textutil,
                                             gint            start_pos,
                                             gint            end_pos);
+gint          gail_text_util_get_char_count (GailTextUtil   *textutil);
+GtkTextBuffer* gail_text_util_get_buffer   (GailTextUtil    *textutil);
+AcOffsetIndex* gail_text_util_get_offset_index (GailTextUtil *textutil);
 
 G_END_DECLS
 
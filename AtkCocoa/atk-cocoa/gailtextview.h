@@ -22,6 +22,9 @@
 
 #include "gailcontainer.h"
 #include "gailtextutil.h"
+#include "acoffsetindex.h"
+
+@class NSString;
 
 G_BEGIN_DECLS
 
@@ -50,10 +53,29 @@ struct _GailTextView
   gint           length;
 
   guint          insert_notify_handler;
+
+  /* For translating Cocoa's UTF-16 ranges, made when it's first needed and
+   * kept up to date with the edits. It doesn't keep a copy of the text */
+  AcUtf16Index   *offsets;
+  /* NSMutableString * of the visible text, so the buffer doesn't have to be copied
+   * out every time Cocoa asks. void * because ARC doesn't like ObjC object types in
+   * C structs */
+  void           *snapshot;
+  /* NSString * copy of the snapshot handed out as the value, until the next edit */
+  void           *value;
+  /* Whether the buffer has hidden text, pixbufs or child anchors, so the snapshot
+   * can't be used for its ranges. Kept when the snapshot is dropped */
+  gboolean       snapshot_is_partial;
 };
 
 GType gail_text_view_get_type (void);
 
+AcUtf16Index *gail_text_view_get_offset_index (GailTextView *view);
+/* The string changes with the buffer, so it mustn't be kept or handed out */
+NSString *gail_text_view_get_snapshot (GailTextView *view);
+NSString *gail_text_view_get_value (GailTextView *view);
+gboolean gail_text_view_snapshot_matches_offsets (GailTextView *view);
+
 struct _GailTextViewClass
 {
   GailContainerClass parent_class;
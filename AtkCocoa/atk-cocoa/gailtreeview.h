@@ -24,9 +24,12 @@
 #include <gtk/gtk.h>
 #include "gailcontainer.h"
 #include "gailcell.h"
+#include "acrowops.h"
 
+@class NSArray;
 @class NSMutableArray;
 @class ACAccessibilityTreeColumnElement;
+@class ACAccessibilityTreeCellElement;
 
 G_BEGIN_DECLS
 
@@ -51,10 +54,31 @@ struct _GailTreeView
   GHashTable *columnMap; /* Maps GtkTreeViewColumn to ACAccessibilityTreeColumnElement */
   /* These are void * because ARC doesn't like ObjC object types in C structs */
   void *rowRootNode; /* The root ACAccessibilityTreeRowElement * */
-  void *rowCache; /* NSArray * containing the most recent dump of the row cache. */
-  guint32 rowUpdateId;
-  gboolean treeIsDirty;
+  void *cellRows; /* NSHashTable * of the rows that have cells, weakly held */
+  guint recycleCellsId; /* Recycles the cells of the rows that have scrolled out of view */
+  void *visibleRows; /* NSArray * of the rows in view when they were last asked for, with NSNull for rows that couldn't be made */
+  void *visibleRowElements; /* NSArray * of visibleRows without the NSNulls, the same array if there are none */
+  int visibleRowsStart; /* Flattened index of the first visible row, -1 if it has to be looked up again */
+  gdouble visibleRowsValue; /* The vertical adjustment's value for visibleRows */
+  gboolean visibleRowsDirty;
+  void *selectedIndexes; /* NSMutableIndexSet * of the flattened indices of the selected rows */
+  void *selectedRows; /* NSArray * of the rows in selectedIndexes handed out to clients */
+  gboolean selectionDirty;
+  gboolean lazyRows; /* Rows are placeholders until their element is requested */
+  void *unresolvedRows; /* NSHashTable * of rows made while the row tree was behind the model, weakly held */
   GList *oldSelection;
+
+  /* Model changes are queued and applied to the row tree in one batch when the main loop is idle */
+  AcRowOps *rowOps;
+
+  /* The plans for copying renderer values into the cells, see transfer_renderer_properties */
+  GHashTable *transferPlans;
+
+  /* Counters for how much the batching has merged */
+  guint batchCount;
+  guint batchedRowOps;
+  guint batchedSelectionChanges;
+  guint coalescedNotifications;
 };
 
 GType gail_tree_view_get_type (void);
@@ -71,13 +95,27 @@ void gail_tree_view_update_row_cells (GailTreeView *gailview,
 
 void gail_treeview_add_rows (GailTreeView *gailview,
                              NSMutableArray *a);
+NSArray *gail_treeview_get_rows (GailTreeView *gailview);
+void gail_treeview_ensure_rows (GailTreeView *gailview);
 void gail_treeview_add_columns (GailTreeView *gailview,
                                 NSMutableArray *a);
 void gail_treeview_add_headers (GailTreeView *gailview,
                                 NSMutableArray *a);
+/* The column's cells in every row, made as they are accessed */
+NSArray *gail_treeview_get_column_elements (GailTreeView *gailview,
+                                           ACAccessibilityTreeColumnElement *columnElement);
+/* The column's cells in the visible rows */
 void gail_treeview_add_column_elements (GailTreeView *gailview,
                                         ACAccessibilityTreeColumnElement *columnElement,
                                         NSMutableArray *a);
+/* The column's cells in the rows at the flattened indices in range */
+void gail_treeview_add_column_elements_in_range (GailTreeView *gailview,
+                                                ACAccessibilityTreeColumnElement *columnElement,
+                                                NSRange range,
+                                                NSMutableArray *a);
+ACAccessibilityTreeCellElement *gail_treeview_make_row_cell (GailTreeView *gailview,
+                                                             ACAccessibilityTreeRowElement *rowElement,
+                                                             ACAccessibilityTreeColumnElement *columnElement);
 void gail_treeview_add_row_elements (GailTreeView *gailview,
                                      ACAccessibilityTreeRowElement *rowElement,
                                      NSMutableArray *a);
@@ -86,12 +124,18 @@ void gail_treeview_add_renderer_elements (GailTreeView *gailview,
                                           ACAccessibilityTreeColumnElement *columnElement,
                                           NSMutableArray *a,
                                           NSMutableArray *visibleChildren);
+/* The returned array is kept until the selection changes, so it can't be modified */
+NSArray *gail_treeview_get_selected_rows (GailTreeView *gailview);
 void gail_treeview_add_selected_rows (GailTreeView *gailview,
                                       NSMutableArray *a);
+void gail_treeview_set_selected_rows (GailTreeView *gailview,
+                                      NSArray *rows);
 ACAccessibilityTreeRowElement *gail_treeview_row_for_path (GailTreeView *gailview,
                                                            GtkTreePath *path);
 ACAccessibilityTreeColumnElement *gail_treeview_get_column_element (GailTreeView *gailview,
                                                                     GtkTreeViewColumn *column);
+/* The returned array is kept until the view scrolls or the rows change, so it can't be modified */
+NSArray *gail_treeview_get_visible_rows (GailTreeView *gailview);
 void gail_treeview_add_visible_rows (GailTreeView *gailview,
                                      NSMutableArray *rows);
 
@@ -566,6 +566,9 @@ gail_switch_page_watcher (GSignalInvocationHint *ihint,
 static gboolean
 gail_focus_idle_handler (gpointer data)
 {
+  // The widget may have been destroyed before the idle ran, so its type isn't looked at
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "gail_focus_idle_handler", NULL);
+
   focus_notify_handler = 0;
   /*
    * The widget which was to receive focus may have been removed
@@ -668,6 +671,8 @@ gail_focus_notify (GtkWidget *widget)
 static void
 gail_focus_notify_when_idle (GtkWidget *widget, gboolean whenIdle)
 {
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "gail_focus_notify_when_idle", widget);
+
   if (focus_notify_handler)
     {
       if (widget)
@@ -1000,6 +1005,9 @@ gail_accessibility_module_init (void)
     ac_debug_flags |= g_parse_debug_string (debug, ac_debug_keys, G_N_ELEMENTS (ac_debug_keys));
   }
 
+  // Profiling is turned on per category with ATKCOCOA_PROFILE
+  ac_profile_init (ac_debug_keys, G_N_ELEMENTS (ac_debug_keys));
+
   // Overwrite the Gtk log handlers to give a backtrace
   if (g_getenv (ATKCOCOA_DEBUG_BACKTRACE) != NULL) {
     original_log = g_log_set_default_handler (gail_log_handler, NULL);
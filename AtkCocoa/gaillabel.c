@@ -221,6 +221,7 @@ notify_name_change (AtkObject *atk_obj)
   GailLabel *gail_label;
   GtkWidget *widget;
   GObject *gail_obj;
+  char *old_label;
 
   widget = GTK_ACCESSIBLE (atk_obj)->widget;
   if (widget == NULL)
@@ -240,16 +241,12 @@ notify_name_change (AtkObject *atk_obj)
    * Check whether the label has actually changed before emitting
    * notification.
    */
-  if (gail_label->textutil->buffer) 
+  old_label = gail_text_util_get_substring (gail_label->textutil, 0, -1);
+  if (old_label) 
     {
-      GtkTextIter start, end;
       const char *new_label;
-      char *old_label;
       int same;   
 
-      gtk_text_buffer_get_start_iter (gail_label->textutil->buffer, &start);
-      gtk_text_buffer_get_end_iter (gail_label->textutil->buffer, &end);
-      old_label = gtk_text_buffer_get_text (gail_label->textutil->buffer, &start, &end, FALSE);
       new_label = gtk_label_get_text (label);
       same = strcmp (new_label, old_label);
       g_free (old_label);
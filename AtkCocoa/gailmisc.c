@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <gtk/gtk.h>
 #include "atk-cocoa/gailmisc.h"
 
@@ -178,6 +179,335 @@ gail_misc_add_attribute (AtkAttributeSet *attrib_set,
   return return_set;
 }
 
+/*
+ * Each layout keeps an index of its text and attribute runs, so a run lookup doesn't step
+ * an attribute iterator and walk the UTF-8 from the start of the text every time.
+ * The index holds an AcOffsetIndex of the text, and the byte ranges of the attribute runs
+ * with the attributes reported for each of them.
+ *
+ * The index is kept for as long as the layout has the same text, serial and attribute list.
+ * GTK replaces a layout's attribute list rather than changing it in place, so the list is
+ * told apart by its pointer, and a ref is held on it so the pointer can't be reused for
+ * another list. The runs point into a copy of the list all the same, so a list that is
+ * changed in place can only give stale attributes, never freed ones.
+ */
+
+/* The attributes reported for a run, in the order they are added to the set */
+static const PangoAttrType layout_run_attr_types[] = {
+  PANGO_ATTR_FAMILY,
+  PANGO_ATTR_STYLE,
+  PANGO_ATTR_WEIGHT,
+  PANGO_ATTR_VARIANT,
+  PANGO_ATTR_STRETCH,
+  PANGO_ATTR_SIZE,
+  PANGO_ATTR_UNDERLINE,
+  PANGO_ATTR_STRIKETHROUGH,
+  PANGO_ATTR_RISE,
+  PANGO_ATTR_LANGUAGE,
+  PANGO_ATTR_SCALE,
+  PANGO_ATTR_FOREGROUND,
+  PANGO_ATTR_BACKGROUND,
+};
+
+#define N_LAYOUT_RUN_ATTRS G_N_ELEMENTS (layout_run_attr_types)
+
+typedef struct {
+  gint start_index;
+  gint end_index;
+  PangoAttribute *attrs[N_LAYOUT_RUN_ATTRS];
+} GailLayoutRun;
+
+typedef struct {
+  /* What the index was built for */
+  const gchar *text;
+  PangoAttrList *attr_list; /* The layout's attribute list, reffed */
+  guint serial;
+
+  PangoAttrList *attrs; /* A copy of attr_list, which the runs point into */
+
+  AcOffsetIndex *offsets;
+  GArray *runs; /* GailLayoutRun, sorted by start_index */
+} GailLayoutIndex;
+
+static GQuark quark_layout_index = 0;
+
+static guint
+layout_get_serial (PangoLayout *layout)
+{
+#if PANGO_VERSION_CHECK (1, 32, 4)
+  return pango_layout_get_serial (layout);
+#else
+  return 0;
+#endif
+}
+
+static void
+layout_index_free (gpointer data)
+{
+  GailLayoutIndex *index = data;
+
+  ac_offset_index_free (index->offsets);
+  g_array_free (index->runs, TRUE);
+  if (index->attrs)
+    pango_attr_list_unref (index->attrs);
+  if (index->attr_list)
+    pango_attr_list_unref (index->attr_list);
+
+  g_slice_free (GailLayoutIndex, index);
+}
+
+static void
+layout_run_init (GailLayoutRun     *run,
+                 PangoAttrIterator *iter)
+{
+  guint i;
+
+  pango_attr_iterator_range (iter, &run->start_index, &run->end_index);
+  for (i = 0; i < N_LAYOUT_RUN_ATTRS; i++)
+    run->attrs[i] = pango_attr_iterator_get (iter, layout_run_attr_types[i]);
+}
+
+static GailLayoutIndex *
+layout_index_new (PangoLayout   *layout,
+                  const gchar   *text,
+                  PangoAttrList *attr_list)
+{
+  GailLayoutIndex *index;
+
+  index = g_slice_new0 (GailLayoutIndex);
+  index->text = text;
+  index->attr_list = attr_list ? pango_attr_list_ref (attr_list) : NULL;
+  index->attrs = attr_list ? pango_attr_list_copy (attr_list) : NULL;
+  index->serial = layout_get_serial (layout);
+  index->offsets = ac_offset_index_new (text, -1);
+  index->runs = g_array_new (FALSE, FALSE, sizeof (GailLayoutRun));
+
+  if (index->attrs)
+    {
+      PangoAttrIterator *iter = pango_attr_list_get_iterator (index->attrs);
+
+      do
+        {
+          GailLayoutRun run;
+
+          layout_run_init (&run, iter);
+          g_array_append_val (index->runs, run);
+        }
+      while (pango_attr_iterator_next (iter));
+
+      pango_attr_iterator_destroy (iter);
+    }
+
+  return index;
+}
+
+static GailLayoutIndex *
+get_layout_index (PangoLayout *layout,
+                  const gchar *text)
+{
+  GailLayoutIndex *index;
+  PangoAttrList *attr_list;
+
+  if (G_UNLIKELY (quark_layout_index == 0))
+    quark_layout_index = g_quark_from_static_string ("gail-layout-index");
+
+  attr_list = pango_layout_get_attributes (layout);
+  index = g_object_get_qdata (G_OBJECT (layout), quark_layout_index);
+  if (index &&
+      index->text == text &&
+      index->serial == layout_get_serial (layout) &&
+      index->attr_list == attr_list)
+    return index;
+
+  index = layout_index_new (layout, text, attr_list);
+  g_object_set_qdata_full (G_OBJECT (layout), quark_layout_index, index, layout_index_free);
+
+  return index;
+}
+
+typedef struct {
+  const gchar *text;
+  guint serial;
+  AcOffsetIndex *offsets;
+} GailLayoutOffsets;
+
+static GQuark quark_layout_offsets = 0;
+
+static void
+layout_offsets_free (gpointer data)
+{
+  GailLayoutOffsets *layout_offsets = data;
+
+  ac_offset_index_free (layout_offsets->offsets);
+  g_slice_free (GailLayoutOffsets, layout_offsets);
+}
+
+/**
+ * gail_misc_layout_get_offset_index:
+ * @layout: A #PangoLayout
+ *
+ * Gets an index for translating between the character offsets and the
+ * byte indices of the layout's text. It is kept with the layout until
+ * the text changes.
+ *
+ * Returns: the #AcOffsetIndex, owned by the layout
+ **/
+AcOffsetIndex*
+gail_misc_layout_get_offset_index (PangoLayout *layout)
+{
+  GailLayoutOffsets *layout_offsets;
+  const gchar *text;
+
+  if (G_UNLIKELY (quark_layout_offsets == 0))
+    quark_layout_offsets = g_quark_from_static_string ("gail-layout-offsets");
+
+  text = pango_layout_get_text (layout);
+  layout_offsets = g_object_get_qdata (G_OBJECT (layout), quark_layout_offsets);
+  if (layout_offsets &&
+      layout_offsets->text == text &&
+      layout_offsets->serial == layout_get_serial (layout))
+    return layout_offsets->offsets;
+
+  layout_offsets = g_slice_new (GailLayoutOffsets);
+  layout_offsets->text = text;
+  layout_offsets->serial = layout_get_serial (layout);
+  layout_offsets->offsets = ac_offset_index_new (text, -1);
+  g_object_set_qdata_full (G_OBJECT (layout), quark_layout_offsets, layout_offsets, layout_offsets_free);
+
+  return layout_offsets->offsets;
+}
+
+/* The run containing byte_index. The runs cover every index, the last one ending at G_MAXINT */
+static GailLayoutRun *
+layout_index_find_run (GailLayoutIndex *index,
+                       gint            byte_index)
+{
+  guint low = 0, high = index->runs->len;
+
+  while (high - low > 1)
+    {
+      guint mid = (low + high) / 2;
+
+      if (g_array_index (index->runs, GailLayoutRun, mid).start_index <= byte_index)
+        low = mid;
+      else
+        high = mid;
+    }
+
+  return &g_array_index (index->runs, GailLayoutRun, low);
+}
+
+static AtkAttributeSet *
+add_layout_run_attributes (AtkAttributeSet *attrib_set,
+                           GailLayoutRun   *run)
+{
+  PangoAttrString *pango_string;
+  PangoAttrInt *pango_int;
+  PangoAttrColor *pango_color;
+  PangoAttrLanguage *pango_lang;
+  PangoAttrFloat *pango_float;
+  gchar *value = NULL;
+  guint i;
+
+  for (i = 0; i < N_LAYOUT_RUN_ATTRS; i++)
+    {
+      if (run->attrs[i] == NULL)
+        continue;
+
+      switch (layout_run_attr_types[i])
+        {
+        case PANGO_ATTR_FAMILY:
+          pango_string = (PangoAttrString*) run->attrs[i];
+          value = g_strdup_printf("%s", pango_string->value);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_FAMILY_NAME, 
+                                                value);
+          break;
+        case PANGO_ATTR_STYLE:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_STYLE, 
+          g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STYLE, pango_int->value)));
+          break;
+        case PANGO_ATTR_WEIGHT:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          value = g_strdup_printf("%i", pango_int->value);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_WEIGHT, 
+                                                value);
+          break;
+        case PANGO_ATTR_VARIANT:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_VARIANT, 
+           g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_VARIANT, pango_int->value)));
+          break;
+        case PANGO_ATTR_STRETCH:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_STRETCH, 
+           g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STRETCH, pango_int->value)));
+          break;
+        case PANGO_ATTR_SIZE:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          value = g_strdup_printf("%i", pango_int->value / PANGO_SCALE);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_SIZE,
+                                                value);
+          break;
+        case PANGO_ATTR_UNDERLINE:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_UNDERLINE, 
+           g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_UNDERLINE, pango_int->value)));
+          break;
+        case PANGO_ATTR_STRIKETHROUGH:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_STRIKETHROUGH, 
+           g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STRIKETHROUGH, pango_int->value)));
+          break;
+        case PANGO_ATTR_RISE:
+          pango_int = (PangoAttrInt*) run->attrs[i];
+          value = g_strdup_printf("%i", pango_int->value);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_RISE,
+                                                value);
+          break;
+        case PANGO_ATTR_LANGUAGE:
+          pango_lang = (PangoAttrLanguage*) run->attrs[i];
+          value = g_strdup( pango_language_to_string( pango_lang->value));
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_LANGUAGE, 
+                                                value);
+          break;
+        case PANGO_ATTR_SCALE:
+          pango_float = (PangoAttrFloat*) run->attrs[i];
+          value = g_strdup_printf("%g", pango_float->value);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                ATK_TEXT_ATTR_SCALE, 
+                                                value);
+          break;
+        case PANGO_ATTR_FOREGROUND:
+        case PANGO_ATTR_BACKGROUND:
+          pango_color = (PangoAttrColor*) run->attrs[i];
+          value = g_strdup_printf ("%u,%u,%u", 
+                                   pango_color->color.red, 
+                                   pango_color->color.green, 
+                                   pango_color->color.blue);
+          attrib_set = gail_misc_add_attribute (attrib_set, 
+                                                layout_run_attr_types[i] == PANGO_ATTR_FOREGROUND ?
+                                                ATK_TEXT_ATTR_FG_COLOR : ATK_TEXT_ATTR_BG_COLOR, 
+                                                value);
+          break;
+        default:
+          break;
+        }
+    }
+
+  return attrib_set;
+}
+
 /**
  * gail_misc_layout_get_run_attributes:
  * @attrib_set: The #AtkAttributeSet to add the attribute to
@@ -199,161 +529,93 @@ gail_misc_layout_get_run_attributes (AtkAttributeSet *attrib_set,
                                      gint            offset,
                                      gint            *start_offset,
                                      gint            *end_offset)
+{
+  GailLayoutIndex *layout_index;
+  GailLayoutRun *run;
+  gint index;
+
+  layout_index = get_layout_index (layout, text);
+  /* Grab the attributes of the PangoLayout, if any */
+  if (layout_index->runs->len == 0)
+    {
+      *start_offset = 0;
+      *end_offset = ac_offset_index_get_length (layout_index->offsets, AC_OFFSET_CHARS);
+      return attrib_set;
+    }
+  /* Get invariant range offsets, offsets out of range are clamped */
+  index = ac_offset_index_convert (layout_index->offsets, offset, AC_OFFSET_CHARS, AC_OFFSET_BYTES);
+  run = layout_index_find_run (layout_index, index);
+
+  *start_offset = ac_offset_index_convert (layout_index->offsets, run->start_index,
+                                           AC_OFFSET_BYTES, AC_OFFSET_CHARS);
+  /* The last run ends at G_MAXINT */
+  *end_offset = ac_offset_index_convert (layout_index->offsets, run->end_index,
+                                         AC_OFFSET_BYTES, AC_OFFSET_CHARS);
+
+  return add_layout_run_attributes (attrib_set, run);
+}
+
+/**
+ * gail_misc_layout_get_run_attributes_unindexed:
+ * @attrib_set: The #AtkAttributeSet to add the attribute to
+ * @layout: The PangoLayout from which the attributes will be obtained
+ * @text: The text 
+ * @offset: The offset at which the attributes are required
+ * @start_offset: The start offset of the current run
+ * @end_offset: The end offset of the current run
+ *
+ * Like gail_misc_layout_get_run_attributes(), but finds the run without
+ * indexing the layout. For layouts made for a single lookup, like the
+ * ones the cell renderers make, where the index would be thrown away
+ * unused.
+ *
+ * Returns: A pointer to the #AtkAttributeSet.
+ **/
+AtkAttributeSet* 
+gail_misc_layout_get_run_attributes_unindexed (AtkAttributeSet *attrib_set,
+                                               PangoLayout     *layout,
+                                               gchar           *text,
+                                               gint            offset,
+                                               gint            *start_offset,
+                                               gint            *end_offset)
 {
   PangoAttrIterator *iter;
-  PangoAttrList *attr;  
-  PangoAttrString *pango_string;
-  PangoAttrInt *pango_int;
-  PangoAttrColor *pango_color;
-  PangoAttrLanguage *pango_lang;
-  PangoAttrFloat *pango_float;
-  gint index, start_index, end_index;
-  gboolean is_next = TRUE;
-  gchar *value = NULL;
+  PangoAttrList *attr_list;
+  GailLayoutRun run;
+  gint index;
   glong len;
 
   len = g_utf8_strlen (text, -1);
-  /* Grab the attributes of the PangoLayout, if any */
-  if ((attr = pango_layout_get_attributes (layout)) == NULL)
+  attr_list = pango_layout_get_attributes (layout);
+  if (attr_list == NULL)
     {
       *start_offset = 0;
-      *end_offset = (int)len;
+      *end_offset = (gint)len;
       return attrib_set;
     }
-  iter = pango_attr_list_get_iterator (attr);
-  /* Get invariant range offsets */
-  /* If offset out of range, set offset in range */
+
   if (offset > len)
-    offset = (int)len;
+    offset = (gint)len;
   else if (offset < 0)
     offset = 0;
+  index = (gint)(g_utf8_offset_to_pointer (text, offset) - text);
 
-  index = (int)(g_utf8_offset_to_pointer (text, offset) - text);
-  pango_attr_iterator_range (iter, &start_index, &end_index);
-  while (is_next)
-    {
-      if (index >= start_index && index < end_index)
-        {
-          *start_offset = (int)g_utf8_pointer_to_offset (text,
-                                                    text + start_index);  
-          if (end_index == G_MAXINT)
-          /* Last iterator */
-            end_index = (int)len;
-      
-          *end_offset = (int)g_utf8_pointer_to_offset (text,
-                                                  text + end_index);  
-          break;
-        }  
-      is_next = pango_attr_iterator_next (iter);
-      pango_attr_iterator_range (iter, &start_index, &end_index);
-    }
-  /* Get attributes */
-  if ((pango_string = (PangoAttrString*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_FAMILY)) != NULL)
-    {
-      value = g_strdup_printf("%s", pango_string->value);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_FAMILY_NAME, 
-                                            value);
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_STYLE)) != NULL)
-    {
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_STYLE, 
-      g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STYLE, pango_int->value)));
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_WEIGHT)) != NULL)
-    {
-      value = g_strdup_printf("%i", pango_int->value);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_WEIGHT, 
-                                            value);
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_VARIANT)) != NULL)
-    {
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_VARIANT, 
-       g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_VARIANT, pango_int->value)));
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_STRETCH)) != NULL)
-    {
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_STRETCH, 
-       g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STRETCH, pango_int->value)));
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_SIZE)) != NULL)
-    {
-      value = g_strdup_printf("%i", pango_int->value / PANGO_SCALE);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_SIZE,
-                                            value);
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_UNDERLINE)) != NULL)
-    {
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_UNDERLINE, 
-       g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_UNDERLINE, pango_int->value)));
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_STRIKETHROUGH)) != NULL)
-    {
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_STRIKETHROUGH, 
-       g_strdup (atk_text_attribute_get_value (ATK_TEXT_ATTR_STRIKETHROUGH, pango_int->value)));
-    } 
-  if ((pango_int = (PangoAttrInt*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_RISE)) != NULL)
-    {
-      value = g_strdup_printf("%i", pango_int->value);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_RISE,
-                                            value);
-    } 
-  if ((pango_lang = (PangoAttrLanguage*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_LANGUAGE)) != NULL)
-    {
-      value = g_strdup( pango_language_to_string( pango_lang->value));
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_LANGUAGE, 
-                                            value);
-    } 
-  if ((pango_float = (PangoAttrFloat*) pango_attr_iterator_get (iter, 
-                                   PANGO_ATTR_SCALE)) != NULL)
-    {
-      value = g_strdup_printf("%g", pango_float->value);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_SCALE, 
-                                            value);
-    } 
-  if ((pango_color = (PangoAttrColor*) pango_attr_iterator_get (iter, 
-                                    PANGO_ATTR_FOREGROUND)) != NULL)
-    {
-      value = g_strdup_printf ("%u,%u,%u", 
-                               pango_color->color.red, 
-                               pango_color->color.green, 
-                               pango_color->color.blue);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_FG_COLOR, 
-                                            value);
-    } 
-  if ((pango_color = (PangoAttrColor*) pango_attr_iterator_get (iter, 
-                                     PANGO_ATTR_BACKGROUND)) != NULL)
-    {
-      value = g_strdup_printf ("%u,%u,%u", 
-                               pango_color->color.red, 
-                               pango_color->color.green, 
-                               pango_color->color.blue);
-      attrib_set = gail_misc_add_attribute (attrib_set, 
-                                            ATK_TEXT_ATTR_BG_COLOR, 
-                                            value);
-    } 
+  /* The runs cover every index, so this stops at the last one at the latest */
+  iter = pango_attr_list_get_iterator (attr_list);
+  layout_run_init (&run, iter);
+  while (index >= run.end_index && pango_attr_iterator_next (iter))
+    layout_run_init (&run, iter);
+
+  *start_offset = (gint)g_utf8_pointer_to_offset (text, text + run.start_index);
+  if (run.end_index == G_MAXINT)
+    *end_offset = (gint)len;
+  else
+    *end_offset = (gint)g_utf8_pointer_to_offset (text, text + run.end_index);
+
+  /* The attributes belong to the iterator */
+  attrib_set = add_layout_run_attributes (attrib_set, &run);
   pango_attr_iterator_destroy (iter);
+
   return attrib_set;
 }
 
@@ -555,21 +817,10 @@ gail_misc_get_origins (GtkWidget *widget,
   gdk_window_get_origin (window, x_toplevel, y_toplevel);
 }
 
-/**
- * gail_misc_add_to_attr_set:
- * @attrib_set: An #AtkAttributeSet
- * @attrs: The #GtkTextAttributes containing the attribute value
- * @attr: The #AtkTextAttribute to be added
- *
- * Gets the value for the AtkTextAttribute from the GtkTextAttributes
- * and adds it to the AttributeSet.
- *
- * Returns: A pointer to the updated #AtkAttributeSet.
- **/
-AtkAttributeSet*
-gail_misc_add_to_attr_set (AtkAttributeSet   *attrib_set,
-                           GtkTextAttributes *attrs,
-                           AtkTextAttribute  attr)
+/* The value of attr in attrs, as ATK formats it */
+static gchar *
+format_attribute_value (GtkTextAttributes *attrs,
+                        AtkTextAttribute  attr)
 {
   gchar *value;
 
@@ -671,456 +922,709 @@ gail_misc_add_to_attr_set (AtkAttributeSet   *attrib_set,
       value = NULL;
       break;
     }
-  return gail_misc_add_attribute (attrib_set, attr, value);
+  return value;
 }
 
 /**
- * gail_misc_buffer_get_run_attributes:
- * @buffer: The #GtkTextBuffer for which the attributes will be obtained
- * @offset: The offset at which the attributes are required
- * @start_offset: The start offset of the current run
- * @end_offset: The end offset of the current run
+ * gail_misc_add_to_attr_set:
+ * @attrib_set: An #AtkAttributeSet
+ * @attrs: The #GtkTextAttributes containing the attribute value
+ * @attr: The #AtkTextAttribute to be added
  *
- * Creates an AtkAttributeSet which contains the attributes for the 
- * run starting at offset.
+ * Gets the value for the AtkTextAttribute from the GtkTextAttributes
+ * and adds it to the AttributeSet.
  *
- * Returns: A pointer to the #AtkAttributeSet.
+ * Returns: A pointer to the updated #AtkAttributeSet.
  **/
 AtkAttributeSet*
-gail_misc_buffer_get_run_attributes (GtkTextBuffer *buffer,
-                                     gint          offset,
-                                     gint	    *start_offset,
-                                     gint          *end_offset)
+gail_misc_add_to_attr_set (AtkAttributeSet   *attrib_set,
+                           GtkTextAttributes *attrs,
+                           AtkTextAttribute  attr)
 {
-  GtkTextIter iter;
-  AtkAttributeSet *attrib_set = NULL;
-  AtkAttribute *at;
-  GSList *tags, *temp_tags;
-  gdouble scale = 1;
-  gboolean val_set = FALSE;
-  PangoFontMask mask;
+  return gail_misc_add_attribute (attrib_set, attr, format_attribute_value (attrs, attr));
+}
 
-  gtk_text_buffer_get_iter_at_offset (buffer, &iter, offset);
+/*
+ * Run attributes are resolved from the run's tags in a single pass. Each tag keeps the
+ * attributes it sets, formatted once as interned strings, until one of its properties
+ * changes. A run takes every attribute from the highest priority tag that sets it,
+ * apart from the scale, which is the product of all of them.
+ */
+#define ATTR_BIT(attr) (G_GUINT64_CONSTANT (1) << (attr))
+
+G_STATIC_ASSERT (ATK_TEXT_ATTR_LAST_DEFINED <= 64);
+
+typedef struct {
+  guint64 set;
+  const gchar *values[ATK_TEXT_ATTR_LAST_DEFINED];
+  gdouble scale;
+} GailTagAttributes;
+
+typedef struct {
+  guint64 set;
+  const gchar *values[ATK_TEXT_ATTR_LAST_DEFINED];
+} GailRunAttributes;
+
+/* The order the attributes are reported in */
+static const AtkTextAttribute run_attribute_order[] = {
+  ATK_TEXT_ATTR_STYLE,
+  ATK_TEXT_ATTR_VARIANT,
+  ATK_TEXT_ATTR_STRETCH,
+  ATK_TEXT_ATTR_JUSTIFICATION,
+  ATK_TEXT_ATTR_DIRECTION,
+  ATK_TEXT_ATTR_WRAP_MODE,
+  ATK_TEXT_ATTR_FG_STIPPLE,
+  ATK_TEXT_ATTR_BG_STIPPLE,
+  ATK_TEXT_ATTR_FG_COLOR,
+  ATK_TEXT_ATTR_BG_COLOR,
+  ATK_TEXT_ATTR_FAMILY_NAME,
+  ATK_TEXT_ATTR_LANGUAGE,
+  ATK_TEXT_ATTR_WEIGHT,
+  ATK_TEXT_ATTR_SCALE,
+  ATK_TEXT_ATTR_SIZE,
+  ATK_TEXT_ATTR_STRIKETHROUGH,
+  ATK_TEXT_ATTR_UNDERLINE,
+  ATK_TEXT_ATTR_RISE,
+  ATK_TEXT_ATTR_BG_FULL_HEIGHT,
+  ATK_TEXT_ATTR_PIXELS_INSIDE_WRAP,
+  ATK_TEXT_ATTR_PIXELS_BELOW_LINES,
+  ATK_TEXT_ATTR_PIXELS_ABOVE_LINES,
+  ATK_TEXT_ATTR_EDITABLE,
+  ATK_TEXT_ATTR_INVISIBLE,
+  ATK_TEXT_ATTR_INDENT,
+  ATK_TEXT_ATTR_RIGHT_MARGIN,
+  ATK_TEXT_ATTR_LEFT_MARGIN,
+};
+
+static GQuark quark_tag_attributes = 0;
+static GQuark quark_tag_watched = 0;
+
+static void
+tag_attributes_free (gpointer data)
+{
+  g_slice_free (GailTagAttributes, data);
+}
 
-  gtk_text_iter_forward_to_tag_toggle (&iter, NULL);
-  *end_offset = gtk_text_iter_get_offset (&iter);
+static void
+tag_property_changed (GObject    *tag,
+                      GParamSpec *pspec,
+                      gpointer   data)
+{
+  g_object_set_qdata (tag, quark_tag_attributes, NULL);
+}
 
-  gtk_text_iter_backward_to_tag_toggle (&iter, NULL);
-  *start_offset = gtk_text_iter_get_offset (&iter);
+static void
+tag_attributes_add (GailTagAttributes *tag_attrs,
+                    GtkTextAttributes *values,
+                    AtkTextAttribute  attr)
+{
+  gchar *value = format_attribute_value (values, attr);
 
-  gtk_text_buffer_get_iter_at_offset (buffer, &iter, offset);
+  tag_attrs->values[attr] = value ? g_intern_string (value) : NULL;
+  tag_attrs->set |= ATTR_BIT (attr);
+  g_free (value);
+}
 
-  tags = gtk_text_iter_get_tags (&iter);
-  tags = g_slist_reverse (tags);
+static GailTagAttributes *
+get_tag_attributes (GtkTextTag *tag)
+{
+  GailTagAttributes *tag_attrs;
+  GtkTextAttributes *values = tag->values;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  if (G_UNLIKELY (quark_tag_attributes == 0))
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
+      quark_tag_attributes = g_quark_from_static_string ("gail-tag-attributes");
+      quark_tag_watched = g_quark_from_static_string ("gail-tag-attributes-watched");
+    }
 
-      font = tag->values->font;
+  tag_attrs = g_object_get_qdata (G_OBJECT (tag), quark_tag_attributes);
+  if (tag_attrs)
+    return tag_attrs;
 
-      if (font)
-        {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_STYLE;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_STYLE);
-        }
-      temp_tags = temp_tags->next;
+  tag_attrs = g_slice_new0 (GailTagAttributes);
+
+  if (values->font)
+    {
+      PangoFontMask mask = pango_font_description_get_set_fields (values->font);
+
+      if (mask & PANGO_FONT_MASK_STYLE)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_STYLE);
+      if (mask & PANGO_FONT_MASK_VARIANT)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_VARIANT);
+      if (mask & PANGO_FONT_MASK_STRETCH)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_STRETCH);
+      if (mask & PANGO_FONT_MASK_FAMILY)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_FAMILY_NAME);
+      if (mask & PANGO_FONT_MASK_WEIGHT)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_WEIGHT);
+      if (mask & PANGO_FONT_MASK_SIZE)
+        tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_SIZE);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  if (tag->justification_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_JUSTIFICATION);
+  if (values->direction != GTK_TEXT_DIR_NONE)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_DIRECTION);
+  if (tag->wrap_mode_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_WRAP_MODE);
+  if (tag->fg_stipple_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_FG_STIPPLE);
+  if (tag->bg_stipple_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_BG_STIPPLE);
+  if (tag->fg_color_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_FG_COLOR);
+  if (tag->bg_color_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_BG_COLOR);
+  if (tag->language_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_LANGUAGE);
+  if (tag->scale_set)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
+      tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_SCALE);
+      tag_attrs->scale = values->font_scale;
+    }
+  if (tag->strikethrough_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_STRIKETHROUGH);
+  if (tag->underline_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_UNDERLINE);
+  if (tag->rise_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_RISE);
+  if (tag->bg_full_height_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_BG_FULL_HEIGHT);
+  if (tag->pixels_inside_wrap_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_PIXELS_INSIDE_WRAP);
+  if (tag->pixels_below_lines_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_PIXELS_BELOW_LINES);
+  if (tag->pixels_above_lines_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_PIXELS_ABOVE_LINES);
+  if (tag->editable_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_EDITABLE);
+  if (tag->invisible_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_INVISIBLE);
+  if (tag->indent_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_INDENT);
+  if (tag->right_margin_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_RIGHT_MARGIN);
+  if (tag->left_margin_set)
+    tag_attributes_add (tag_attrs, values, ATK_TEXT_ATTR_LEFT_MARGIN);
+
+  g_object_set_qdata_full (G_OBJECT (tag), quark_tag_attributes, tag_attrs, tag_attributes_free);
+
+  // Any property change can change what the tag sets, so the attributes are worked out again
+  if (g_object_get_qdata (G_OBJECT (tag), quark_tag_watched) == NULL)
+    {
+      g_signal_connect (tag, "notify", G_CALLBACK (tag_property_changed), NULL);
+      g_object_set_qdata (G_OBJECT (tag), quark_tag_watched, GINT_TO_POINTER (TRUE));
+    }
 
-      font = tag->values->font;
+  return tag_attrs;
+}
 
-      if (font)
-        {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_VARIANT;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_VARIANT);
-        }
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+/* tags is in increasing priority, as gtk_text_iter_get_tags returns them */
+static void
+resolve_run_attributes (GSList            *tags,
+                        GailRunAttributes *run)
+{
+  const gchar *scale_value = NULL;
+  gdouble scale = 1;
+  guint n_scales = 0;
+  GSList *l;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  memset (run, 0, sizeof (GailRunAttributes));
+
+  // The list is walked from the lowest priority up, so a later tag overrides an earlier one
+  for (l = tags; l; l = l->next)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
+      GailTagAttributes *tag_attrs = get_tag_attributes (GTK_TEXT_TAG (l->data));
+      guint64 bits = tag_attrs->set & ~ATTR_BIT (ATK_TEXT_ATTR_SCALE);
+
+      run->set |= bits;
+      while (bits)
+        {
+          int attr = __builtin_ctzll (bits);
 
-      font = tag->values->font;
+          run->values[attr] = tag_attrs->values[attr];
+          bits &= bits - 1;
+        }
 
-      if (font)
+      if (tag_attrs->set & ATTR_BIT (ATK_TEXT_ATTR_SCALE))
         {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_STRETCH;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_STRETCH);
+          scale *= tag_attrs->scale;
+          scale_value = tag_attrs->values[ATK_TEXT_ATTR_SCALE];
+          n_scales++;
         }
-      temp_tags = temp_tags->next;
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  if (n_scales > 0)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      run->set |= ATTR_BIT (ATK_TEXT_ATTR_SCALE);
 
-      val_set = tag->justification_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_JUSTIFICATION);
-      temp_tags = temp_tags->next;
+      if (n_scales == 1)
+        {
+          run->values[ATK_TEXT_ATTR_SCALE] = scale_value;
+        }
+      else
+        {
+          gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+          g_snprintf (buf, sizeof (buf), "%g", scale);
+          run->values[ATK_TEXT_ATTR_SCALE] = g_intern_string (buf);
+        }
     }
-  val_set = FALSE;
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+static AtkAttributeSet *
+run_attributes_to_set (const GailRunAttributes *run)
+{
+  AtkAttributeSet *attrib_set = NULL;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (run_attribute_order); i++)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      AtkTextAttribute attr = run_attribute_order[i];
 
-      if (tag->values->direction != GTK_TEXT_DIR_NONE)
+      if (run->set & ATTR_BIT (attr))
         {
-          val_set = TRUE;
-          attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                  ATK_TEXT_ATTR_DIRECTION);
+          // The set belongs to the caller, who frees the strings
+          attrib_set = gail_misc_add_attribute (attrib_set, attr, g_strdup (run->values[attr]));
         }
-      temp_tags = temp_tags->next;
     }
-  val_set = FALSE;
-
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
 
-      val_set = tag->wrap_mode_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_WRAP_MODE);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+  return attrib_set;
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+/*
+ * Each buffer keeps an index of its runs: the sorted offsets where tags toggle, each with
+ * the attributes of the run it starts, resolved when first asked for. Edits shift the
+ * offsets after them and mark where they happened as dirty, and the paragraphs around the
+ * dirty places are scanned again before the next lookup, so finding a run is a binary search
+ * rather than a walk over the buffer's tag toggles.
+ */
+typedef struct {
+  gint offset;
+  GailRunAttributes *attrs;
+} GailRunBoundary;
+
+typedef struct {
+  gint start;
+  gint end;
+} GailDirtyRange;
+
+typedef struct {
+  GtkTextBuffer *buffer;
+  GtkTextTagTable *tag_table;
+  GArray *boundaries; /* GailRunBoundary, sorted by offset, always starting with 0 */
+  GArray *dirty; /* GailDirtyRange, sorted by start, none of them overlapping or touching */
+} GailRunIndex;
+
+/* Past this many dirty ranges they are collapsed into the one range covering them all, so
+ * keeping them up to date stays cheap however many edits come before the next lookup */
+#define RUN_INDEX_MAX_DIRTY 16
+
+static GQuark quark_run_index = 0;
+
+static void
+run_boundary_clear (GailRunBoundary *boundary)
+{
+  if (boundary->attrs)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-
-      val_set = tag->fg_stipple_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_FG_STIPPLE);
-      temp_tags = temp_tags->next;
+      g_slice_free (GailRunAttributes, boundary->attrs);
+      boundary->attrs = NULL;
     }
-  val_set = FALSE;
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+static void
+run_index_mark_dirty (GailRunIndex *index,
+                      gint         start,
+                      gint         end)
+{
+  GailDirtyRange range = { start, end };
+  guint low = 0, high = index->dirty->len, last;
+
+  // The ranges don't overlap, so their ends are sorted too. Find the first one that reaches start
+  while (low < high)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      guint mid = (low + high) / 2;
 
-      val_set = tag->bg_stipple_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_BG_STIPPLE);
-      temp_tags = temp_tags->next;
+      if (g_array_index (index->dirty, GailDirtyRange, mid).end < start)
+        low = mid + 1;
+      else
+        high = mid;
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  // Everything from there that starts by end is merged into the new range
+  for (last = low; last < index->dirty->len; last++)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      GailDirtyRange *merged = &g_array_index (index->dirty, GailDirtyRange, last);
 
-      val_set = tag->fg_color_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_FG_COLOR);
-      temp_tags = temp_tags->next;
+      if (merged->start > end)
+        break;
+      range.start = MIN (range.start, merged->start);
+      range.end = MAX (range.end, merged->end);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  g_array_remove_range (index->dirty, low, last - low);
+  g_array_insert_val (index->dirty, low, range);
+
+  if (index->dirty->len > RUN_INDEX_MAX_DIRTY)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-  
-      val_set = tag->bg_color_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_BG_COLOR);
-      temp_tags = temp_tags->next;
+      range.start = g_array_index (index->dirty, GailDirtyRange, 0).start;
+      range.end = g_array_index (index->dirty, GailDirtyRange, index->dirty->len - 1).end;
+      g_array_set_size (index->dirty, 1);
+      g_array_index (index->dirty, GailDirtyRange, 0) = range;
     }
-  val_set = FALSE;
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
+/* The tags themselves changed, so no run's attributes can be trusted but the boundaries stand */
+static void
+run_index_forget_attributes (GailRunIndex *index)
+{
+  guint i;
 
-      font = tag->values->font;
+  for (i = 0; i < index->boundaries->len; i++)
+    run_boundary_clear (&g_array_index (index->boundaries, GailRunBoundary, i));
+}
 
-      if (font)
-        {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_FAMILY;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_FAMILY_NAME);
-        }
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+/* First boundary at or after offset */
+static guint
+run_index_lower_bound (GailRunIndex *index,
+                       gint         offset)
+{
+  guint low = 0, high = index->boundaries->len;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  while (low < high)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      guint mid = (low + high) / 2;
 
-      val_set = tag->language_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_LANGUAGE);
-      temp_tags = temp_tags->next;
+      if (g_array_index (index->boundaries, GailRunBoundary, mid).offset < offset)
+        low = mid + 1;
+      else
+        high = mid;
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
+  return low;
+}
 
-      font = tag->values->font;
+/* Moves everything after offset by delta, and drops the boundaries in
+ * [offset, offset - delta) when text is deleted */
+static void
+run_index_shift (GailRunIndex *index,
+                 gint         offset,
+                 gint         delta)
+{
+  guint i, first;
 
-      if (font)
-        {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_WEIGHT;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_WEIGHT);
-        }
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+  if (delta < 0)
+    {
+      guint last;
 
+      first = run_index_lower_bound (index, offset);
+      last = run_index_lower_bound (index, offset - delta);
 
-  /*
-   * scale is special as the scale is the product of all scale values
-   * specified.
-   */
-  temp_tags = tags;
-  while (temp_tags)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      // The boundary at the start of the buffer always stays
+      if (first == 0 && last > 0)
+        first = 1;
 
-      if (tag->scale_set)
-        {
-          val_set = TRUE;
-          scale *= tag->values->font_scale;
-        }
-      temp_tags = temp_tags->next;
+      for (i = first; i < last; i++)
+        run_boundary_clear (&g_array_index (index->boundaries, GailRunBoundary, i));
+      if (last > first)
+        g_array_remove_range (index->boundaries, first, last - first);
     }
-  if (val_set)
+  else
     {
-      at = g_malloc(sizeof(AtkAttribute));
-      at->name = g_strdup(atk_text_attribute_get_name (ATK_TEXT_ATTR_SCALE));
-      at->value = g_strdup_printf("%g", scale);
-      attrib_set = g_slist_prepend(attrib_set, at);
+      first = run_index_lower_bound (index, offset + 1);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  for (i = first; i < index->boundaries->len; i++)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
-      PangoFontDescription *font;
-
-      font = tag->values->font;
+      GailRunBoundary *boundary = &g_array_index (index->boundaries, GailRunBoundary, i);
 
-      if (font)
-        {
-          mask = pango_font_description_get_set_fields (font);
-          val_set = mask & PANGO_FONT_MASK_SIZE;
-          if (val_set)
-            attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                    ATK_TEXT_ATTR_SIZE);
-        }
-      temp_tags = temp_tags->next;
+      boundary->offset = MAX (offset, boundary->offset + delta);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  for (i = 0; i < index->dirty->len; i++)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      GailDirtyRange *range = &g_array_index (index->dirty, GailDirtyRange, i);
 
-      val_set = tag->strikethrough_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_STRIKETHROUGH);
-      temp_tags = temp_tags->next;
+      if (range->start > offset)
+        range->start = MAX (offset, range->start + delta);
+      if (range->end > offset)
+        range->end = MAX (offset, range->end + delta);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  // A deletion can bring ranges together, which are merged to keep them apart
+  if (delta < 0)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      guint kept = 0;
 
-      val_set = tag->underline_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_UNDERLINE);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+      for (i = 1; i < index->dirty->len; i++)
+        {
+          GailDirtyRange *range = &g_array_index (index->dirty, GailDirtyRange, i);
+          GailDirtyRange *previous = &g_array_index (index->dirty, GailDirtyRange, kept);
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+          if (range->start <= previous->end)
+            previous->end = MAX (previous->end, range->end);
+          else
+            g_array_index (index->dirty, GailDirtyRange, ++kept) = *range;
+        }
 
-      val_set = tag->rise_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_RISE);
-      temp_tags = temp_tags->next;
+      if (index->dirty->len > 0)
+        g_array_set_size (index->dirty, kept + 1);
     }
-  val_set = FALSE;
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+static void
+buffer_insert_text (GtkTextBuffer *buffer,
+                    GtkTextIter   *location,
+                    gchar         *text,
+                    gint          len,
+                    GailRunIndex  *index)
+{
+  gint n_chars = (gint)g_utf8_strlen (text, len);
+  // location has been moved to the end of the new text
+  gint offset = gtk_text_iter_get_offset (location) - n_chars;
 
-      val_set = tag->bg_full_height_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_BG_FULL_HEIGHT);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+  run_index_shift (index, offset, n_chars);
+  run_index_mark_dirty (index, offset, offset + n_chars);
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+static void
+buffer_delete_range (GtkTextBuffer *buffer,
+                     GtkTextIter   *start,
+                     GtkTextIter   *end,
+                     GailRunIndex  *index)
+{
+  gint start_offset = gtk_text_iter_get_offset (start);
+  gint end_offset = gtk_text_iter_get_offset (end);
 
-      val_set = tag->pixels_inside_wrap_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_PIXELS_INSIDE_WRAP);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+  run_index_shift (index, start_offset, start_offset - end_offset);
+  run_index_mark_dirty (index, start_offset, start_offset);
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+static void
+buffer_tag_changed (GtkTextBuffer *buffer,
+                    GtkTextTag    *tag,
+                    GtkTextIter   *start,
+                    GtkTextIter   *end,
+                    GailRunIndex  *index)
+{
+  run_index_mark_dirty (index, gtk_text_iter_get_offset (start), gtk_text_iter_get_offset (end));
+}
 
-      val_set = tag->pixels_below_lines_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_PIXELS_BELOW_LINES);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+static void
+tag_table_tag_changed (GtkTextTagTable *table,
+                       GtkTextTag      *tag,
+                       gboolean        size_changed,
+                       GailRunIndex    *index)
+{
+  run_index_forget_attributes (index);
+}
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+static void
+tag_table_tag_removed (GtkTextTagTable *table,
+                       GtkTextTag      *tag,
+                       GailRunIndex    *index)
+{
+  // Removing a tag from the table takes it off the whole buffer
+  run_index_forget_attributes (index);
+  run_index_mark_dirty (index, 0, gtk_text_buffer_get_char_count (index->buffer));
+}
 
-      val_set = tag->pixels_above_lines_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_PIXELS_ABOVE_LINES);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+static void
+run_index_free (gpointer data)
+{
+  GailRunIndex *index = data;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+  run_index_forget_attributes (index);
+  g_array_free (index->boundaries, TRUE);
+  g_array_free (index->dirty, TRUE);
 
-      val_set = tag->editable_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_EDITABLE);
-      temp_tags = temp_tags->next;
-    }
-  val_set = FALSE;
+  // The table can be shared with other buffers, so it may well outlive this one
+  g_signal_handlers_disconnect_by_data (index->tag_table, index);
+  g_object_unref (index->tag_table);
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
-    {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+  g_slice_free (GailRunIndex, index);
+}
+
+static GailRunIndex *
+get_run_index (GtkTextBuffer *buffer)
+{
+  GailRunIndex *index;
+
+  if (G_UNLIKELY (quark_run_index == 0))
+    quark_run_index = g_quark_from_static_string ("gail-run-index");
+
+  index = g_object_get_qdata (G_OBJECT (buffer), quark_run_index);
+  if (index)
+    return index;
+
+  index = g_slice_new0 (GailRunIndex);
+  index->buffer = buffer;
+  index->tag_table = g_object_ref (gtk_text_buffer_get_tag_table (buffer));
+  index->boundaries = g_array_new (FALSE, FALSE, sizeof (GailRunBoundary));
+  index->dirty = g_array_new (FALSE, FALSE, sizeof (GailDirtyRange));
+
+  // Built on the first lookup
+  run_index_mark_dirty (index, 0, gtk_text_buffer_get_char_count (buffer));
+
+  g_signal_connect_after (buffer, "insert-text", G_CALLBACK (buffer_insert_text), index);
+  // Connected before the default handler, while the range still has its length
+  g_signal_connect (buffer, "delete-range", G_CALLBACK (buffer_delete_range), index);
+  g_signal_connect_after (buffer, "apply-tag", G_CALLBACK (buffer_tag_changed), index);
+  g_signal_connect_after (buffer, "remove-tag", G_CALLBACK (buffer_tag_changed), index);
+  g_signal_connect (index->tag_table, "tag-changed", G_CALLBACK (tag_table_tag_changed), index);
+  g_signal_connect (index->tag_table, "tag-removed", G_CALLBACK (tag_table_tag_removed), index);
+
+  g_object_set_qdata_full (G_OBJECT (buffer), quark_run_index, index, run_index_free);
+
+  return index;
+}
+
+/* Widens start and end out to the paragraphs they are in */
+static void
+run_index_paragraph_bounds (GailRunIndex *index,
+                            gint         *start,
+                            gint         *end)
+{
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &iter, *start);
+  gtk_text_iter_set_line_offset (&iter, 0);
+  *start = gtk_text_iter_get_offset (&iter);
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &iter, *end);
+  if (!gtk_text_iter_ends_line (&iter))
+    gtk_text_iter_forward_to_line_end (&iter);
+  gtk_text_iter_forward_line (&iter);
+  *end = gtk_text_iter_get_offset (&iter);
+}
+
+/* Scans the paragraphs from start to end for tag toggles again. start and end are
+ * paragraph bounds, from run_index_paragraph_bounds */
+static void
+run_index_rescan (GailRunIndex *index,
+                  gint         start,
+                  gint         end)
+{
+  GtkTextIter iter;
+  GArray *found;
+  guint first, last, i;
 
-      val_set = tag->invisible_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_INVISIBLE);
-      temp_tags = temp_tags->next;
+  found = g_array_new (FALSE, FALSE, sizeof (GailRunBoundary));
+
+  gtk_text_buffer_get_iter_at_offset (index->buffer, &iter, start);
+  if (start == 0 || gtk_text_iter_toggles_tag (&iter, NULL))
+    {
+      GailRunBoundary boundary = { start, NULL };
+      g_array_append_val (found, boundary);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  while (gtk_text_iter_forward_to_tag_toggle (&iter, NULL))
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      GailRunBoundary boundary = { gtk_text_iter_get_offset (&iter), NULL };
 
-      val_set = tag->indent_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_INDENT);
-      temp_tags = temp_tags->next;
+      // A toggle at the end of the buffer doesn't start a run
+      if (boundary.offset >= end || gtk_text_iter_is_end (&iter))
+        break;
+      g_array_append_val (found, boundary);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  first = run_index_lower_bound (index, start);
+  last = run_index_lower_bound (index, end);
+  for (i = first; i < last; i++)
+    run_boundary_clear (&g_array_index (index->boundaries, GailRunBoundary, i));
+  g_array_remove_range (index->boundaries, first, last - first);
+  g_array_insert_vals (index->boundaries, first, found->data, found->len);
+
+  g_array_free (found, TRUE);
+}
+
+static void
+run_index_update (GailRunIndex *index)
+{
+  guint i = 0;
+
+  // Ranges whose paragraphs overlap are scanned together, so no paragraph is scanned twice
+  while (i < index->dirty->len)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      GailDirtyRange range = g_array_index (index->dirty, GailDirtyRange, i++);
+
+      run_index_paragraph_bounds (index, &range.start, &range.end);
+      while (i < index->dirty->len &&
+             g_array_index (index->dirty, GailDirtyRange, i).start < range.end)
+        {
+          GailDirtyRange next = g_array_index (index->dirty, GailDirtyRange, i++);
+
+          run_index_paragraph_bounds (index, &next.start, &next.end);
+          range.end = MAX (range.end, next.end);
+        }
 
-      val_set = tag->right_margin_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_RIGHT_MARGIN);
-      temp_tags = temp_tags->next;
+      run_index_rescan (index, range.start, range.end);
     }
-  val_set = FALSE;
 
-  temp_tags = tags;
-  while (temp_tags && !val_set)
+  g_array_set_size (index->dirty, 0);
+}
+
+/**
+ * gail_misc_buffer_get_run_attributes:
+ * @buffer: The #GtkTextBuffer for which the attributes will be obtained
+ * @offset: The offset at which the attributes are required
+ * @start_offset: The start offset of the current run
+ * @end_offset: The end offset of the current run
+ *
+ * Creates an AtkAttributeSet which contains the attributes for the 
+ * run starting at offset.
+ *
+ * Returns: A pointer to the #AtkAttributeSet.
+ **/
+AtkAttributeSet*
+gail_misc_buffer_get_run_attributes (GtkTextBuffer *buffer,
+                                     gint          offset,
+                                     gint	    *start_offset,
+                                     gint          *end_offset)
+{
+  GailRunIndex *index;
+  GailRunBoundary *boundary;
+  GailRunAttributes run;
+  GtkTextIter iter;
+  GSList *tags;
+  gint n_chars;
+  guint i;
+
+  n_chars = gtk_text_buffer_get_char_count (buffer);
+  if (offset < 0 || offset > n_chars)
+    offset = n_chars;
+
+  index = get_run_index (buffer);
+  run_index_update (index);
+
+  // The run a position is in is the one started by the last boundary at or before it.
+  // The end of the buffer belongs to the last run
+  i = run_index_lower_bound (index, MIN (offset, n_chars - 1) + 1);
+  boundary = &g_array_index (index->boundaries, GailRunBoundary, i > 0 ? i - 1 : 0);
+
+  *start_offset = n_chars > 0 ? boundary->offset : 0;
+  *end_offset = i < index->boundaries->len ? g_array_index (index->boundaries, GailRunBoundary, i).offset : n_chars;
+
+  if (offset < n_chars)
     {
-      GtkTextTag *tag = GTK_TEXT_TAG (temp_tags->data);
+      if (boundary->attrs == NULL)
+        {
+          gtk_text_buffer_get_iter_at_offset (buffer, &iter, boundary->offset);
+          tags = gtk_text_iter_get_tags (&iter);
+          resolve_run_attributes (tags, &run);
+          g_slist_free (tags);
 
-      val_set = tag->left_margin_set;
-      if (val_set)
-        attrib_set = gail_misc_add_to_attr_set (attrib_set, tag->values, 
-                                                ATK_TEXT_ATTR_LEFT_MARGIN);
-      temp_tags = temp_tags->next;
+          boundary->attrs = g_slice_dup (GailRunAttributes, &run);
+        }
+
+      return run_attributes_to_set (boundary->attrs);
     }
-  val_set = FALSE;
 
+  // The end of the buffer has its own tags
+  gtk_text_buffer_get_iter_at_offset (buffer, &iter, offset);
+  tags = gtk_text_iter_get_tags (&iter);
+  resolve_run_attributes (tags, &run);
   g_slist_free (tags);
-  return attrib_set;
+
+  return run_attributes_to_set (&run);
 }
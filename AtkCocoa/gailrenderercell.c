@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <gtk/gtk.h>
 #include "atk-cocoa/gailrenderercell.h"
 
@@ -29,12 +30,29 @@ static void      gail_renderer_cell_finalize            (GObject               *
 
 G_DEFINE_TYPE (GailRendererCell, gail_renderer_cell, GAIL_TYPE_CELL)
 
+static GQuark quark_shared_renderers = 0;
+static GQuark quark_shared_state = 0;
+
+/* What a shared renderer needs to switch between the cells that use it */
+typedef struct {
+  guint n_specs;
+  GParamSpec **specs; /* The properties of the class' property_list the renderer has, in order */
+  guint n_entries;
+  gint *spec_for_entry; /* Index into specs for each entry of property_list, -1 if it isn't shared */
+  GValue *defaults; /* The values of a new renderer, for cells that haven't had values copied in */
+  GailRendererCell *bound; /* The cell whose values are in the renderer, not referenced */
+} SharedRendererState;
+
 static void 
 gail_renderer_cell_class_init (GailRendererCellClass *klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
   klass->property_list = NULL;
+  klass->share_renderer = FALSE;
+
+  quark_shared_renderers = g_quark_from_static_string ("gail-renderer-cell-shared-renderers");
+  quark_shared_state = g_quark_from_static_string ("gail-renderer-cell-shared-state");
 
   gobject_class->finalize = gail_renderer_cell_finalize;
 }
@@ -43,6 +61,21 @@ static void
 gail_renderer_cell_init (GailRendererCell *renderer_cell)
 {
   renderer_cell->renderer = NULL;
+  renderer_cell->bound_values = NULL;
+}
+
+static void
+free_values (GValue *values,
+             guint   n_values)
+{
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    {
+      if (G_IS_VALUE (&values[i]))
+        g_value_unset (&values[i]);
+    }
+  g_free (values);
 }
 
 static void
@@ -51,20 +84,285 @@ gail_renderer_cell_finalize (GObject  *object)
   GailRendererCell *renderer_cell = GAIL_RENDERER_CELL (object);
 
   if (renderer_cell->renderer)
-    g_object_unref (renderer_cell->renderer);
+    {
+      SharedRendererState *state = g_object_get_qdata (G_OBJECT (renderer_cell->renderer), quark_shared_state);
+
+      if (state)
+        {
+          /* The renderer keeps our values, but they can't be ours any more */
+          if (state->bound == renderer_cell)
+            state->bound = NULL;
+
+          if (renderer_cell->bound_values)
+            free_values (renderer_cell->bound_values, state->n_specs);
+        }
+
+      g_object_unref (renderer_cell->renderer);
+    }
+
   G_OBJECT_CLASS (gail_renderer_cell_parent_class)->finalize (object);
 }
 
+static void
+shared_renderer_state_free (SharedRendererState *state)
+{
+  free_values (state->defaults, state->n_specs);
+  g_free (state->specs);
+  g_free (state->spec_for_entry);
+  g_slice_free (SharedRendererState, state);
+}
+
+/* renderer has to be new, so its values are the defaults */
+static SharedRendererState *
+shared_renderer_state_new (GailRendererCellClass *class,
+                           GtkCellRenderer       *renderer)
+{
+  SharedRendererState *state = g_slice_new0 (SharedRendererState);
+  GObjectClass *renderer_class = G_OBJECT_GET_CLASS (renderer);
+  gchar **prop_list;
+  guint n_props = 0;
+
+  for (prop_list = class->property_list; prop_list && *prop_list; prop_list++)
+    n_props++;
+
+  state->specs = g_new0 (GParamSpec *, n_props);
+  state->defaults = g_new0 (GValue, n_props);
+  state->n_entries = n_props;
+  state->spec_for_entry = g_new (gint, n_props);
+
+  for (prop_list = class->property_list; prop_list && *prop_list; prop_list++)
+    {
+      GParamSpec *pspec = g_object_class_find_property (renderer_class, *prop_list);
+      guint entry = prop_list - class->property_list;
+
+      state->spec_for_entry[entry] = -1;
+      if (pspec == NULL ||
+          (pspec->flags & (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY)) != G_PARAM_READWRITE)
+        continue;
+
+      state->specs[state->n_specs] = pspec;
+      g_value_init (&state->defaults[state->n_specs], pspec->value_type);
+      g_object_get_property (G_OBJECT (renderer), pspec->name, &state->defaults[state->n_specs]);
+
+      state->spec_for_entry[entry] = state->n_specs++;
+    }
+
+  return state;
+}
+
+/* Called once values have been copied into the shared renderer for the cell. The ones that were
+ * copied become the cell's own values, and only the properties the copy didn't set are read
+ * back from the renderer */
+static void
+keep_transferred_values (GailRendererCell    *cell,
+                         SharedRendererState *state,
+                         const guint         *entries,
+                         GValue              *values,
+                         guint                n_entries)
+{
+  guint i;
+
+  if (cell->bound_values == NULL)
+    cell->bound_values = g_new0 (GValue, state->n_specs);
+
+  for (i = 0; i < state->n_specs; i++)
+    {
+      if (G_IS_VALUE (&cell->bound_values[i]))
+        g_value_unset (&cell->bound_values[i]);
+    }
+
+  for (i = 0; i < n_entries; i++)
+    {
+      gint spec = entries[i] < state->n_entries ? state->spec_for_entry[entries[i]] : -1;
+
+      /* Taken over, so the caller has nothing to unset */
+      if (spec >= 0 && G_IS_VALUE (&values[i]))
+        {
+          cell->bound_values[spec] = values[i];
+          memset (&values[i], 0, sizeof (GValue));
+        }
+    }
+
+  for (i = 0; i < state->n_specs; i++)
+    {
+      if (G_IS_VALUE (&cell->bound_values[i]))
+        continue;
+
+      g_value_init (&cell->bound_values[i], state->specs[i]->value_type);
+      g_object_get_property (G_OBJECT (cell->renderer), state->specs[i]->name, &cell->bound_values[i]);
+    }
+
+  state->bound = cell;
+}
+
+/* Puts the cell's values into the shared renderer, in property_list order */
+static void
+bind_bound_values (GailRendererCell    *cell,
+                   SharedRendererState *state)
+{
+  GObject *renderer = G_OBJECT (cell->renderer);
+  GValue *values = cell->bound_values ? cell->bound_values : state->defaults;
+  guint i;
+
+  g_object_freeze_notify (renderer);
+  for (i = 0; i < state->n_specs; i++)
+    g_object_set_property (renderer, state->specs[i]->name, &values[i]);
+  g_object_thaw_notify (renderer);
+
+  state->bound = cell;
+}
+
 gboolean
 gail_renderer_cell_update_cache (GailRendererCell *cell, 
                                  gboolean         emit_change_signal)
 {
   GailRendererCellClass *class = GAIL_RENDERER_CELL_GET_CLASS(cell);
+
   if (class->update_cache)
     return (class->update_cache)(cell, emit_change_signal);
   return FALSE;
 }
 
+/*
+ * The renderer is only somewhere to copy the column's values into, so every cell of the
+ * same class in a column can use the same one instead of having its own. Each cell keeps
+ * the values of its property_list when values are copied into it for the cell, and they
+ * are put back into the renderer before anything reads it for that cell.
+ */
+void
+gail_renderer_cell_share_renderer (GailRendererCell  *cell,
+                                   GtkTreeViewColumn *column)
+{
+  GailRendererCellClass *class = GAIL_RENDERER_CELL_GET_CLASS (cell);
+  GHashTable *shared;
+  GtkCellRenderer *renderer;
+  gpointer key;
+
+  if (!class->share_renderer || cell->renderer == NULL || column == NULL)
+    return;
+
+  shared = g_object_get_qdata (G_OBJECT (column), quark_shared_renderers);
+  if (shared == NULL)
+    {
+      shared = g_hash_table_new_full (NULL, NULL, NULL, g_object_unref);
+      g_object_set_qdata_full (G_OBJECT (column), quark_shared_renderers,
+                               shared, (GDestroyNotify) g_hash_table_destroy);
+    }
+
+  key = GSIZE_TO_POINTER (G_OBJECT_TYPE (cell));
+  renderer = g_hash_table_lookup (shared, key);
+  if (renderer == NULL)
+    {
+      /* The cell's renderer has just been made, so it has the defaults to compare with */
+      g_object_set_qdata_full (G_OBJECT (cell->renderer), quark_shared_state,
+                               shared_renderer_state_new (class, cell->renderer),
+                               (GDestroyNotify) shared_renderer_state_free);
+      g_hash_table_insert (shared, key, g_object_ref (cell->renderer));
+      return;
+    }
+
+  if (renderer != cell->renderer)
+    {
+      g_object_unref (cell->renderer);
+      cell->renderer = g_object_ref (renderer);
+    }
+}
+
+/* Use this rather than cell->renderer to read values from the renderer, or to copy new ones into it */
+GtkCellRenderer *
+gail_renderer_cell_get_renderer (GailRendererCell *cell)
+{
+  SharedRendererState *state;
+
+  if (cell->renderer == NULL)
+    return NULL;
+
+  state = g_object_get_qdata (G_OBJECT (cell->renderer), quark_shared_state);
+  if (state && state->bound != cell)
+    bind_bound_values (cell, state);
+
+  return cell->renderer;
+}
+
+GtkCellRenderer *
+gail_renderer_cell_begin_transfer (GailRendererCell *cell,
+                                   const guint      *entries,
+                                   guint             n_entries)
+{
+  SharedRendererState *state;
+  guint covered = 0;
+  guint i;
+
+  if (cell->renderer == NULL)
+    return NULL;
+
+  state = g_object_get_qdata (G_OBJECT (cell->renderer), quark_shared_state);
+  if (state == NULL || state->bound == cell)
+    return cell->renderer;
+
+  /* The entries are in property_list order, so each shared property is only counted once */
+  for (i = 0; i < n_entries; i++)
+    {
+      if (entries[i] < state->n_entries && state->spec_for_entry[entries[i]] >= 0)
+        covered++;
+    }
+
+  /* When the copy sets every shared property there is nothing of the cell's to put back first */
+  if (covered != state->n_specs)
+    bind_bound_values (cell, state);
+
+  return cell->renderer;
+}
+
+void
+gail_renderer_cell_end_transfer (GailRendererCell *cell,
+                                 const guint      *entries,
+                                 GValue           *values,
+                                 guint             n_entries)
+{
+  SharedRendererState *state;
+  guint i;
+
+  state = cell->renderer ? g_object_get_qdata (G_OBJECT (cell->renderer), quark_shared_state) : NULL;
+  if (state)
+    keep_transferred_values (cell, state, entries, values, n_entries);
+
+  for (i = 0; i < n_entries; i++)
+    {
+      if (G_IS_VALUE (&values[i]))
+        g_value_unset (&values[i]);
+    }
+}
+
+void
+gail_renderer_cell_bind_static_string (GailRendererCell *cell,
+                                       const gchar      *property,
+                                       const gchar      *string)
+{
+  SharedRendererState *state;
+  guint i;
+
+  if (cell->renderer == NULL || cell->bound_values == NULL)
+    return;
+
+  state = g_object_get_qdata (G_OBJECT (cell->renderer), quark_shared_state);
+  if (state == NULL)
+    return;
+
+  for (i = 0; i < state->n_specs; i++)
+    {
+      GValue *value = &cell->bound_values[i];
+
+      if (strcmp (state->specs[i]->name, property) != 0)
+        continue;
+
+      if (G_VALUE_HOLDS_STRING (value) &&
+          g_strcmp0 (g_value_get_string (value), string) == 0)
+        g_value_set_static_string (value, string);
+      return;
+    }
+}
+
 AtkObject*
 gail_renderer_cell_new (void)
 {
@@ -160,7 +160,7 @@ gail_scale_notify (GObject    *obj,
               if (txt)
                 {
 	          g_signal_emit_by_name (obj, "text_changed::delete", 0,
-                                         gtk_text_buffer_get_char_count (scale->textutil->buffer));
+                                         gail_text_util_get_char_count (scale->textutil));
                   gail_text_util_text_setup (scale->textutil, txt);
 	          g_signal_emit_by_name (obj, "text_changed::insert", 0,
                                          g_utf8_strlen (txt, -1));
@@ -314,10 +314,7 @@ gail_scale_get_character_count (AtkText *text)
     return 0;
 
   scale = GAIL_SCALE (text);
-  if (scale->textutil->buffer)
-    return gtk_text_buffer_get_char_count (scale->textutil->buffer);
-  else
-    return 0;
+  return gail_text_util_get_char_count (scale->textutil);
 
 }
 
@@ -135,9 +135,16 @@ gchar *gail_text_cell_property_list[] = {
 };
 #endif
 
-// TBH all we care about with Cocoa is the text property
+/*
+ * The renderer is shared with the other text cells in the column, so this has to be
+ * everything the cell's element reads from it, not just the text
+ */
 gchar *gail_text_cell_property_list[] = {
   "text",
+  "visible",
+  /* The rest of the values the cell element looks for */
+  "active",
+  "value",
   NULL
 };
 
@@ -154,6 +161,7 @@ gail_text_cell_class_init (GailTextCellClass *klass)
 
   renderer_cell_class->update_cache = gail_text_cell_update_cache;
   renderer_cell_class->property_list = gail_text_cell_property_list;
+  renderer_cell_class->share_renderer = TRUE;
 
   cell_class->initialize = gail_text_cell_initialize;
 
@@ -285,6 +293,9 @@ gail_text_cell_update_cache (GailRendererCell *cell,
 
   g_free (new_cache);
   gail_text_util_text_setup (text_cell->textutil, text_cell->cell_text);
+
+  /* The text the cell keeps for its shared renderer can be cell_text itself, rather than a third copy */
+  gail_renderer_cell_bind_static_string (cell, "text", text_cell->cell_text);
   
   id<NSAccessibility> realElement = (__bridge id<NSAccessibility>) gailcell->cell_element;
   [realElement setAccessibilityLabel:nsstring_from_cstring (text_cell->cell_text)];
@@ -422,20 +433,21 @@ gail_text_cell_get_run_attributes (AtkText *text,
   GtkWidget *widget;
 
   gail_renderer = GAIL_RENDERER_CELL (text);
-  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer->renderer);
+  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer_cell_get_renderer (gail_renderer));
 
   parent = atk_object_get_parent (ATK_OBJECT (text));
   if (GAIL_IS_CONTAINER_CELL (parent))
     parent = atk_object_get_parent (parent);
   g_return_val_if_fail (GAIL_IS_CELL_PARENT (parent), NULL);
   widget = GTK_ACCESSIBLE (parent)->widget;
+  /* The layout only lives for this lookup, so it isn't worth indexing */
   layout = create_pango_layout (gtk_renderer, widget);
-  attrib_set = gail_misc_layout_get_run_attributes (attrib_set, 
-                                                    layout,
-                                                    gtk_renderer->text,
-                                                    offset,
-                                                    start_offset,
-                                                    end_offset);
+  attrib_set = gail_misc_layout_get_run_attributes_unindexed (attrib_set, 
+                                                              layout,
+                                                              gtk_renderer->text,
+                                                              offset,
+                                                              start_offset,
+                                                              end_offset);
   g_object_unref (G_OBJECT (layout));
   
   return attrib_set;
@@ -452,7 +464,7 @@ gail_text_cell_get_default_attributes (AtkText	*text)
   GtkWidget *widget;
 
   gail_renderer = GAIL_RENDERER_CELL (text);
-  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer->renderer);
+  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer_cell_get_renderer (gail_renderer));
 
   parent = atk_object_get_parent (ATK_OBJECT (text));
   if (GAIL_IS_CONTAINER_CELL (parent))
@@ -584,7 +596,7 @@ gail_text_cell_get_character_extents (AtkText          *text,
       return;
     }
   gail_renderer = GAIL_RENDERER_CELL (text);
-  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer->renderer);
+  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer_cell_get_renderer (gail_renderer));
   /*
    * Thus would be inconsistent with the cache
    */
@@ -633,7 +645,7 @@ gail_text_cell_get_offset_at_point (AtkText          *text,
     return -1;
 
   gail_renderer = GAIL_RENDERER_CELL (text);
-  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer->renderer);
+  gtk_renderer = GTK_CELL_RENDERER_TEXT (gail_renderer_cell_get_renderer (gail_renderer));
   parent = atk_object_get_parent (ATK_OBJECT (text));
 
   g_return_val_if_fail (gtk_renderer->text, -1);
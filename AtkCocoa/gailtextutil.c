@@ -20,7 +20,9 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include "atk-cocoa/gailtextutil.h"
+#include "atk-cocoa/gailmisc.h"
 
 /**
  * SECTION:gailtextutil
@@ -43,6 +45,18 @@ static void gail_text_util_init            (GailTextUtil      *textutil);
 static void gail_text_util_finalize        (GObject           *object);
 
 
+static void clear_text                     (GailTextUtil      *textutil);
+static gboolean get_string_offsets         (GailTextUtil        *textutil,
+                                            gpointer            layout,
+                                            GailOffsetType      function,
+                                            AtkTextBoundary     boundary_type,
+                                            gint                offset,
+                                            gint                *start_offset,
+                                            gint                *end_offset);
+static gchar* get_string_substring         (GailTextUtil        *textutil,
+                                            gint                start_pos,
+                                            gint                end_pos);
+
 static void get_pango_text_offsets         (PangoLayout         *layout,
                                             GtkTextBuffer       *buffer,
                                             GailOffsetType      function,
@@ -97,6 +111,8 @@ static void
 gail_text_util_init (GailTextUtil *textutil)
 {
   textutil->buffer = NULL;
+  textutil->text = NULL;
+  textutil->offsets = NULL;
 }
 
 static void
@@ -116,16 +132,30 @@ gail_text_util_finalize (GObject *object)
 
   if (textutil->buffer)
     g_object_unref (textutil->buffer);
+  clear_text (textutil);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+static void
+clear_text (GailTextUtil *textutil)
+{
+  g_free (textutil->text);
+  textutil->text = NULL;
+  textutil->n_bytes = 0;
+  textutil->n_chars = 0;
+
+  ac_offset_index_free (textutil->offsets);
+  textutil->offsets = NULL;
+}
+
 /**
  * gail_text_util_text_setup:
  * @textutil: The #GailTextUtil to be initialized.
  * @text: A gchar* which points to the text to be stored in the GailTextUtil
  *
  * This function initializes the GailTextUtil with the specified character string,
+ * No #GtkTextBuffer is created until one is needed.
  **/
 void
 gail_text_util_text_setup (GailTextUtil *textutil,
@@ -133,21 +163,30 @@ gail_text_util_text_setup (GailTextUtil *textutil,
 {
   g_return_if_fail (GAIL_IS_TEXT_UTIL (textutil));
 
-  if (textutil->buffer)
+  if (!text)
     {
-      if (!text)
+      clear_text (textutil);
+      if (textutil->buffer)
         {
           g_object_unref (textutil->buffer);
           textutil->buffer = NULL;
-          return;
         }
+      return;
     }
-  else
-    {
-      textutil->buffer = gtk_text_buffer_new (NULL);
-    }
 
-  gtk_text_buffer_set_text (textutil->buffer, text, -1);
+  /* Cells set the same text every time they are updated */
+  if (textutil->text && strcmp (textutil->text, text) == 0)
+    return;
+
+  clear_text (textutil);
+  textutil->text = g_strdup (text);
+  textutil->n_bytes = (int)strlen (text);
+  textutil->n_chars = (int)g_utf8_strlen (text, textutil->n_bytes);
+  textutil->single_line = (strpbrk (text, "\n\r") == NULL &&
+                           strstr (text, "\xe2\x80\xa9") == NULL); /* U+2029 PARAGRAPH SEPARATOR */
+
+  if (textutil->buffer)
+    gtk_text_buffer_set_text (textutil->buffer, text, -1);
 }
 
 /**
@@ -163,9 +202,53 @@ gail_text_util_buffer_setup  (GailTextUtil  *textutil,
 {
   g_return_if_fail (GAIL_IS_TEXT_UTIL (textutil));
 
+  clear_text (textutil);
   textutil->buffer = g_object_ref (buffer);
 }
 
+/**
+ * gail_text_util_get_buffer:
+ * @textutil: A #GailTextUtil
+ *
+ * Gets the #GtkTextBuffer holding the text, creating it if the GailTextUtil
+ * was set up from a string.
+ *
+ * Returns: the buffer, or %NULL if there is no text
+ **/
+GtkTextBuffer*
+gail_text_util_get_buffer (GailTextUtil *textutil)
+{
+  g_return_val_if_fail (GAIL_IS_TEXT_UTIL (textutil), NULL);
+
+  if (textutil->buffer == NULL && textutil->text != NULL)
+    {
+      textutil->buffer = gtk_text_buffer_new (NULL);
+      gtk_text_buffer_set_text (textutil->buffer, textutil->text, textutil->n_bytes);
+    }
+
+  return textutil->buffer;
+}
+
+/**
+ * gail_text_util_get_char_count:
+ * @textutil: A #GailTextUtil
+ *
+ * Returns: the number of characters in the text
+ **/
+gint
+gail_text_util_get_char_count (GailTextUtil *textutil)
+{
+  g_return_val_if_fail (GAIL_IS_TEXT_UTIL (textutil), 0);
+
+  if (textutil->text)
+    return textutil->n_chars;
+
+  if (textutil->buffer)
+    return gtk_text_buffer_get_char_count (textutil->buffer);
+
+  return 0;
+}
+
 /**
  * gail_text_util_get_text:
  * @textutil: A #GailTextUtil
@@ -199,7 +282,12 @@ gail_text_util_get_text (GailTextUtil    *textutil,
 
   g_return_val_if_fail (GAIL_IS_TEXT_UTIL (textutil), NULL);
 
-  buffer = textutil->buffer;
+  if (textutil->text &&
+      get_string_offsets (textutil, layout, function, boundary_type, offset,
+                          start_offset, end_offset))
+    return get_string_substring (textutil, *start_offset, *end_offset);
+
+  buffer = gail_text_util_get_buffer (textutil);
   if (buffer == NULL)
     {
       *start_offset = 0;
@@ -649,6 +737,9 @@ gail_text_util_get_substring (GailTextUtil *textutil,
 
   g_return_val_if_fail(GAIL_IS_TEXT_UTIL (textutil), NULL);
 
+  if (textutil->text)
+    return get_string_substring (textutil, start_pos, end_pos);
+
   buffer = textutil->buffer;
   if (buffer == NULL)
      return NULL;
@@ -662,6 +753,150 @@ gail_text_util_get_substring (GailTextUtil *textutil,
   return gtk_text_buffer_get_text (buffer, &start, &end, FALSE);
 }
 
+/**
+ * gail_text_util_get_offset_index:
+ * @textutil: A #GailTextUtil
+ *
+ * Gets the index that translates between the byte, character and UTF-16
+ * offsets of the text, when the GailTextUtil was set up from a string.
+ *
+ * Returns: the index, or %NULL if there is no string
+ **/
+AcOffsetIndex*
+gail_text_util_get_offset_index (GailTextUtil *textutil)
+{
+  g_return_val_if_fail (GAIL_IS_TEXT_UTIL (textutil), NULL);
+
+  if (textutil->text == NULL)
+    return NULL;
+
+  if (textutil->offsets == NULL)
+    textutil->offsets = ac_offset_index_new (textutil->text, textutil->n_bytes);
+
+  return textutil->offsets;
+}
+
+/* ASCII strings don't need an index at all */
+static const gchar*
+string_offset_to_pointer (GailTextUtil *textutil,
+                          gint         offset)
+{
+  if (offset <= 0)
+    return textutil->text;
+  if (offset >= textutil->n_chars)
+    return textutil->text + textutil->n_bytes;
+  if (textutil->n_bytes == textutil->n_chars)
+    return textutil->text + offset;
+
+  return textutil->text + ac_offset_index_convert (gail_text_util_get_offset_index (textutil),
+                                                   offset, AC_OFFSET_CHARS, AC_OFFSET_BYTES);
+}
+
+/* Offsets are clamped the same way gtk_text_buffer_get_iter_at_offset() does */
+static gint
+string_clamp_offset (GailTextUtil *textutil,
+                     gint         offset)
+{
+  if (offset < 0 || offset > textutil->n_chars)
+    return textutil->n_chars;
+
+  return offset;
+}
+
+static gchar*
+get_string_substring (GailTextUtil *textutil,
+                      gint         start_pos,
+                      gint         end_pos)
+{
+  const gchar *start, *end;
+
+  start_pos = string_clamp_offset (textutil, start_pos);
+  end_pos = string_clamp_offset (textutil, end_pos);
+  if (start_pos > end_pos)
+    {
+      gint tmp = start_pos;
+      start_pos = end_pos;
+      end_pos = tmp;
+    }
+
+  start = string_offset_to_pointer (textutil, start_pos);
+  end = string_offset_to_pointer (textutil, end_pos);
+
+  return g_strndup (start, end - start);
+}
+
+/*
+ * Works out the boundaries that can be found without a GtkTextBuffer, giving
+ * the same results as the GtkTextIter code in gail_text_util_get_text().
+ * Returns FALSE if the buffer is needed.
+ */
+static gboolean
+get_string_offsets (GailTextUtil    *textutil,
+                    gpointer        layout,
+                    GailOffsetType  function,
+                    AtkTextBoundary boundary_type,
+                    gint            offset,
+                    gint            *start_offset,
+                    gint            *end_offset)
+{
+  gint n_chars = textutil->n_chars;
+
+  if (n_chars == 0)
+    {
+      *start_offset = 0;
+      *end_offset = 0;
+      return TRUE;
+    }
+
+  offset = string_clamp_offset (textutil, offset);
+
+  switch (boundary_type)
+    {
+    case ATK_TEXT_BOUNDARY_CHAR:
+      switch (function)
+        {
+        case GAIL_BEFORE_OFFSET:
+          *start_offset = MAX (offset - 1, 0);
+          *end_offset = offset;
+          break;
+        case GAIL_AT_OFFSET:
+          *start_offset = offset;
+          *end_offset = MIN (offset + 1, n_chars);
+          break;
+        case GAIL_AFTER_OFFSET:
+          *start_offset = MIN (offset + 1, n_chars);
+          *end_offset = MIN (offset + 2, n_chars);
+          break;
+        }
+      return TRUE;
+
+    case ATK_TEXT_BOUNDARY_LINE_START:
+    case ATK_TEXT_BOUNDARY_LINE_END:
+      /* Display lines and multiple lines need the layout or the buffer */
+      if (layout != NULL || !textutil->single_line)
+        return FALSE;
+
+      switch (function)
+        {
+        case GAIL_BEFORE_OFFSET:
+          *start_offset = *end_offset = 0;
+          break;
+        case GAIL_AT_OFFSET:
+          *start_offset = 0;
+          *end_offset = n_chars;
+          break;
+        case GAIL_AFTER_OFFSET:
+          *start_offset = *end_offset = n_chars;
+          break;
+        }
+      return TRUE;
+
+    default:
+      /* Words and sentences use the Pango break rules through GtkTextIter */
+      return FALSE;
+    }
+}
+
 static void
 get_pango_text_offsets (PangoLayout         *layout,
                         GtkTextBuffer       *buffer,
@@ -676,11 +911,11 @@ get_pango_text_offsets (PangoLayout         *layout,
   PangoLayoutIter *iter;
   PangoLayoutLine *line, *prev_line = NULL, *prev_prev_line = NULL;
   gint index, start_index, end_index;
-  const gchar *text;
+  AcOffsetIndex *offsets;
   gboolean found = FALSE;
 
-  text = pango_layout_get_text (layout);
-  index = (int)(g_utf8_offset_to_pointer (text, offset) - text);
+  offsets = gail_misc_layout_get_offset_index (layout);
+  index = ac_offset_index_convert (offsets, offset, AC_OFFSET_CHARS, AC_OFFSET_BYTES);
   iter = pango_layout_get_iter (layout);
   do
     {
@@ -778,8 +1013,8 @@ get_pango_text_offsets (PangoLayout         *layout,
       end_index = start_index;
     }
   pango_layout_iter_free (iter);
-  *start_offset = (int)g_utf8_pointer_to_offset (text, text + start_index);
-  *end_offset = (int)g_utf8_pointer_to_offset (text, text + end_index);
+  *start_offset = ac_offset_index_convert (offsets, start_index, AC_OFFSET_BYTES, AC_OFFSET_CHARS);
+  *end_offset = ac_offset_index_convert (offsets, end_index, AC_OFFSET_BYTES, AC_OFFSET_CHARS);
  
   gtk_text_buffer_get_iter_at_offset (buffer, start_iter, *start_offset);
   gtk_text_buffer_get_iter_at_offset (buffer, end_iter, *end_offset);
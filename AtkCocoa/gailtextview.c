@@ -28,6 +28,7 @@
 #include <gtk/gtk.h>
 #include "atk-cocoa/gailtextview.h"
 #include "atk-cocoa/gailmisc.h"
+#include "atk-cocoa/acdebug.h"
 
 #import "atk-cocoa/ACAccessibilityTextViewElement.h"
 
@@ -150,6 +151,28 @@ static void       _gail_text_view_insert_text_cb       (GtkTextBuffer    *buffer
                                                         gchar            *arg2,
                                                         gint             arg3,
                                                         gpointer         user_data);
+static void       _gail_text_view_text_inserted_cb     (GtkTextBuffer    *buffer,
+                                                        GtkTextIter      *arg1,
+                                                        gchar            *arg2,
+                                                        gint             arg3,
+                                                        gpointer         user_data);
+static void       _gail_text_view_insert_pixbuf_cb     (GtkTextBuffer    *buffer,
+                                                        GtkTextIter      *arg1,
+                                                        GdkPixbuf        *arg2,
+                                                        gpointer         user_data);
+static void       _gail_text_view_insert_child_anchor_cb (GtkTextBuffer    *buffer,
+                                                        GtkTextIter      *arg1,
+                                                        GtkTextChildAnchor *arg2,
+                                                        gpointer         user_data);
+static void       _gail_text_view_tag_applied_cb       (GtkTextBuffer    *buffer,
+                                                        GtkTextTag       *tag,
+                                                        GtkTextIter      *arg1,
+                                                        GtkTextIter      *arg2,
+                                                        gpointer         user_data);
+static void       _gail_text_view_tag_changed_cb       (GtkTextTagTable  *table,
+                                                        GtkTextTag       *tag,
+                                                        gboolean         size_changed,
+                                                        gpointer         user_data);
 static void       _gail_text_view_delete_range_cb      (GtkTextBuffer    *buffer,
                                                         GtkTextIter      *arg1,
                                                         GtkTextIter      *arg2,
@@ -215,6 +238,41 @@ gail_text_view_init (GailTextView      *text_view)
   text_view->previous_insert_offset = -1;
   text_view->previous_selection_bound = -1;
   text_view->insert_notify_handler = 0;
+  text_view->offsets = NULL;
+  text_view->snapshot = NULL;
+  text_view->value = NULL;
+  text_view->snapshot_is_partial = FALSE;
+}
+
+#define SNAPSHOT(view) ((__bridge NSMutableString *)(view)->snapshot)
+
+static void
+clear_value (GailTextView *view)
+{
+  if (view->value)
+    {
+      CFBridgingRelease (view->value);
+      view->value = NULL;
+    }
+}
+
+static void
+clear_snapshot (GailTextView *view)
+{
+  clear_value (view);
+  if (view->snapshot)
+    {
+      CFBridgingRelease (view->snapshot);
+      view->snapshot = NULL;
+    }
+}
+
+/* For when what is hidden may have changed, so the snapshot may match the buffer again */
+static void
+reset_snapshot (GailTextView *view)
+{
+  clear_snapshot (view);
+  view->snapshot_is_partial = FALSE;
 }
 
 static id<NSAccessibility>
@@ -239,10 +297,34 @@ setup_buffer (GtkTextView  *view,
   gail_view->textutil = gail_text_util_new ();
   gail_text_util_buffer_setup (gail_view->textutil, buffer);
 
+  ac_utf16_index_free (gail_view->offsets);
+  gail_view->offsets = NULL;
+  reset_snapshot (gail_view);
+
   /* Set up signal callbacks */
   g_signal_connect_object (buffer, "insert-text",
                            (GCallback) _gail_text_view_insert_text_cb,
                            view, 0);
+  /* After the default handler, so an insert another handler stops never reaches the index */
+  g_signal_connect_object (buffer, "insert-text",
+                           (GCallback) _gail_text_view_text_inserted_cb,
+                           view, G_CONNECT_AFTER);
+  g_signal_connect_object (buffer, "insert-pixbuf",
+                           (GCallback) _gail_text_view_insert_pixbuf_cb,
+                           view, 0);
+  g_signal_connect_object (buffer, "insert-child-anchor",
+                           (GCallback) _gail_text_view_insert_child_anchor_cb,
+                           view, 0);
+  /* Hiding or showing text changes the snapshot without an edit */
+  g_signal_connect_object (buffer, "apply-tag",
+                           (GCallback) _gail_text_view_tag_applied_cb,
+                           view, 0);
+  g_signal_connect_object (buffer, "remove-tag",
+                           (GCallback) _gail_text_view_tag_applied_cb,
+                           view, 0);
+  g_signal_connect_object (gtk_text_buffer_get_tag_table (buffer), "tag-changed",
+                           (GCallback) _gail_text_view_tag_changed_cb,
+                           view, 0);
   g_signal_connect_object (buffer, "delete-range",
                            (GCallback) _gail_text_view_delete_range_cb,
                            view, 0);
@@ -279,12 +361,127 @@ gail_text_view_finalize (GObject            *object)
   GailTextView *text_view = GAIL_TEXT_VIEW (object);
 
   g_object_unref (text_view->textutil);
+  ac_utf16_index_free (text_view->offsets);
+  clear_snapshot (text_view);
   if (text_view->insert_notify_handler)
     g_source_remove (text_view->insert_notify_handler);
 
   G_OBJECT_CLASS (gail_text_view_parent_class)->finalize (object);
 }
 
+/**
+ * gail_text_view_get_offset_index:
+ * @view: A #GailTextView
+ *
+ * Gets the index that translates between the character offsets of the
+ * view's buffer and the UTF-16 offsets Cocoa uses.
+ *
+ * Returns: the index, or %NULL if the view has no buffer
+ **/
+AcUtf16Index *
+gail_text_view_get_offset_index (GailTextView *view)
+{
+  GtkTextBuffer *buffer;
+  GtkTextIter start, end;
+  gchar *text;
+
+  if (view->textutil == NULL || (buffer = view->textutil->buffer) == NULL)
+    return NULL;
+
+  /* Every edit comes through the insert and delete-range handlers after this */
+  if (view->offsets)
+    return view->offsets;
+
+  /* The slice has a character for each pixbuf and child, so its offsets are the buffer's */
+  gtk_text_buffer_get_bounds (buffer, &start, &end);
+  text = gtk_text_buffer_get_slice (buffer, &start, &end, TRUE);
+  view->offsets = ac_utf16_index_new (text, -1);
+  g_free (text);
+
+  return view->offsets;
+}
+
+/**
+ * gail_text_view_get_snapshot:
+ * @view: A #GailTextView
+ *
+ * Gets the visible text of the view's buffer as an NSString, the same as
+ * gtk_text_buffer_get_text() gives without hidden characters. It is made
+ * the first time it's needed. While it is all of the buffer, the insert
+ * and delete-range handlers apply each edit to it, otherwise an edit drops
+ * it to be made again.
+ *
+ * Returns: the text, or %nil if the view has no buffer. It is the
+ *   snapshot itself, so it changes with the buffer
+ **/
+NSString *
+gail_text_view_get_snapshot (GailTextView *view)
+{
+  GtkTextIter start, end;
+  gchar *text;
+
+  /* The snapshot is patched through the index, so it is needed first */
+  if (gail_text_view_get_offset_index (view) == NULL)
+    return nil;
+
+  if (view->snapshot == NULL)
+    {
+      gtk_text_buffer_get_bounds (view->textutil->buffer, &start, &end);
+      text = gtk_text_buffer_get_text (view->textutil->buffer, &start, &end, FALSE);
+      view->snapshot = (void *)CFBridgingRetain ([[NSMutableString alloc] initWithUTF8String:text]);
+      g_free (text);
+
+      view->snapshot_is_partial = !gail_text_view_snapshot_matches_offsets (view);
+    }
+
+  return SNAPSHOT (view);
+}
+
+/**
+ * gail_text_view_get_value:
+ * @view: A #GailTextView
+ *
+ * Gets a copy of the snapshot that can be handed out. It is made when it
+ * is first asked for after an edit, so reading the value again before
+ * the next edit doesn't copy anything.
+ *
+ * Returns: the text, or %nil if the view has no buffer
+ **/
+NSString *
+gail_text_view_get_value (GailTextView *view)
+{
+  NSString *snapshot;
+
+  if (view->value == NULL)
+    {
+      snapshot = gail_text_view_get_snapshot (view);
+      if (snapshot == nil)
+        return nil;
+
+      view->value = (void *)CFBridgingRetain ([snapshot copy]);
+    }
+
+  return (__bridge NSString *)view->value;
+}
+
+/**
+ * gail_text_view_snapshot_matches_offsets:
+ * @view: A #GailTextView
+ *
+ * The snapshot leaves out hidden text, pixbufs and child anchors, which
+ * are in the buffer's offsets. This only ever makes it shorter, so when
+ * it is as long as the buffer nothing was left out and a UTF-16 range
+ * of the buffer is the same range of the snapshot.
+ *
+ * Returns: %TRUE if the snapshot has been made and is all of the buffer
+ **/
+gboolean
+gail_text_view_snapshot_matches_offsets (GailTextView *view)
+{
+  return view->snapshot && view->offsets &&
+    [SNAPSHOT (view) length] == (NSUInteger)ac_utf16_index_get_length (view->offsets, AC_OFFSET_UTF16);
+}
+
 static void
 gail_text_view_real_notify_gtk (GObject             *obj,
                                 GParamSpec          *pspec)
@@ -1375,6 +1572,34 @@ gail_text_view_paste_received (GtkClipboard *clipboard,
   g_object_unref (paste_struct->buffer);
 }
 
+/* Applies an insert to the offset index and the snapshot, if they have been made */
+static void
+offsets_insert (GailTextView *gail_text_view,
+                gint          position,
+                const gchar   *text,
+                gint          n_bytes)
+{
+  if (gail_text_view->offsets == NULL)
+    return;
+
+  clear_value (gail_text_view);
+  if (gail_text_view_snapshot_matches_offsets (gail_text_view))
+    {
+      NSString *inserted = [[NSString alloc] initWithBytes:text length:n_bytes encoding:NSUTF8StringEncoding];
+
+      if (inserted)
+        [SNAPSHOT (gail_text_view) insertString:inserted
+                                        atIndex:ac_utf16_index_convert (gail_text_view->offsets, position,
+                                                                        AC_OFFSET_CHARS, AC_OFFSET_UTF16)];
+      else
+        clear_snapshot (gail_text_view);
+    }
+  else
+    clear_snapshot (gail_text_view);
+
+  ac_utf16_index_insert (gail_text_view->offsets, position, text, n_bytes);
+}
+
 /* Callbacks */
 
 /* Note arg1 returns the start of the insert range, arg3 returns the
@@ -1389,6 +1614,8 @@ _gail_text_view_insert_text_cb (GtkTextBuffer *buffer,
                                 gint          arg3,
                                 gpointer      user_data)
 {
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "_gail_text_view_insert_text_cb", buffer);
+
   GtkTextView *text = (GtkTextView *) user_data;
   AtkObject *accessible;
   GailTextView *gail_text_view;
@@ -1403,7 +1630,7 @@ _gail_text_view_insert_text_cb (GtkTextBuffer *buffer,
   gail_text_view->signal_name = "text_changed::insert";
   position = gtk_text_iter_get_offset (arg1);
   length = (int)g_utf8_strlen(arg2, arg3);
-  
+
   if (gail_text_view->length == 0)
     {
       gail_text_view->position = position;
@@ -1436,6 +1663,101 @@ _gail_text_view_insert_text_cb (GtkTextBuffer *buffer,
   ac_element_notify(AC_ELEMENT (accessible), NSAccessibilitySelectedTextChangedNotification, nil);
 }
 
+static void
+_gail_text_view_text_inserted_cb (GtkTextBuffer *buffer,
+                                  GtkTextIter   *arg1,
+                                  gchar         *arg2,
+                                  gint          arg3,
+                                  gpointer      user_data)
+{
+  GtkTextView *text = (GtkTextView *) user_data;
+  GailTextView *gail_text_view;
+
+  gail_text_view = GAIL_TEXT_VIEW (gtk_widget_get_accessible (GTK_WIDGET (text)));
+  if (buffer != gail_text_view->textutil->buffer)
+    return;
+
+  /* arg1 has been moved to the end of the new text */
+  offsets_insert (gail_text_view, gtk_text_iter_get_offset (arg1) - (gint)g_utf8_strlen (arg2, arg3),
+                  arg2, arg3);
+}
+
+/* Pixbufs and child anchors take up a character of the buffer each, which is
+ * U+FFFC in a slice, but don't go through insert-text. They aren't in the
+ * snapshot, which stays as it is */
+#define OBJECT_REPLACEMENT_CHARACTER "\xef\xbf\xbc"
+
+static void
+_gail_text_view_insert_pixbuf_cb (GtkTextBuffer *buffer,
+                                  GtkTextIter   *arg1,
+                                  GdkPixbuf     *arg2,
+                                  gpointer      user_data)
+{
+  GtkTextView *text = (GtkTextView *) user_data;
+  GailTextView *gail_text_view;
+
+  gail_text_view = GAIL_TEXT_VIEW (gtk_widget_get_accessible (GTK_WIDGET (text)));
+  if (buffer != gail_text_view->textutil->buffer)
+    return;
+
+  gail_text_view->snapshot_is_partial = TRUE;
+  if (gail_text_view->offsets)
+    ac_utf16_index_insert (gail_text_view->offsets, gtk_text_iter_get_offset (arg1),
+                           OBJECT_REPLACEMENT_CHARACTER, strlen (OBJECT_REPLACEMENT_CHARACTER));
+}
+
+static void
+_gail_text_view_insert_child_anchor_cb (GtkTextBuffer      *buffer,
+                                        GtkTextIter        *arg1,
+                                        GtkTextChildAnchor *arg2,
+                                        gpointer           user_data)
+{
+  GtkTextView *text = (GtkTextView *) user_data;
+  GailTextView *gail_text_view;
+
+  gail_text_view = GAIL_TEXT_VIEW (gtk_widget_get_accessible (GTK_WIDGET (text)));
+  if (buffer != gail_text_view->textutil->buffer)
+    return;
+
+  gail_text_view->snapshot_is_partial = TRUE;
+  if (gail_text_view->offsets)
+    ac_utf16_index_insert (gail_text_view->offsets, gtk_text_iter_get_offset (arg1),
+                           OBJECT_REPLACEMENT_CHARACTER, strlen (OBJECT_REPLACEMENT_CHARACTER));
+}
+
+static void
+_gail_text_view_tag_applied_cb (GtkTextBuffer *buffer,
+                                GtkTextTag    *tag,
+                                GtkTextIter   *arg1,
+                                GtkTextIter   *arg2,
+                                gpointer      user_data)
+{
+  GtkTextView *text = (GtkTextView *) user_data;
+  GailTextView *gail_text_view;
+  gboolean invisible_set;
+
+  gail_text_view = GAIL_TEXT_VIEW (gtk_widget_get_accessible (GTK_WIDGET (text)));
+  if (gail_text_view->snapshot == NULL && !gail_text_view->snapshot_is_partial)
+    return;
+
+  g_object_get (tag, "invisible-set", &invisible_set, NULL);
+  if (invisible_set)
+    reset_snapshot (gail_text_view);
+}
+
+static void
+_gail_text_view_tag_changed_cb (GtkTextTagTable *table,
+                                GtkTextTag      *tag,
+                                gboolean        size_changed,
+                                gpointer        user_data)
+{
+  GtkTextView *text = (GtkTextView *) user_data;
+
+  /* A tag being hidden or shown counts as a size change */
+  if (size_changed)
+    reset_snapshot (GAIL_TEXT_VIEW (gtk_widget_get_accessible (GTK_WIDGET (text))));
+}
+
 /* Note arg1 returns the start of the delete range, arg2 returns the
  * end of the delete range if multiple characters are deleted.  If one
  * character is deleted they have the same value, which is the caret
@@ -1447,6 +1769,8 @@ _gail_text_view_delete_range_cb (GtkTextBuffer *buffer,
                                  GtkTextIter   *arg2,
                                  gpointer      user_data)
 {
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "_gail_text_view_delete_range_cb", buffer);
+
   GtkTextView *text = (GtkTextView *) user_data;
   AtkObject *accessible;
   GailTextView *gail_text_view;
@@ -1455,6 +1779,23 @@ _gail_text_view_delete_range_cb (GtkTextBuffer *buffer,
 
   accessible = gtk_widget_get_accessible(GTK_WIDGET(text));
   gail_text_view = GAIL_TEXT_VIEW (accessible);
+
+  if (gail_text_view->offsets && buffer == gail_text_view->textutil->buffer)
+    {
+      clear_value (gail_text_view);
+      if (gail_text_view_snapshot_matches_offsets (gail_text_view))
+        {
+          int start = ac_utf16_index_convert (gail_text_view->offsets, offset, AC_OFFSET_CHARS, AC_OFFSET_UTF16);
+          int end = ac_utf16_index_convert (gail_text_view->offsets, offset + length, AC_OFFSET_CHARS, AC_OFFSET_UTF16);
+
+          [SNAPSHOT (gail_text_view) deleteCharactersInRange:NSMakeRange (start, end - start)];
+        }
+      else
+        clear_snapshot (gail_text_view);
+
+      ac_utf16_index_delete (gail_text_view->offsets, offset, offset + length);
+    }
+
   if (gail_text_view->insert_notify_handler)
     {
       g_source_remove (gail_text_view->insert_notify_handler);
@@ -1552,6 +1893,8 @@ static void
 _gail_text_view_changed_cb (GtkTextBuffer *buffer,
                             gpointer      user_data)
 {
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "_gail_text_view_changed_cb", buffer);
+
   GtkTextView *text = (GtkTextView *) user_data;
   AtkObject *accessible;
   GailTextView *gail_text_view;
@@ -1652,6 +1995,8 @@ emit_text_caret_moved (GailTextView *gail_text_view,
 static gint
 insert_idle_handler (gpointer data)
 {
+  AC_PROFILE_SCOPE_FOR (WIDGETS, "insert_idle_handler", data);
+
   GailTextView *gail_text_view;
   GtkTextBuffer *buffer;
 
@@ -43,10 +43,18 @@
 #import "atk-cocoa/ACAccessibilityTreeCellElement.h"
 #import "atk-cocoa/ACAccessibilityTreeColumnElement.h"
 #import "atk-cocoa/ACAccessibilityTreeRowElement.h"
+#import "atk-cocoa/ACAccessibilityTreeRowArray.h"
+#import "atk-cocoa/ACAccessibilityTreeColumnCellArray.h"
 #import "atk-cocoa/ACAccessibilityCellElement.h"
 #import "atk-cocoa/NSAccessibilityElement+AtkCocoa.h"
 #import "atk-cocoa/NSArray+AtkCocoa.h"
 
+/* Set to build an element for every row up front instead of on first access */
+#define ATKCOCOA_EAGER_ROWS_ENV "ATKCOCOA_EAGER_ROWS"
+
+/* At most how often, in milliseconds, the cells of the rows that went out of view are recycled */
+#define RECYCLE_CELLS_DELAY 250
+
 typedef struct _GailTreeViewRowInfo    GailTreeViewRowInfo;
 
 static void             gail_tree_view_class_init       (GailTreeViewClass      *klass);
@@ -92,6 +100,8 @@ static void             column_visibility_changed       (GObject
                                                          GParamSpec             *param,
                                                          gpointer               user_data);
 static void             column_destroy                  (GtkObject              *obj); 
+static void             watch_column                    (GtkTreeView            *tree_view,
+                                                         GtkTreeViewColumn      *column);
 static void             model_row_inserted              (GtkTreeModel           *tree_model,
                                                          GtkTreePath            *path,
                                                          GtkTreeIter            *iter,
@@ -99,6 +109,10 @@ static void             model_row_inserted              (GtkTreeModel
 static void             model_row_deleted               (GtkTreeModel           *tree_model,
                                                          GtkTreePath            *path,
                                                          gpointer               user_data);
+static void             model_row_has_child_toggled     (GtkTreeModel           *tree_model,
+                                                         GtkTreePath            *path,
+                                                         GtkTreeIter            *iter,
+                                                         gpointer               user_data);
 static void             destroy_count_func              (GtkTreeView            *tree_view,
                                                          GtkTreePath            *path,
                                                          gint                   count,
@@ -132,10 +146,8 @@ static ACAccessibilityTreeRowElement *find_row_element_for_path (GailTreeView *g
                                                                  GtkTreePath *path);
 static ACAccessibilityTreeColumnElement *find_column_element_for_column (GailTreeView *gailView,
                                                                          GtkTreeViewColumn *column);
-static NSAccessibilityElement *make_accessibility_element_for_row (GtkTreeModel *treeModel,
-                                                                   GtkTreeView *treeView,
-                                                                   GailTreeView *gailView,
-                                                                   GtkTreeIter  *rowIter);
+static NSAccessibilityElement *make_accessibility_element_for_row (GtkTreeView *treeView,
+                                                                   GailTreeView *gailView);
 static void sort_child_elements (GailTreeView *gailView);
 static NSInteger row_column_index_sort (id objA,
                                         id objB,
@@ -146,6 +158,25 @@ static void remove_all_children (GailTreeView *gailview,
                                  ACAccessibilityTreeRowElement *parentElement);
 static void update_columns (GailTreeView *gailview,
                             GtkTreeView *tree_view);
+static void invalidate_selected_rows (GailTreeView *gailview);
+static void selection_rows_inserted (GailTreeView *gailview,
+                                     int idx,
+                                     int count);
+static void selection_rows_removed (GailTreeView *gailview,
+                                    int idx,
+                                    int count);
+static const AcRowOpsFuncs row_ops_funcs;
+static void flush_pending_row_ops (GailTreeView *gailview);
+static void resolve_rows (GailTreeView *gailview);
+static void recycle_cells (GailTreeView *gailview,
+                           gboolean offscreen_only);
+static void schedule_recycle_cells (GailTreeView *gailview);
+static void cancel_recycle_cells (GailTreeView *gailview);
+static void set_visible_rows (GailTreeView *gailview,
+                              NSArray *rows,
+                              NSArray *elements);
+static void invalidate_visible_rows (GailTreeView *gailview,
+                                     gboolean rows_moved);
 
 static id<NSAccessibility> get_real_accessibility_element (AcElement *element);
 
@@ -199,7 +230,7 @@ gail_tree_view_class_init (GailTreeViewClass *klass)
 static void
 gail_tree_view_init (GailTreeView *view)
 {
-  view->treeIsDirty = TRUE;
+  view->lazyRows = (g_getenv (ATKCOCOA_EAGER_ROWS_ENV) == NULL);
 }
 
 static id<NSAccessibility>
@@ -215,58 +246,70 @@ print_refcount (id obj)
 }
 
 #define ROOT_NODE(view) ((__bridge ACAccessibilityTreeRowElement *)(view)->rowRootNode)
-#define ROW_CACHE(view) ((__bridge NSArray *)(view)->rowCache)
+#define CELL_ROWS(view) ((__bridge NSHashTable *)(view)->cellRows)
+#define VISIBLE_ROWS(view) ((__bridge NSArray *)(view)->visibleRows)
+#define VISIBLE_ROW_ELEMENTS(view) ((__bridge NSArray *)(view)->visibleRowElements)
+#define SELECTED_INDEXES(view) ((__bridge NSMutableIndexSet *)(view)->selectedIndexes)
+#define UNRESOLVED_ROWS(view) ((__bridge NSHashTable *)(view)->unresolvedRows)
 
+/* Finds the row that is the parent of path, and the index of path inside it. */
 static ACAccessibilityTreeRowElement *
-add_row_to_row_map_with_path (GailTreeView *view,
-                              GtkTreePath *path,
-                              ACAccessibilityTreeRowElement *row_element)
+get_parent_from_row_map (GailTreeView *view,
+                         GtkTreePath *path,
+                         int *idx)
 {
   ACAccessibilityTreeRowElement *parent;
+  int depth = gtk_tree_path_get_depth (path);
+  int *indices = gtk_tree_path_get_indices (path);
 
-  char *pathString = gtk_tree_path_to_string (path);
-  char *parentPathString;
-  int idx;
+  if (depth < 1) {
+    return nil;
+  }
 
-  if (gtk_tree_path_get_depth (path) > 1) {
-    gtk_tree_path_up (path);
-    parentPathString = gtk_tree_path_to_string (path);
+  parent = [ROOT_NODE (view) childAtIndices:indices depth:depth - 1 materialize:YES];
+  if (parent == nil) {
+    char *pathString = gtk_tree_path_to_string (path);
+    g_warning ("No parent found for %s", pathString);
+    g_free (pathString);
 
-    parent = [ROOT_NODE (view) childAtPath:parentPathString];
+    return nil;
+  }
 
-    if (parent == nil) {
-      g_warning ("No parent found at %s for %s", parentPathString, pathString);
-      g_free (parentPathString);
-      return NULL;
-    }
+  *idx = indices[depth - 1];
+  return parent;
+}
 
-    g_free (parentPathString);
-  } else {
-    parent = ROOT_NODE (view);
-  }
+static ACAccessibilityTreeRowElement *
+add_row_to_row_map_with_path (GailTreeView *view,
+                              GtkTreePath *path,
+                              ACAccessibilityTreeRowElement *row_element)
+{
+  ACAccessibilityTreeRowElement *parent;
+  int idx;
 
-  idx = last_path_index (pathString);
-  g_free (pathString);
+  parent = get_parent_from_row_map (view, path, &idx);
+  if (parent == nil) {
+    return NULL;
+  }
 
   [parent insertChild:row_element atIndex:idx];
-  view->treeIsDirty = TRUE;
 
   return parent;
 }
 
 static ACAccessibilityTreeRowElement *
-add_row_to_row_map (GailTreeView *view,
-                    ACAccessibilityTreeRowElement *row_element)
+add_placeholder_to_row_map (GailTreeView *view,
+                            GtkTreePath *path)
 {
   ACAccessibilityTreeRowElement *parent;
-  GtkTreePath *path = [row_element rowPath];
+  int idx;
 
-  if (path == NULL) {
-    return nil;
+  parent = get_parent_from_row_map (view, path, &idx);
+  if (parent == nil) {
+    return NULL;
   }
 
-  parent = add_row_to_row_map_with_path(view, path, row_element);
-  gtk_tree_path_free(path);
+  [parent insertPlaceholderChildrenAtIndex:idx count:1];
 
   return parent;
 }
@@ -275,13 +318,28 @@ static ACAccessibilityTreeRowElement *
 get_row_from_row_map (GailTreeView *view,
                       GtkTreePath *path)
 {
-  ACAccessibilityTreeRowElement *row;
-  char *pathString = gtk_tree_path_to_string (path);
+  int depth = gtk_tree_path_get_depth (path);
 
-  row = [ROOT_NODE (view) childAtPath:pathString];
+  if (depth < 1) {
+    return nil;
+  }
 
-  g_free (pathString);
-  return row;
+  return [ROOT_NODE (view) childAtIndices:gtk_tree_path_get_indices (path) depth:depth materialize:YES];
+}
+
+/* Like get_row_from_row_map, but returns nil for rows that are still placeholders
+ * instead of creating their element */
+static ACAccessibilityTreeRowElement *
+get_existing_row_from_row_map (GailTreeView *view,
+                               GtkTreePath *path)
+{
+  int depth = gtk_tree_path_get_depth (path);
+
+  if (depth < 1) {
+    return nil;
+  }
+
+  return [ROOT_NODE (view) childAtIndices:gtk_tree_path_get_indices (path) depth:depth materialize:NO];
 }
 
 static void
@@ -289,7 +347,14 @@ remove_row_from_row_map (GailTreeView *view,
                          ACAccessibilityTreeRowElement *row)
 {
   [row removeFromParent];
-  view->treeIsDirty = TRUE;
+}
+
+static int
+flattened_index_of_path (GailTreeView *view,
+                         GtkTreePath *path)
+{
+  return [ROOT_NODE (view) flattenedIndexOfIndices:gtk_tree_path_get_indices (path)
+                                             depth:gtk_tree_path_get_depth (path)];
 }
 
 static void
@@ -314,6 +379,8 @@ gail_tree_view_real_initialize (AtkObject *obj,
   widget = GTK_WIDGET (data);
   tree_view = GTK_TREE_VIEW (widget);
 
+  view->rowOps = ac_row_ops_new (tree_view, &row_ops_funcs, view);
+
   g_signal_connect_after (widget,
                           "row-collapsed",
                           G_CALLBACK (gail_tree_view_collapse_row_gtk),
@@ -381,12 +448,7 @@ gail_tree_view_real_initialize (AtkObject *obj,
 
   for (tmp_list = tv_cols; tmp_list; tmp_list = tmp_list->next)
     {
-      g_signal_connect_data (tmp_list->data, "notify::visible",
-       (GCallback)column_visibility_changed, 
-        tree_view, NULL, FALSE);
-      g_signal_connect_data (tmp_list->data, "destroy",
-       (GCallback)column_destroy, 
-        NULL, NULL, FALSE);
+      watch_column (tree_view, tmp_list->data);
     }
 
   g_list_free (tv_cols);
@@ -395,14 +457,38 @@ gail_tree_view_real_initialize (AtkObject *obj,
 static void
 destroy_root(GailTreeView *gailview)
 {
+  // Anything still queued refers to the rows that are about to go
+  if (gailview->rowOps) {
+    ac_row_ops_discard (gailview->rowOps);
+  }
+
   if (gailview->rowRootNode) {
+    // The root might outlive us inside an ACAccessibilityTreeRowArray, so don't leave it calling back
+    [ROOT_NODE(gailview) setRowFactory:nil];
+
     // If we don't remove all the children, rowRootNode will be dealloc'd twice and crash
     remove_all_children(gailview, ac_element_get_accessibility_element(AC_ELEMENT (gailview)), ROOT_NODE(gailview));
     CFBridgingRelease(gailview->rowRootNode);
     gailview->rowRootNode = NULL;
+  }
+
+  cancel_recycle_cells (gailview);
+  if (gailview->cellRows) {
+    CFBridgingRelease (gailview->cellRows);
+    gailview->cellRows = NULL;
+  }
+
+  set_visible_rows (gailview, nil, nil);
+
+  if (gailview->unresolvedRows) {
+    CFBridgingRelease (gailview->unresolvedRows);
+    gailview->unresolvedRows = NULL;
+  }
 
-    CFBridgingRelease (gailview->rowCache);
-    gailview->rowCache = NULL;
+  invalidate_selected_rows (gailview);
+  if (gailview->selectedIndexes) {
+    CFBridgingRelease (gailview->selectedIndexes);
+    gailview->selectedIndexes = NULL;
   }
 }
 
@@ -410,6 +496,8 @@ static void
 gail_tree_view_real_notify_gtk (GObject             *obj,
                                 GParamSpec          *pspec)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "gail_tree_view_real_notify_gtk", obj);
+
   GtkWidget *widget;
   AtkObject* atk_obj;
   GtkTreeView *tree_view;
@@ -426,12 +514,6 @@ gail_tree_view_real_notify_gtk (GObject             *obj,
       GtkTreeModel *tree_model;
       AtkRole role;
 
-      // Cancel any rows being updated
-      if (gailview->rowUpdateId > 0) {
-        g_source_remove (gailview->rowUpdateId);
-        gailview->rowUpdateId = 0;
-      }
-
       tree_model = gtk_tree_view_get_model (tree_view);
       if (gailview->tree_model)
         {
@@ -528,6 +610,9 @@ gail_tree_view_finalize (GObject	    *object)
     }
 
   cleanup_caches(view);
+  ac_row_ops_free (view->rowOps);
+  if (view->transferPlans)
+    g_hash_table_destroy (view->transferPlans);
   G_OBJECT_CLASS (gail_tree_view_parent_class)->finalize (object);
 }
 
@@ -555,11 +640,6 @@ gail_tree_view_destroyed (GtkWidget *widget,
 
   gailview = GAIL_TREE_VIEW (accessible);
 
-  if (gailview->rowUpdateId > 0) {
-    g_source_remove (gailview->rowUpdateId);
-    gailview->rowUpdateId = 0;
-  }
-
   adj = gailview->old_hadj;
   if (adj)
     g_signal_handlers_disconnect_by_func (adj, 
@@ -608,6 +688,7 @@ gail_tree_view_ref_state_set (AtkObject *obj)
 static void
 add_row_to_tree (GailTreeView *gailView,
                  ACAccessibilityTreeRowElement *child,
+                 GtkTreePath *path,
                  BOOL isDisclosed)
 {
   ACAccessibilityElement *treeElement;
@@ -618,7 +699,8 @@ add_row_to_tree (GailTreeView *gailView,
   }
 
   treeElement = (ACAccessibilityElement *)ac_element_get_accessibility_element(AC_ELEMENT(gailView));
-  parentRowElement = add_row_to_row_map (gailView, child);
+  // The row has no path of its own until it is in the row tree
+  parentRowElement = add_row_to_row_map_with_path (gailView, path, child);
 
   if (isDisclosed) {
     [parentRowElement addChildRowElement:child];
@@ -627,26 +709,45 @@ add_row_to_tree (GailTreeView *gailView,
   [child setAccessibilityTopLevelUIElement:[treeElement accessibilityWindow]];
 }
 
+/* Builds the elements for the children of parent starting at iter and adds them as one run,
+ * rather than walking the row tree for each of them */
 static void
-remove_row_from_tree (GailTreeView *gailView,
-                      ACAccessibilityTreeRowElement *child)
+add_children_to_tree (GailTreeView *gailView,
+                      GtkTreeView *treeView,
+                      ACAccessibilityTreeRowElement *parent,
+                      GtkTreeIter *iter)
 {
-  ACAccessibilityElement *treeElement = (ACAccessibilityElement *)ac_element_get_accessibility_element(AC_ELEMENT(gailView));
+  ACAccessibilityElement *treeElement;
+  NSMutableArray *children;
+  id window;
 
-  NSArray *selectedRows = [treeElement accessibilitySelectedRows];
-  if ([selectedRows containsObject:child]) {
-    [treeElement setAccessibilitySelectedRows:[selectedRows ac_removeObject:child]];
+  if (gailView->rowRootNode == NULL) {
+    return;
   }
 
-  [[child parent] removeChildRowElement:child];
+  treeElement = (ACAccessibilityElement *)ac_element_get_accessibility_element(AC_ELEMENT(gailView));
+  window = [treeElement accessibilityWindow];
 
-  remove_row_from_row_map(gailView, child);
+  children = [NSMutableArray array];
+  do {
+    ACAccessibilityTreeRowElement *child = (ACAccessibilityTreeRowElement *)make_accessibility_element_for_row (treeView, gailView);
+
+    [child setAccessibilityWindow:window];
+    [child setAccessibilityTopLevelUIElement:window];
+    [child setHasChildRows:gtk_tree_model_iter_has_child (gailView->tree_model, iter)];
+    [children addObject:child];
+  } while (gtk_tree_model_iter_next (gailView->tree_model, iter));
+
+  [parent insertChildren:children atIndex:0];
+}
 
-  // instead of walking the whole tree by calling update_accessibility_rows
-  // we can just remove them by hand
-  NSArray *rows = [treeElement accessibilityRows];
-  [treeElement setAccessibilityRows:[rows ac_removeObject:child]];
-  [treeElement setAccessibilityVisibleRows:[treeElement accessibilityRows]];
+static void
+remove_row_from_tree (GailTreeView *gailView,
+                      ACAccessibilityTreeRowElement *child)
+{
+  [child recycleChildCells];
+  [[child parent] removeChildRowElement:child];
+  remove_row_from_row_map(gailView, child);
 }
 
 static gboolean
@@ -654,6 +755,8 @@ gail_tree_view_expand_row_gtk (GtkTreeView       *tree_view,
                                GtkTreeIter        *iter,
                                GtkTreePath        *path)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "gail_tree_view_expand_row_gtk", tree_view);
+
   AtkObject *atk_obj;
   GailTreeView *gailview;
   GtkTreeModel *tree_model;
@@ -671,6 +774,9 @@ gail_tree_view_expand_row_gtk (GtkTreeView       *tree_view,
   if (gailview->rowRootNode == NULL) {
     return FALSE;
   }
+
+  // The children are added for the model as it is now, so catch up with it first
+  flush_pending_row_ops (gailview);
   
   tree_model = gtk_tree_view_get_model (tree_view);
   treeElement = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
@@ -685,12 +791,22 @@ gail_tree_view_expand_row_gtk (GtkTreeView       *tree_view,
     GtkTreeIter childIter;
     if (gtk_tree_model_iter_children (tree_model, &childIter, iter)) {
       NSMutableArray *disclosedRows = [[NSMutableArray alloc] init];
+      int oldCount = [expandedElement descendantCount], expandedIndex;
 
       // FIXME: I think the disclosedRows need to have the whole subtree flattened, not just the direct children
-      do {
-        NSAccessibilityElement *element = make_accessibility_element_for_row (tree_model, tree_view, gailview, &childIter);
-        add_row_to_tree(gailview, (ACAccessibilityTreeRowElement *)element, YES);
-      } while (gtk_tree_model_iter_next (tree_model, &childIter));
+      if (gailview->lazyRows) {
+        // The children are collapsed, so they can all be placeholders until they're requested
+        int n_children = gtk_tree_model_iter_n_children (tree_model, iter);
+        [expandedElement insertPlaceholderChildrenAtIndex:0 count:n_children];
+      } else {
+        add_children_to_tree (gailview, tree_view, expandedElement, &childIter);
+      }
+
+      // The new rows go after the expanded row, and none of them are selected yet
+      expandedIndex = flattened_index_of_path (gailview, path);
+      if (expandedIndex >= 0) {
+        selection_rows_inserted (gailview, expandedIndex + 1, [expandedElement descendantCount] - oldCount);
+      }
 
       // Now the indices have been updated, sort the disclosed rows
 //      [disclosedRows sortUsingFunction:row_column_index_sort context:NULL];
@@ -698,7 +814,7 @@ gail_tree_view_expand_row_gtk (GtkTreeView       *tree_view,
     }
   }
 
-  gailview->treeIsDirty = TRUE;
+  invalidate_visible_rows (gailview, TRUE);
   NSAccessibilityPostNotification(expandedElement, NSAccessibilityRowExpandedNotification);
   return FALSE;
 }
@@ -708,25 +824,9 @@ remove_all_children (GailTreeView *gailview,
                      NSAccessibilityElement *treeElement,
                      ACAccessibilityTreeRowElement *parentElement)
 {
-  // Cancel any pending update until after we've removed these rows
-  if (gailview->rowUpdateId > 0) {
-    g_source_remove (gailview->rowUpdateId);
-    gailview->rowUpdateId = 0;
-  }
-
-  // FIXME: Can this work by just removing the highest element and then all its children will be automatically removed?
-  NSMutableArray *childrenToRemove = [NSMutableArray array];
-  [parentElement foreachChild:^void (ACAccessibilityTreeRowElement *parent, ACAccessibilityTreeRowElement *child, void *userdata) {
-    remove_all_children ((GailTreeView *)userdata, treeElement, child);
-
-    [childrenToRemove addObject:child];
-  } userData:gailview];
-
-  // Gather all the rows that need removed so we can remove them outside of the foreachChild loop
-  for (ACAccessibilityTreeRowElement *c in childrenToRemove) {
-    remove_row_from_tree(gailview, c);
-  }
+  [parentElement recycleDescendantCells];
 
+  // The whole subtree is detached at once, the rows below the children go with them
   [parentElement removeAllChildren];
 }
 
@@ -735,10 +835,12 @@ gail_tree_view_collapse_row_gtk (GtkTreeView       *tree_view,
                                  GtkTreeIter        *iter,
                                  GtkTreePath        *path)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "gail_tree_view_collapse_row_gtk", tree_view);
+
   GtkTreeModel *tree_model;
   AtkObject *atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
   GailTreeView *gailview = GAIL_TREE_VIEW (atk_obj);
-  gint row;
+  gint row, collapsedIndex;
 
   AC_NOTE (TREEWIDGET, g_print ("Collapsing row: %s\n", gtk_tree_path_to_string (path)));
   NSAccessibilityElement *treeElement;
@@ -746,9 +848,16 @@ gail_tree_view_collapse_row_gtk (GtkTreeView       *tree_view,
 
   tree_model = gtk_tree_view_get_model (tree_view);
 
+  flush_pending_row_ops (gailview);
+
   treeElement = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
   collapsedElement = find_row_element_for_path (gailview, path);
+  collapsedIndex = flattened_index_of_path (gailview, path);
+  if (collapsedElement != nil && collapsedIndex >= 0) {
+    selection_rows_removed (gailview, collapsedIndex + 1, [collapsedElement descendantCount]);
+  }
   remove_all_children (gailview, treeElement, collapsedElement);
+  invalidate_visible_rows (gailview, TRUE);
 
   NSAccessibilityPostNotification(collapsedElement, NSAccessibilityRowCollapsedNotification);
 
@@ -759,6 +868,13 @@ static void
 gail_tree_view_size_allocate_gtk (GtkWidget     *widget,
                                   GtkAllocation *allocation)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "gail_tree_view_size_allocate_gtk", widget);
+
+  AtkObject *atk_obj = gtk_widget_get_accessible (widget);
+
+  // Rows may have gone out of view if the tree got smaller
+  invalidate_visible_rows (GAIL_TREE_VIEW (atk_obj), FALSE);
+  schedule_recycle_cells (GAIL_TREE_VIEW (atk_obj));
 }
 
 static void
@@ -802,32 +918,255 @@ static void
 gail_tree_view_changed_gtk (GtkTreeSelection *selection,
                             gpointer         data)
 {
-  NSAccessibilityElement *element;
-  GtkTreeModel *selectionModel;
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "gail_tree_view_changed_gtk", selection);
+
   GailTreeView *gailview = GAIL_TREE_VIEW(data);
 
   if (gailview->rowRootNode == NULL) {
     return;
   }
 
-  element = ac_element_get_accessibility_element(AC_ELEMENT (data));
+  // Selecting a range emits a signal per row, so only work out the new selection once they're done
+  ac_row_ops_selection_changed (gailview->rowOps);
+}
+
+/* The selection is mirrored as a set of ranges of flattened row indices. GTK keeps the selection
+ * with the rows as they move and new rows start out unselected, so as row changes are applied
+ * the set is shifted and trimmed to match. Only a selection change means reading it back from the
+ * GtkTreeSelection, which is left until a client next asks for the selected rows.
+ * The array handed out only looks the rows up as they are accessed. */
+static void
+drop_selected_rows_array (GailTreeView *gailview)
+{
+  if (gailview->selectedRows) {
+    CFBridgingRelease (gailview->selectedRows);
+    gailview->selectedRows = NULL;
+  }
+}
+
+static void
+invalidate_selected_rows (GailTreeView *gailview)
+{
+  gailview->selectionDirty = TRUE;
+  drop_selected_rows_array (gailview);
+}
+
+/* Whether a change to the rows from idx onwards moves any selected row */
+static gboolean
+selection_is_moved_from (GailTreeView *gailview,
+                         int idx)
+{
+  NSUInteger last;
+
+  // A set that is going to be read back again doesn't need kept up to date
+  if (gailview->selectionDirty || gailview->selectedIndexes == NULL || idx < 0) {
+    return FALSE;
+  }
+
+  last = [SELECTED_INDEXES (gailview) lastIndex];
+  return last != NSNotFound && last >= (NSUInteger)idx;
+}
+
+/* Called once count rows have been added at the flattened index idx */
+static void
+selection_rows_inserted (GailTreeView *gailview,
+                         int idx,
+                         int count)
+{
+  if (count <= 0 || !selection_is_moved_from (gailview, idx)) {
+    return;
+  }
+
+  [SELECTED_INDEXES (gailview) shiftIndexesStartingAtIndex:idx by:count];
+  drop_selected_rows_array (gailview);
+}
+
+/* Called when the count rows at the flattened index idx are removed */
+static void
+selection_rows_removed (GailTreeView *gailview,
+                        int idx,
+                        int count)
+{
+  if (count <= 0 || !selection_is_moved_from (gailview, idx)) {
+    return;
+  }
+
+  [SELECTED_INDEXES (gailview) removeIndexesInRange:NSMakeRange (idx, count)];
+  [SELECTED_INDEXES (gailview) shiftIndexesStartingAtIndex:idx + count by:-count];
+  drop_selected_rows_array (gailview);
+}
+
+/* Whether any of the count rows at the flattened index idx are selected */
+static gboolean
+selection_has_rows_in (GailTreeView *gailview,
+                       int idx,
+                       int count)
+{
+  return count > 0 && selection_is_moved_from (gailview, idx) &&
+    [SELECTED_INDEXES (gailview) countOfIndexesInRange:NSMakeRange (idx, count)] > 0;
+}
+
+/* Called once the children of parent, whose first child is at the flattened index start, have
+ * been reordered. old_offsets are the children's offsets from start before the reorder.
+ * The selected rows below parent move with the subtrees they are in */
+static void
+selection_rows_reordered (GailTreeView *gailview,
+                          ACAccessibilityTreeRowElement *parent,
+                          int start,
+                          const int *old_offsets,
+                          const int *new_order)
+{
+  NSMutableIndexSet *selected = SELECTED_INDEXES (gailview);
+  NSMutableIndexSet *moved;
+  NSRange range;
+  int n_children, *new_position, i;
+
+  range = NSMakeRange (start, [parent descendantCount]);
+  n_children = [parent childCount];
+  new_position = g_new (int, n_children);
+  for (i = 0; i < n_children; i++) {
+    new_position[new_order[i]] = i;
+  }
+
+  moved = [NSMutableIndexSet indexSet];
+  [selected enumerateIndexesInRange:range options:0 usingBlock:^(NSUInteger idx, BOOL *stop) {
+    int offset = (int)(idx - start);
+    int low = 0, high = n_children;
+
+    // The last child that starts at or before offset
+    while (high - low > 1) {
+      int mid = low + (high - low) / 2;
+
+      if (old_offsets[mid] <= offset) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+
+    [moved addIndex:start + [parent flattenedOffsetOfChildAtIndex:new_position[low]] + (offset - old_offsets[low])];
+  }];
+
+  [selected removeIndexesInRange:range];
+  [selected addIndexes:moved];
+  drop_selected_rows_array (gailview);
+
+  g_free (new_position);
+}
+
+static void
+add_selected_row_index (GtkTreeModel *model,
+                        GtkTreePath *path,
+                        GtkTreeIter *iter,
+                        gpointer data)
+{
+  GailTreeView *gailview = data;
+  int idx;
+
+  idx = flattened_index_of_path (gailview, path);
+  if (idx >= 0) {
+    // The rows come in order, so this extends the last range
+    [SELECTED_INDEXES (gailview) addIndex:idx];
+  }
+}
+
+static void
+refresh_selected_rows (GailTreeView *gailview)
+{
+  GtkTreeSelection *selection;
+  GtkWidget *widget;
+
+  if (!gailview->selectionDirty) {
+    return;
+  }
+
+  widget = GTK_ACCESSIBLE (gailview)->widget;
+  if (gailview->rowRootNode == NULL || widget == NULL) {
+    return;
+  }
+
+  if (gailview->selectedIndexes == NULL) {
+    gailview->selectedIndexes = (void *)CFBridgingRetain ([NSMutableIndexSet indexSet]);
+  }
+  [SELECTED_INDEXES (gailview) removeAllIndexes];
+
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (widget));
+  if (gtk_tree_selection_get_mode (selection) != GTK_SELECTION_MULTIPLE) {
+    GtkTreeModel *model;
+    GtkTreeIter iter;
 
-  NSMutableArray *newSelectedChildren = [NSMutableArray array];
-  GList *selected = gtk_tree_selection_get_selected_rows(selection, &selectionModel);
-  for (GList *l = selected; l; l = l->next) {
-    GtkTreePath *p = l->data;
-    ACAccessibilityTreeRowElement *row = get_row_from_row_map(GAIL_TREE_VIEW(data), p);
+    // There's at most one selected row, which GTK can give us without walking every row
+    if (gtk_tree_selection_get_selected (selection, &model, &iter)) {
+      GtkTreePath *path = gtk_tree_model_get_path (model, &iter);
 
-    if (row != nil) {
-      [newSelectedChildren addObject:row];
+      add_selected_row_index (model, path, &iter, gailview);
+      gtk_tree_path_free (path);
     }
+  } else {
+    gtk_tree_selection_selected_foreach (selection, add_selected_row_index, gailview);
+  }
+
+  gailview->selectionDirty = FALSE;
+}
+
+NSArray *
+gail_treeview_get_selected_rows (GailTreeView *gailview)
+{
+  gail_treeview_ensure_rows (gailview);
+  if (gailview->rowRootNode == NULL) {
+    return @[];
+  }
+
+  refresh_selected_rows (gailview);
+  if (gailview->selectedIndexes == NULL) {
+    return @[];
+  }
+
+  // Kept until the selection or the rows change, so asking again doesn't allocate anything
+  if (gailview->selectedRows == NULL) {
+    ACAccessibilityTreeRowArray *rows = [[ACAccessibilityTreeRowArray alloc] initWithRootRow:ROOT_NODE (gailview)
+                                                                                     indexes:SELECTED_INDEXES (gailview)];
+    gailview->selectedRows = (void *)CFBridgingRetain (rows);
+  }
+
+  return (__bridge NSArray *)gailview->selectedRows;
+}
+
+void
+gail_treeview_set_selected_rows (GailTreeView *gailview,
+                                 NSArray *rows)
+{
+  GtkTreeSelection *selection;
+  GtkWidget *widget;
+
+  widget = GTK_ACCESSIBLE (gailview)->widget;
+  if (widget == NULL) {
+    return;
   }
 
-  g_list_foreach(selected, (GFunc)gtk_tree_path_free, NULL);
-  g_list_free (selected);
+  // The rows' paths are only right once the tree has caught up with the model
+  gail_treeview_ensure_rows (gailview);
 
-  [element setAccessibilitySelectedRows:newSelectedChildren];
-  NSAccessibilityPostNotification(element, NSAccessibilitySelectedRowsChangedNotification);
+  selection = gtk_tree_view_get_selection (GTK_TREE_VIEW (widget));
+  gtk_tree_selection_unselect_all (selection);
+
+  for (id row in rows) {
+    GtkTreePath *path;
+
+    if (![row isKindOfClass:[ACAccessibilityTreeRowElement class]]) {
+      continue;
+    }
+
+    path = [(ACAccessibilityTreeRowElement *)row rowPath];
+    if (path == NULL) {
+      continue;
+    }
+
+    gtk_tree_selection_select_path (selection, path);
+    gtk_tree_path_free (path);
+  }
+
+  // The changed signals have marked the selection as out of date, and it's read back when next asked for
 }
 
 static gboolean
@@ -870,11 +1209,17 @@ update_column_headers (GtkTreeView *tree_view)
   ACAccessibilityOutlineElement *outlineElement = (ACAccessibilityOutlineElement *)element;
 
   if (hasHeaders) {
-    ACAccessibilityTableHeaderElement *header = [[ACAccessibilityTableHeaderElement alloc] initWithDelegate:(AcElement *)gailview];
-    [header setAccessibilityWindow:[element accessibilityWindow]];
-    [header setAccessibilityTopLevelUIElement:[element accessibilityWindow]];
+    // The header element is kept, and only its children are replaced
+    ACAccessibilityTableHeaderElement *header = [outlineElement headerElement];
+    NSMutableArray *headerElements = [NSMutableArray array];
 
-    [outlineElement setHeaderElement:header];
+    if (header == nil) {
+      header = [[ACAccessibilityTableHeaderElement alloc] initWithDelegate:(AcElement *)gailview];
+      [header setAccessibilityWindow:[element accessibilityWindow]];
+      [header setAccessibilityTopLevelUIElement:[element accessibilityWindow]];
+
+      [outlineElement setHeaderElement:header];
+    }
 
     tv_cols = gtk_tree_view_get_columns(tree_view);
     for (t = tv_cols; t; t = t->next) {
@@ -885,7 +1230,7 @@ update_column_headers (GtkTreeView *tree_view)
 
       id<NSAccessibility> headerElement = [tc columnHeaderElement];
       if (headerElement) {
-        [header accessibilityAddChildElement:headerElement];
+        [headerElements addObject:headerElement];
 
         [headerElement setAccessibilityWindow:[element accessibilityWindow]];
         [headerElement setAccessibilityTopLevelUIElement:[element accessibilityWindow]];
@@ -894,6 +1239,8 @@ update_column_headers (GtkTreeView *tree_view)
     }
 
     g_list_free (tv_cols);
+
+    [header setAccessibilityChildren:headerElements];
   } else {
     // Remove the header
     [outlineElement setHeaderElement:nil];
@@ -909,11 +1256,46 @@ columns_changed (GtkTreeView *tree_view)
   update_columns(gailview, tree_view);
 }
 
+/* Columns that are added after the view is set up need watching for visibility changes too */
+static void
+watch_column (GtkTreeView *tree_view,
+              GtkTreeViewColumn *column)
+{
+  if (g_signal_handler_find (column, G_SIGNAL_MATCH_FUNC | G_SIGNAL_MATCH_DATA, 0, 0, NULL,
+                             column_visibility_changed, tree_view) != 0) {
+    return;
+  }
+
+  g_signal_connect_data (column, "notify::visible",
+                         (GCallback)column_visibility_changed,
+                         tree_view, NULL, FALSE);
+  g_signal_connect_data (column, "destroy",
+                         (GCallback)column_destroy,
+                         NULL, NULL, FALSE);
+}
+
+static void
+collect_column_element (gpointer key,
+                        gpointer value,
+                        gpointer data)
+{
+  NSMutableArray *elements = (__bridge NSMutableArray *)data;
+
+  [elements addObject:(__bridge ACAccessibilityTreeColumnElement *)value];
+}
+
+/* Applies the column changes as a diff against the elements we already have. The elements of
+ * the columns that are still shown are kept, along with the cells that the rows have made for them,
+ * and only the columns that have been removed or hidden lose their cells. */
 static void
 update_columns (GailTreeView *gailview,
                 GtkTreeView *tree_view)
 {
   GList *tv_cols, *tmp_list;
+  GHashTable *oldMap;
+  NSMutableArray *removed;
+  gboolean changed = FALSE;
+  int idx;
 
   // If columnMap is NULL then we're probably being destroyed
   if (gailview->columnMap == NULL) {
@@ -922,32 +1304,66 @@ update_columns (GailTreeView *gailview,
 
   tv_cols = gtk_tree_view_get_columns (tree_view);
 
-  int idx;
   NSAccessibilityElement *parentElement = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
 
-  g_hash_table_foreach_remove (gailview->columnMap, remove_column_from_parent, (__bridge void *)parentElement);
+  // The elements of the columns that are still shown are moved over to the new map
+  oldMap = gailview->columnMap;
+  gailview->columnMap = g_hash_table_new (NULL, NULL);
 
   idx = 0;
   for (tmp_list = tv_cols; tmp_list; tmp_list = tmp_list->next) {
+    GtkTreeViewColumn *column = tmp_list->data;
     ACAccessibilityTreeColumnElement *tc;
+    void *value;
+
+    watch_column (tree_view, column);
 
-    if (!gtk_tree_view_column_get_visible(tmp_list->data)) {
+    if (!gtk_tree_view_column_get_visible (column)) {
       continue;
     }
-    
-    tc = [[ACAccessibilityTreeColumnElement alloc] initWithDelegate:AC_ELEMENT (gailview) treeColumn:tmp_list->data];
 
-    [tc setAccessibilityIndex:idx];
-    [tc setAccessibilityWindow:[parentElement accessibilityWindow]];
-    [tc setAccessibilityTopLevelUIElement:[parentElement accessibilityWindow]];
-    [tc setAccessibilityParent:parentElement];
+    value = g_hash_table_lookup (oldMap, column);
+    if (value != NULL) {
+      g_hash_table_steal (oldMap, column);
+
+      tc = (__bridge ACAccessibilityTreeColumnElement *)value;
+      if ([tc accessibilityIndex] != idx) {
+        [tc setAccessibilityIndex:idx];
+        changed = TRUE;
+      }
+    } else {
+      tc = [[ACAccessibilityTreeColumnElement alloc] initWithDelegate:AC_ELEMENT (gailview) treeColumn:column];
+
+      [tc setAccessibilityIndex:idx];
+      [tc setAccessibilityWindow:[parentElement accessibilityWindow]];
+      [tc setAccessibilityTopLevelUIElement:[parentElement accessibilityWindow]];
+      [tc setAccessibilityParent:parentElement];
 
-    g_hash_table_insert (gailview->columnMap, tmp_list->data, (__bridge_retained void *)tc);
+      value = (__bridge_retained void *)tc;
+      changed = TRUE;
+    }
 
+    g_hash_table_insert (gailview->columnMap, column, value);
     idx++;
   }
 
-  update_column_headers(tree_view);
+  // Whatever is left has been removed or hidden
+  removed = [NSMutableArray arrayWithCapacity:g_hash_table_size (oldMap)];
+  g_hash_table_foreach (oldMap, collect_column_element, (__bridge void *)removed);
+  g_hash_table_foreach_remove (oldMap, remove_column_from_parent, (__bridge void *)parentElement);
+  g_hash_table_destroy (oldMap);
+
+  if (changed || [removed count] > 0) {
+    AC_NOTE (TREEWIDGET, g_print ("Columns changed: %d shown, %lu removed\n", idx, (unsigned long)[removed count]));
+
+    if (gailview->cellRows) {
+      for (ACAccessibilityTreeRowElement *row in CELL_ROWS (gailview)) {
+        [row removeCellsForColumns:removed];
+      }
+    }
+
+    update_column_headers (tree_view);
+  }
 
   g_list_free (tv_cols);
 }
@@ -958,9 +1374,10 @@ model_row_changed (GtkTreeModel *tree_model,
                    GtkTreeIter  *iter,
                    gpointer     user_data)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "model_row_changed", tree_model);
+
   GtkTreeView *tree_view = GTK_TREE_VIEW(user_data);
   GailTreeView *gailview;
-  ACAccessibilityTreeRowElement *row;
 
   gailview = GAIL_TREE_VIEW (gtk_widget_get_accessible (GTK_WIDGET (tree_view)));
 
@@ -968,7 +1385,18 @@ model_row_changed (GtkTreeModel *tree_model,
     return;
   }
 
-  row = find_row_element_for_path (gailview, path);
+  ac_row_ops_row_changed (gailview->rowOps, tree_model, path, iter);
+}
+
+static void
+apply_row_changed (GtkTreePath *path,
+                   gpointer data)
+{
+  GailTreeView *gailview = data;
+  ACAccessibilityTreeRowElement *row;
+
+  // Placeholder rows will get the new values when their element is created
+  row = get_existing_row_from_row_map (gailview, path);
   if (row == nil) {
     return;
   }
@@ -1021,6 +1449,11 @@ column_visibility_changed (GObject    *object,
                            GParamSpec *pspec,
                            gpointer   user_data)
 {
+  GtkTreeView *tree_view = GTK_TREE_VIEW (user_data);
+  AtkObject *atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
+
+  // Showing or hiding a column doesn't emit columns-changed
+  update_columns (GAIL_TREE_VIEW (atk_obj), tree_view);
 }
 
 /*
@@ -1088,17 +1521,21 @@ make_accessibility_cell_for_column (GtkTreeModel *treeModel,
   gboolean is_expanded = FALSE;
   gboolean needs_disclosure = FALSE;
   GtkTreeSelection *selection;
-  GtkTreeIter rowIter;
 
   parentElement = ac_element_get_accessibility_element (AC_ELEMENT (gailView));
 
-  gtk_tree_model_get_iter(treeModel, &rowIter, path);
-
-  if (isExpanderColumn && gtk_tree_model_iter_has_child (treeModel, &rowIter)) {
+  if (isExpanderColumn && [rowElement hasChildRows]) {
     needs_disclosure = TRUE;
   }
 
-  cell = [[ACAccessibilityTreeCellElement alloc] initWithDelegate:AC_ELEMENT (gailView) withDisclosureButton:needs_disclosure];
+  cell = [columnElement dequeueReusableCell];
+  if (cell == nil) {
+    cell = [[ACAccessibilityTreeCellElement alloc] initWithDelegate:AC_ELEMENT (gailView) withDisclosureButton:needs_disclosure];
+  } else if (needs_disclosure) {
+    [cell addDisclosureButton];
+  } else {
+    [cell removeDisclosureButton];
+  }
   [cell setAccessibilityParent:rowElement];
   [cell setAccessibilityWindow:[parentElement accessibilityWindow]];
   [cell setAccessibilityTopLevelUIElement:[parentElement accessibilityWindow]];
@@ -1134,158 +1571,97 @@ find_column_element_for_column (GailTreeView *gailView,
   return (__bridge ACAccessibilityTreeColumnElement *)g_hash_table_lookup (gailView->columnMap, column);
 }
 
+/* Rows don't take a GtkTreeRowReference, as GTK walks all of them on every change to the model.
+ * A row gets its path from its position in the row tree once it has been added to it. */
 static NSAccessibilityElement *
-make_accessibility_element_for_row (GtkTreeModel *treeModel,
-                                    GtkTreeView *treeView,
-                                    GailTreeView *gailView,
-                                    GtkTreeIter  *rowIter)
+make_accessibility_element_for_row (GtkTreeView *treeView,
+                                    GailTreeView *gailView)
 {
   id<NSAccessibility> parentElement;
   ACAccessibilityTreeRowElement *rowElement;
-  GtkTreeRowReference *rowRef;
-  GtkTreePath *rowPath;
-  GList *columns, *c;
 
   parentElement = ac_element_get_accessibility_element (AC_ELEMENT (gailView));
 
-  rowPath = gtk_tree_model_get_path (treeModel, rowIter);
-  rowRef = gtk_tree_row_reference_new (treeModel, rowPath);
-  rowElement = [[ACAccessibilityTreeRowElement alloc] initWithDelegate:AC_ELEMENT (gailView) treeRow:rowRef treeView:treeView];
+  rowElement = [[ACAccessibilityTreeRowElement alloc] initWithDelegate:AC_ELEMENT (gailView) treeRow:NULL treeView:treeView];
   [rowElement setAccessibilityParent:parentElement];
   [rowElement setAccessibilityWindow:[parentElement accessibilityWindow]];
   
 //  [rowElement setAccessibilityTopLevelUIElement:[parentElement accessibilityTopLevelUIElement]];
-  gtk_tree_path_free (rowPath);
 
   return rowElement;
 }
 
 static void
-update_expandability (GtkTreeView *tree_view,
-                      GtkTreeModel *tree_model,
-                      GailTreeView *gailview,
-                      GtkTreePath *path)
+model_row_inserted (GtkTreeModel *tree_model,
+                    GtkTreePath  *path, 
+                    GtkTreeIter  *iter, 
+                    gpointer     user_data)
 {
-  /*
-  GtkTreeViewColumn *expandColumn = gtk_tree_view_get_expander_column (tree_view);
-  ACAccessibilityTreeColumnElement *columnElement = find_column_element_for_column (gailview, expandColumn);
-  ACAccessibilityTreeRowElement *rowElement = find_row_element_for_path (gailview, path);
-  NSArray *columnChildren = [columnElement accessibilityChildren];
-  ACAccessibilityTreeCellElement *cell = NULL;
-  GtkTreeIter iter;
-  gboolean hasChildren;
-
-  if (!gtk_tree_model_get_iter (tree_model, &iter, path)) {
-    return;
-  }
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "model_row_inserted", tree_model);
 
-  hasChildren = gtk_tree_model_iter_has_child (tree_model, &iter);
-
-  for (id<NSAccessibility> child in columnChildren) {
-    if ([child accessibilityParent] == rowElement) {
-      cell = child;
-      break;
-    }
-  }
+  GtkTreeView *tree_view = (GtkTreeView *)user_data;
+  AtkObject *atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
+  GailTreeView *gailview = GAIL_TREE_VIEW (atk_obj);
 
-  if (cell == NULL) {
+  if (gailview->rowRootNode == NULL) {
     return;
   }
 
-  if (hasChildren) {
-    [cell addDisclosureButton];
-  } else {
-    [cell removeDisclosureButton];
-  }
-   */
+  AC_NOTE (TREEWIDGET, g_print ("Model row inserted: %s\n", gtk_tree_path_to_string (path)));
+
+  ac_row_ops_row_inserted (gailview->rowOps, tree_model, path, iter);
 }
 
-static gboolean
-check_visibility (GtkTreeModel *tree_model,
-                  GtkTreeIter *iter,
-                  GtkTreeView *view)
+/* Called by the row ops while the row-inserted signal is emitted, for a row that can be seen */
+static gpointer
+make_inserted_row_element (GtkTreeModel *tree_model,
+                           GtkTreePath *path,
+                           GtkTreeIter *iter,
+                           gpointer data)
 {
-  GtkTreeIter parentIter;
-  GtkTreePath *path;
-  gboolean expanded;
+  GailTreeView *gailview = data;
+  ACAccessibilityTreeRowElement *element;
 
-  // If iter has no parent, then it is the root node and is visible
-  if (!gtk_tree_model_iter_parent (tree_model, &parentIter, iter)) {
-    return TRUE;
+  // Lazy rows are made as placeholders when the op is applied
+  if (gailview->lazyRows) {
+    return NULL;
   }
 
-  path = gtk_tree_model_get_path (tree_model, &parentIter);
-  expanded = gtk_tree_view_row_expanded (view, path);
-  gtk_tree_path_free (path);
+  element = (ACAccessibilityTreeRowElement *)make_accessibility_element_for_row (GTK_TREE_VIEW (GTK_ACCESSIBLE (gailview)->widget), gailview);
+  [element setHasChildRows:gtk_tree_model_iter_has_child (tree_model, iter)];
 
-  return expanded && check_visibility (tree_model, &parentIter, view);
+  return (void *)CFBridgingRetain (element);
 }
 
-static gboolean
-model_row_is_visible (GtkTreeModel *tree_model,
-                      GtkTreeIter *iter,
-                      GtkTreeView *view)
+static void
+release_row_element (gpointer element)
 {
-  return check_visibility (tree_model, iter, view);
+  CFBridgingRelease (element);
 }
 
-static void
-model_row_inserted (GtkTreeModel *tree_model,
-                    GtkTreePath  *path, 
-                    GtkTreeIter  *iter, 
-                    gpointer     user_data)
+/* Returns TRUE if the number of rows changed */
+static gboolean
+apply_row_inserted (GtkTreePath *path,
+                    gpointer data,
+                    gpointer user_data)
 {
-  GtkTreeView *tree_view = (GtkTreeView *)user_data;
-  GtkTreePath *path_copy;
-  AtkObject *atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
-  GailTreeView *gailview = GAIL_TREE_VIEW (atk_obj);
-  gint n_inserted, child_row;
-
-  if (gailview->rowRootNode == NULL) {
-    return;
-  }
-
-  AC_NOTE (TREEWIDGET, g_print ("Model row inserted: %s\n", gtk_tree_path_to_string (path)));
-
-  /* Check to see if row is visible */
- /*
-  * A row insert is not necessarily visible.  For example,
-  * a row can be draged & dropped into another row, which
-  * causes an insert on the model that isn't visible in the
-  * view.  Only generate a signal if the inserted row is
-  * visible.
-  */
-  if (model_row_is_visible (tree_model, iter, tree_view))
-    {
-      GtkTreeIter iter;
-      NSAccessibilityElement *element, *parentElement;
-      gint n_cols, col;
-      int row = -1;
-
-      AC_NOTE (TREEWIDGET, g_print ("Row is visible\n"));
-      gtk_tree_model_get_iter (tree_model, &iter, path);
-
-      element = make_accessibility_element_for_row (tree_model, tree_view, gailview, &iter);
-      add_row_to_tree(gailview, (ACAccessibilityTreeRowElement *)element, NO);
+  GailTreeView *gailview = user_data;
+  ACAccessibilityTreeRowElement *element = (__bridge ACAccessibilityTreeRowElement *)data;
 
-      gailview->treeIsDirty = TRUE;
-      NSAccessibilityPostNotification(ac_element_get_accessibility_element(AC_ELEMENT (atk_obj)), NSAccessibilityRowCountChangedNotification);
+  if (gailview->lazyRows) {
+    if (add_placeholder_to_row_map (gailview, path) == nil) {
+      return FALSE;
     }
-  else
-    {
-     /*
-      * The row has been inserted inside another row.  This can
-      * cause a row that previously couldn't be expanded to now
-      * be expandable.
-      */
-      AC_NOTE(TREEWIDGET, g_print ("Not visible, maybe expand\n"));
-      path_copy = gtk_tree_path_copy (path);
-      gtk_tree_path_up (path_copy);
-
-      update_expandability (tree_view, tree_model, gailview, path_copy);
-
-      gtk_tree_path_free (path_copy);
+  } else {
+    if (element == nil) {
+      return FALSE;
     }
+
+    add_row_to_tree (gailview, element, path, NO);
+  }
+
+  selection_rows_inserted (gailview, flattened_index_of_path (gailview, path), 1);
+  return TRUE;
 }
 
 static void
@@ -1293,14 +1669,11 @@ model_row_deleted (GtkTreeModel *tree_model,
                    GtkTreePath  *path, 
                    gpointer     user_data)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "model_row_deleted", tree_model);
+
   GtkTreeView *tree_view;
-  GtkTreePath *path_copy;
   AtkObject *atk_obj;
   GailTreeView *gailview;
-  ACAccessibilityElement *treeElement;
-  ACAccessibilityTreeRowElement *rowElement;
-  gint row, col, n_cols;
-
 
   tree_view = (GtkTreeView *)user_data;
   atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
@@ -1310,17 +1683,86 @@ model_row_deleted (GtkTreeModel *tree_model,
     return;
   }
 
-  rowElement = find_row_element_for_path (gailview, path);
-  if (rowElement == NULL) {
+  ac_row_ops_row_deleted (gailview->rowOps, tree_model, path);
+}
+
+static void
+model_row_has_child_toggled (GtkTreeModel *tree_model,
+                             GtkTreePath  *path,
+                             GtkTreeIter  *iter,
+                             gpointer     user_data)
+{
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "model_row_has_child_toggled", tree_model);
+
+  GtkTreeView *tree_view = GTK_TREE_VIEW (user_data);
+  GailTreeView *gailview = GAIL_TREE_VIEW (gtk_widget_get_accessible (GTK_WIDGET (tree_view)));
+
+  if (gailview->rowRootNode == NULL) {
+    return;
+  }
+
+  ac_row_ops_row_has_child_toggled (gailview->rowOps, tree_model, path, iter);
+}
+
+static void
+apply_row_child_toggled (GtkTreePath *path,
+                         gboolean has_child,
+                         gpointer data)
+{
+  GailTreeView *gailview = data;
+  ACAccessibilityTreeRowElement *row;
+
+  // Placeholder rows will find out when their element is created
+  row = get_existing_row_from_row_map (gailview, path);
+  if (row == nil) {
     return;
   }
 
+  // Taken from the model when the signal came in, as the row can't ask the model itself
+  [row setHasChildRows:has_child];
+}
+
+/* Returns TRUE if the number of rows changed */
+static gboolean
+apply_row_deleted (GtkTreePath *path,
+                   gpointer data)
+{
+  GailTreeView *gailview = data;
+  ACAccessibilityElement *treeElement;
+  ACAccessibilityTreeRowElement *rowElement;
+
+  rowElement = get_existing_row_from_row_map (gailview, path);
+  if (rowElement == NULL) {
+    // The row might never have been given an element, in which case only the placeholder needs removed
+    ACAccessibilityTreeRowElement *parentElement;
+    int depth = gtk_tree_path_get_depth (path);
+    int *indices = gtk_tree_path_get_indices (path);
+    int idx;
+
+    if (depth < 1) {
+      return FALSE;
+    }
+
+    idx = indices[depth - 1];
+    parentElement = [ROOT_NODE (gailview) childAtIndices:indices depth:depth - 1 materialize:NO];
+
+    // If the parent isn't expanded then the row was never in the tree
+    if (parentElement == nil || idx >= [parentElement childCount]) {
+      return FALSE;
+    }
+
+    selection_rows_removed (gailview, flattened_index_of_path (gailview, path), 1);
+    [parentElement removeChildAtIndex:idx];
+    return TRUE;
+  }
+
+  selection_rows_removed (gailview, flattened_index_of_path (gailview, path), [rowElement descendantCount] + 1);
+
+  treeElement = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
   remove_all_children (gailview, treeElement, rowElement);
 
   remove_row_from_tree(gailview, rowElement);
-
-  gailview->treeIsDirty = TRUE;
-  NSAccessibilityPostNotification(ac_element_get_accessibility_element(AC_ELEMENT (atk_obj)), NSAccessibilityRowCountChangedNotification);
+  return TRUE;
 }
 
 static void 
@@ -1330,6 +1772,8 @@ model_rows_reordered (GtkTreeModel *tree_model,
                       gint         *new_order, 
                       gpointer     user_data)
 {
+  AC_PROFILE_SCOPE_FOR (TREEWIDGET, "model_rows_reordered", tree_model);
+
   GtkTreeView *view = GTK_TREE_VIEW (user_data);
   GailTreeView *gailview = GAIL_TREE_VIEW (gtk_widget_get_accessible (GTK_WIDGET (view)));
 
@@ -1339,7 +1783,21 @@ model_rows_reordered (GtkTreeModel *tree_model,
     return;
   }
 
-  ACAccessibilityTreeRowElement *parentElement = gtk_tree_path_get_depth (path) > 0 ? find_row_element_for_path (gailview, path) : ROOT_NODE (gailview);
+  ac_row_ops_rows_reordered (gailview->rowOps, tree_model, path, iter, new_order);
+}
+
+static void
+apply_rows_reordered (GtkTreePath *path,
+                      gint *new_order,
+                      gpointer data)
+{
+  GailTreeView *gailview = data;
+  ACAccessibilityTreeRowElement *parentElement;
+  int n_children, start, *old_offsets, i;
+  NSUInteger generation;
+
+  // Expanded rows always have an element, so a placeholder parent has no children to reorder
+  parentElement = gtk_tree_path_get_depth (path) > 0 ? get_existing_row_from_row_map (gailview, path) : ROOT_NODE (gailview);
 
   if (parentElement == nil) {
     // We might get reorders for rows that aren't visible yet, so we don't care about them
@@ -1347,14 +1805,208 @@ model_rows_reordered (GtkTreeModel *tree_model,
     return;
   }
 
-  gailview->treeIsDirty = TRUE;
+  n_children = [parentElement childCount];
+  start = parentElement == ROOT_NODE (gailview) ? 0 : flattened_index_of_path (gailview, path) + 1;
+
+  // If any of the rows below parent are selected, the selection needs to know where each
+  // child's subtree was before they moved
+  old_offsets = NULL;
+  if (selection_has_rows_in (gailview, start, [parentElement descendantCount])) {
+    old_offsets = g_new (int, n_children);
+    for (i = 0; i < n_children; i++) {
+      old_offsets[i] = [parentElement flattenedOffsetOfChildAtIndex:i];
+    }
+  }
+
+  generation = [parentElement rowGeneration];
   [parentElement reorderChildrenToNewIndicies:new_order];
+
+  // An invalid new_order leaves the rows as they were
+  if (old_offsets && generation != [parentElement rowGeneration]) {
+    selection_rows_reordered (gailview, parentElement, start, old_offsets, new_order);
+  }
+  g_free (old_offsets);
+}
+
+/* Model signals can arrive in their thousands when rows are added or removed in bulk,
+ * so the model handlers queue them in the AcRowOps and the changes are applied together,
+ * with one notification for each kind, when the main loop is next idle.
+ * Besides the idle, the queue is only flushed by the expand and collapse handlers, which change
+ * the tree themselves, and by the gail_treeview_ functions before they hand out any rows.
+ * The row elements read the tree as it is and never flush it. */
+static void
+row_ops_flushed (const AcRowOpsBatch *batch,
+                 gpointer data)
+{
+  GailTreeView *gailview = data;
+  NSAccessibilityElement *element;
+
+  // The row changes have already moved the selection with them, but GTK doesn't say what a
+  // selection change was. It is only read back again if somebody asks for it
+  if (batch->n_selection_changes > 0) {
+    invalidate_selected_rows (gailview);
+  }
+
+  // The row tree matches the model again, so any rows made while it didn't can be looked up now
+  resolve_rows (gailview);
+
+  if (batch->n_ops == 0 && batch->n_selection_changes == 0) {
+    return;
+  }
+
+  if (batch->n_moves > 0) {
+    invalidate_visible_rows (gailview, TRUE);
+  }
+
+  AC_PROFILE_COUNT (TREEWIDGET, "row ops per flush", batch->n_ops);
+
+  gailview->batchCount++;
+  gailview->batchedRowOps += batch->n_ops;
+  gailview->batchedSelectionChanges += batch->n_selection_changes;
+
+  element = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
+  if (batch->n_count_changes > 0) {
+    NSAccessibilityPostNotification(element, NSAccessibilityRowCountChangedNotification);
+    gailview->coalescedNotifications += batch->n_count_changes - 1;
+  }
+
+  if (batch->n_selection_changes > 0) {
+    NSAccessibilityPostNotification(element, NSAccessibilitySelectedRowsChangedNotification);
+    gailview->coalescedNotifications += batch->n_selection_changes - 1;
+  }
+
+  AC_NOTE (TREEWIDGET, g_print ("Applied %u row changes and %u selection changes. Totals: %u batches, %u row changes, %u selection changes, %u notifications coalesced\n",
+                                batch->n_ops, batch->n_selection_changes, gailview->batchCount, gailview->batchedRowOps,
+                                gailview->batchedSelectionChanges, gailview->coalescedNotifications));
+}
+
+static const AcRowOpsFuncs row_ops_funcs = {
+  make_inserted_row_element,
+  release_row_element,
+  apply_row_changed,
+  apply_row_inserted,
+  apply_row_deleted,
+  apply_rows_reordered,
+  apply_row_child_toggled,
+  row_ops_flushed
+};
+
+static void
+flush_pending_row_ops (GailTreeView *gailview)
+{
+  if (gailview->rowOps == NULL) {
+    return;
+  }
+
+  if (gailview->rowRootNode == NULL) {
+    ac_row_ops_discard (gailview->rowOps);
+    return;
+  }
+
+  AC_PROFILE_SCOPE (TREEWIDGET, "flush_pending_row_ops");
+
+  ac_row_ops_flush (gailview->rowOps);
 }
 
 static void
 adjustment_changed (GtkAdjustment *adjustment, 
                     GtkTreeView   *tree_view)
 {
+  AtkObject *atk_obj = gtk_widget_get_accessible (GTK_WIDGET (tree_view));
+
+  invalidate_visible_rows (GAIL_TREE_VIEW (atk_obj), FALSE);
+  schedule_recycle_cells (GAIL_TREE_VIEW (atk_obj));
+}
+
+/* Cells are only made for the rows that are asked for their children. Once a row has
+ * scrolled out of view its cells are handed back to their columns to be reused for the
+ * next rows that come into view, so the number of cells stays bounded however far the
+ * tree is scrolled. Scrolling changes the adjustments many times a second, so the cells
+ * are recycled at most every RECYCLE_CELLS_DELAY. */
+static void
+recycle_cells (GailTreeView *gailview,
+               gboolean offscreen_only)
+{
+  GtkWidget *widget;
+  GtkTreePath *startPath, *endPath;
+  NSMutableArray *recycled;
+  int start = -1, end = -1;
+
+  if (gailview->cellRows == NULL || [CELL_ROWS (gailview) count] == 0) {
+    return;
+  }
+
+  widget = GTK_ACCESSIBLE (gailview)->widget;
+  if (offscreen_only) {
+    if (widget == NULL || gailview->rowRootNode == NULL ||
+        !gtk_tree_view_get_visible_range (GTK_TREE_VIEW (widget), &startPath, &endPath)) {
+      return;
+    }
+
+    // The rows are compared by their flattened index, which doesn't need a path for each of them
+    start = flattened_index_of_path (gailview, startPath);
+    end = flattened_index_of_path (gailview, endPath);
+
+    gtk_tree_path_free (startPath);
+    gtk_tree_path_free (endPath);
+
+    if (start < 0 || end < start) {
+      return;
+    }
+  }
+
+  recycled = [NSMutableArray array];
+  for (ACAccessibilityTreeRowElement *row in CELL_ROWS (gailview)) {
+    if (offscreen_only) {
+      NSInteger idx = [row accessibilityIndex];
+
+      // Rows that have been removed from the tree have no index
+      if ([row parent] != nil && idx >= start && idx <= end) {
+        continue;
+      }
+    }
+
+    [row recycleChildCells];
+    [recycled addObject:row];
+  }
+
+  for (ACAccessibilityTreeRowElement *row in recycled) {
+    [CELL_ROWS (gailview) removeObject:row];
+  }
+}
+
+static gboolean
+recycle_cells_timeout (gpointer data)
+{
+  GailTreeView *gailview = GAIL_TREE_VIEW (data);
+
+  gailview->recycleCellsId = 0;
+
+  // The visible range is in terms of the model, so the row tree has to catch up with it
+  flush_pending_row_ops (gailview);
+  recycle_cells (gailview, TRUE);
+
+  return FALSE;
+}
+
+static void
+schedule_recycle_cells (GailTreeView *gailview)
+{
+  // The wait isn't restarted, so the cells are still recycled during a long scroll
+  if (gailview->cellRows == NULL || gailview->recycleCellsId > 0) {
+    return;
+  }
+
+  gailview->recycleCellsId = g_timeout_add (RECYCLE_CELLS_DELAY, recycle_cells_timeout, gailview);
+}
+
+static void
+cancel_recycle_cells (GailTreeView *gailview)
+{
+  if (gailview->recycleCellsId > 0) {
+    g_source_remove (gailview->recycleCellsId);
+    gailview->recycleCellsId = 0;
+  }
 }
 
 /* Misc Public */
@@ -1392,6 +2044,149 @@ update_column_cells (GtkTreeView *tree_view,
   gtk_tree_view_column_cell_set_cell_data (column, tree_model, &iter, is_expander, is_expanded);
 }
 
+/* Copying a renderer's values into a GailRendererCell means finding each property in the cell
+ * class' property_list on both renderers. That only depends on the types involved, so it is done
+ * once per source type, target renderer class and property list and the GParamSpecs are kept in a plan.
+ * The values are moved with g_object_get/set_property, so overrides and interface properties are
+ * dispatched, validated and notified the way GObject does it. The plans are kept by the view. */
+typedef struct {
+  GParamSpec *source_spec;
+  GParamSpec *target_spec;
+} PropertyTransfer;
+
+typedef struct {
+  GType source_type;
+  GType target_type;
+  gchar **property_list;
+} PropertyTransferKey;
+
+typedef struct {
+  PropertyTransferKey key;
+  guint n_transfers;
+  guint *entries; /* The property_list position of each transfer, for gail_renderer_cell_begin_transfer */
+  PropertyTransfer transfers[];
+} PropertyTransferPlan;
+
+static guint
+property_transfer_key_hash (gconstpointer v)
+{
+  const PropertyTransferKey *key = v;
+
+  return (guint)(key->source_type ^ (key->target_type << 7) ^ (key->target_type >> 7) ^ GPOINTER_TO_SIZE (key->property_list));
+}
+
+static gboolean
+property_transfer_key_equal (gconstpointer a,
+                             gconstpointer b)
+{
+  const PropertyTransferKey *keyA = a;
+  const PropertyTransferKey *keyB = b;
+
+  return keyA->source_type == keyB->source_type && keyA->target_type == keyB->target_type &&
+    keyA->property_list == keyB->property_list;
+}
+
+static PropertyTransferPlan *
+build_transfer_plan (const PropertyTransferKey *key)
+{
+  GObjectClass *source_class = g_type_class_peek (key->source_type);
+  GObjectClass *target_class = g_type_class_peek (key->target_type);
+  PropertyTransferPlan *plan;
+  gchar **prop_list;
+  guint n_props = 0;
+
+  for (prop_list = key->property_list; prop_list && *prop_list; prop_list++) {
+    n_props++;
+  }
+
+  // The entries go in the same block, after the transfers
+  plan = g_malloc0 (sizeof (PropertyTransferPlan) + n_props * (sizeof (PropertyTransfer) + sizeof (guint)));
+  plan->key = *key;
+  plan->entries = (guint *)&plan->transfers[n_props];
+
+  for (prop_list = key->property_list; prop_list && *prop_list; prop_list++) {
+    PropertyTransfer *transfer;
+    GParamSpec *source_spec, *target_spec;
+
+    // Invalid properties are quite common with managed types because we don't know the parent type
+    // so everything is defaulting to GtkCellRendererText at the moment.
+    source_spec = g_object_class_find_property (source_class, *prop_list);
+    target_spec = g_object_class_find_property (target_class, *prop_list);
+    if (source_spec == NULL || target_spec == NULL ||
+        !(source_spec->flags & G_PARAM_READABLE) || !(target_spec->flags & G_PARAM_WRITABLE) ||
+        (target_spec->flags & G_PARAM_CONSTRUCT_ONLY) ||
+        !g_value_type_transformable (source_spec->value_type, target_spec->value_type)) {
+      continue;
+    }
+
+    transfer = &plan->transfers[plan->n_transfers];
+    transfer->source_spec = source_spec;
+    transfer->target_spec = target_spec;
+
+    plan->entries[plan->n_transfers++] = (guint)(prop_list - key->property_list);
+  }
+
+  return plan;
+}
+
+static void
+transfer_renderer_properties (GailTreeView *gailview,
+                              GObject *source,
+                              GailRendererCell *renderer_cell)
+{
+  PropertyTransferPlan *plan;
+  PropertyTransferKey key;
+  GObject *target;
+  GValue *values;
+  guint i;
+
+  if (gailview->transferPlans == NULL) {
+    gailview->transferPlans = g_hash_table_new_full (property_transfer_key_hash, property_transfer_key_equal, NULL, g_free);
+  }
+
+  key.source_type = G_OBJECT_TYPE (source);
+  key.target_type = G_OBJECT_TYPE (renderer_cell->renderer);
+  key.property_list = GAIL_RENDERER_CELL_GET_CLASS (renderer_cell)->property_list;
+
+  plan = g_hash_table_lookup (gailview->transferPlans, &key);
+  if (plan == NULL) {
+    plan = build_transfer_plan (&key);
+    g_hash_table_insert (gailview->transferPlans, &plan->key, plan);
+  }
+
+  // A shared renderer gets this cell's values back first, if the source doesn't have all of them
+  target = G_OBJECT (gail_renderer_cell_begin_transfer (renderer_cell, plan->entries, plan->n_transfers));
+
+  // The values are handed to the cell afterwards, so it doesn't have to read them back
+  values = g_newa (GValue, plan->n_transfers);
+  memset (values, 0, plan->n_transfers * sizeof (GValue));
+
+  // The notifications for all the properties go out together once they're all set
+  g_object_freeze_notify (target);
+  for (i = 0; i < plan->n_transfers; i++) {
+    PropertyTransfer *transfer = &plan->transfers[i];
+    GValue *value = &values[i];
+
+    g_value_init (value, transfer->source_spec->value_type);
+    g_object_get_property (source, transfer->source_spec->name, value);
+
+    // The cell keeps the values in the target's types
+    if (!g_value_type_compatible (transfer->source_spec->value_type, transfer->target_spec->value_type)) {
+      GValue converted = G_VALUE_INIT;
+
+      g_value_init (&converted, transfer->target_spec->value_type);
+      g_value_transform (value, &converted);
+      g_value_unset (value);
+      *value = converted;
+    }
+
+    g_object_set_property (target, transfer->target_spec->name, value);
+  }
+  g_object_thaw_notify (target);
+
+  gail_renderer_cell_end_transfer (renderer_cell, plan->entries, values, plan->n_transfers);
+}
+
 static gboolean
 cocoa_update_cell_value (GailRendererCell *renderer_cell,
                          GailTreeView     *gailview,
@@ -1404,21 +2199,15 @@ cocoa_update_cell_value (GailRendererCell *renderer_cell,
   GtkTreePath *path;
   GtkTreeIter iter;
   GList *renderers, *cur_renderer;
-  GParamSpec *spec;
-  GailRendererCellClass *gail_renderer_cell_class;
   GtkCellRendererClass *gtk_cell_renderer_class;
   GailCell *cell;
-  gchar **prop_list;
   AtkObject *parent;
 
-  gail_renderer_cell_class = GAIL_RENDERER_CELL_GET_CLASS (renderer_cell);
   if (renderer_cell->renderer)
     gtk_cell_renderer_class = GTK_CELL_RENDERER_GET_CLASS (renderer_cell->renderer);
   else
     gtk_cell_renderer_class = NULL;
 
-  prop_list = gail_renderer_cell_class->property_list;
-
   cell = GAIL_CELL (renderer_cell);
 
   renderers = gtk_cell_layout_get_cells (GTK_CELL_LAYOUT (column));
@@ -1435,30 +2224,7 @@ cocoa_update_cell_value (GailRendererCell *renderer_cell,
 
   if (gtk_cell_renderer_class)
     {
-      while (*prop_list)
-        {
-          spec = g_object_class_find_property
-                           (G_OBJECT_GET_CLASS (cur_renderer->data), *prop_list);
-
-          //NSLog (@"Property: %s", *prop_list);
-          if (spec != NULL)
-            {
-              GValue value = { 0, };
-
-              g_value_init (&value, spec->value_type);
-              g_object_get_property (cur_renderer->data, *prop_list, &value);
-              g_object_set_property (G_OBJECT (renderer_cell->renderer),
-                                     *prop_list, &value);
-
-              g_value_unset(&value);
-            }
-          else {
-            // Silence this warning as invalid properties are quite command as we don't know the appropriate type for
-            // managed types.
-            // g_warning ("Invalid property: %s\n", *prop_list);
-          }
-          prop_list++;
-        }
+      transfer_renderer_properties (gailview, G_OBJECT (cur_renderer->data), renderer_cell);
     }
   g_list_free (renderers);
 
@@ -1485,6 +2251,9 @@ connect_model_signals (GtkTreeView  *view,
   g_signal_connect_data (obj, "rows-reordered",
                          (GCallback) model_rows_reordered, view, NULL, 
                          G_CONNECT_AFTER);
+  g_signal_connect_data (obj, "row-has-child-toggled",
+                         (GCallback) model_row_has_child_toggled, view, NULL,
+                         G_CONNECT_AFTER);
 }
 
 static void
@@ -1499,79 +2268,266 @@ disconnect_model_signals (GailTreeView *view)
   g_signal_handlers_disconnect_by_func (obj, (gpointer) model_row_inserted, widget);
   g_signal_handlers_disconnect_by_func (obj, (gpointer) model_row_deleted, widget);
   g_signal_handlers_disconnect_by_func (obj, (gpointer) model_rows_reordered, widget);
+  g_signal_handlers_disconnect_by_func (obj, (gpointer) model_row_has_child_toggled, widget);
 }
 
 static void
 add_iter_rows_recursive (GailTreeView *gailview,
                          GtkTreeView *treeview,
-                         GtkTreeIter *iter,
-                         NSMutableArray *a)
+                         GtkTreeIter *iter)
 {
   do {
-    ACAccessibilityTreeRowElement *rowElement = (ACAccessibilityTreeRowElement *) make_accessibility_element_for_row(gailview->tree_model, treeview, gailview, iter);
+    ACAccessibilityTreeRowElement *rowElement = (ACAccessibilityTreeRowElement *) make_accessibility_element_for_row (treeview, gailview);
     GtkTreePath *path;
     gboolean expanded;
 
-    // Need to do this before add_row_to_row_map_with_path as it alters path.
     path = gtk_tree_model_get_path (gailview->tree_model, iter);
     expanded = gtk_tree_view_row_expanded (treeview, path);
 
-    [a addObject:rowElement];
     add_row_to_row_map_with_path(gailview, path, rowElement);
 
     gtk_tree_path_free (path);
 
-    if (gtk_tree_model_iter_has_child(gailview->tree_model, iter)) {
+    [rowElement setHasChildRows:gtk_tree_model_iter_has_child (gailview->tree_model, iter)];
+    if ([rowElement hasChildRows]) {
       if (expanded) {
         GtkTreeIter childIter;
 
         if (gtk_tree_model_iter_children(gailview->tree_model, &childIter, iter)) {
-          add_iter_rows_recursive(gailview, treeview, &childIter, a);
+          add_iter_rows_recursive(gailview, treeview, &childIter);
         }
       }
     }
   } while (gtk_tree_model_iter_next(gailview->tree_model, iter));
 }
 
+static void
+add_iter_rows_lazy (GailTreeView *gailview,
+                    GtkTreeView *treeview,
+                    ACAccessibilityTreeRowElement *parent,
+                    GtkTreeIter *iter)
+{
+  GtkTreeModel *model = gailview->tree_model;
+  int idx = 0, pending = 0;
+
+  // Collapsed rows are added as runs of placeholders. Only the expanded rows need an element
+  // now, as they are the parents of the rows below them.
+  do {
+    if (gtk_tree_model_iter_has_child (model, iter)) {
+      GtkTreePath *path = gtk_tree_model_get_path (model, iter);
+      gboolean expanded = gtk_tree_view_row_expanded (treeview, path);
+
+      gtk_tree_path_free (path);
+
+      if (expanded) {
+        ACAccessibilityTreeRowElement *rowElement;
+        GtkTreeIter childIter;
+
+        [parent insertPlaceholderChildrenAtIndex:idx - pending count:pending];
+        pending = 0;
+
+        rowElement = (ACAccessibilityTreeRowElement *) make_accessibility_element_for_row (treeview, gailview);
+        [rowElement setAccessibilityTopLevelUIElement:[rowElement accessibilityWindow]];
+        [rowElement setHasChildRows:YES];
+        [parent insertChild:rowElement atIndex:idx];
+
+        if (gtk_tree_model_iter_children (model, &childIter, iter)) {
+          add_iter_rows_lazy (gailview, treeview, rowElement, &childIter);
+        }
+
+        idx++;
+        continue;
+      }
+    }
+
+    pending++;
+    idx++;
+  } while (gtk_tree_model_iter_next (model, iter));
+
+  [parent insertPlaceholderChildrenAtIndex:idx - pending count:pending];
+}
+
+/* The row tree is behind the model while there are queued changes, so a path taken from it
+ * can't be looked up in the model until they have been applied */
+static gboolean
+rows_match_model (GailTreeView *gailview)
+{
+  return gailview->rowOps == NULL || !ac_row_ops_is_pending (gailview->rowOps);
+}
+
+/* Fills in what a row needs from the model. Returns FALSE if the row isn't in the model */
+static gboolean
+resolve_row (GailTreeView *gailview,
+             ACAccessibilityTreeRowElement *rowElement,
+             GtkTreePath *path)
+{
+  GtkTreeIter iter;
+
+  if (!gtk_tree_model_get_iter (gailview->tree_model, &iter, path)) {
+    return FALSE;
+  }
+
+  [rowElement setHasChildRows:gtk_tree_model_iter_has_child (gailview->tree_model, &iter)];
+  return TRUE;
+}
+
+static void
+resolve_rows (GailTreeView *gailview)
+{
+  NSHashTable *rows;
+
+  if (gailview->unresolvedRows == NULL || gailview->tree_model == NULL) {
+    return;
+  }
+
+  // Take the table first, in case anything below makes another row
+  rows = CFBridgingRelease (gailview->unresolvedRows);
+  gailview->unresolvedRows = NULL;
+
+  for (ACAccessibilityTreeRowElement *row in rows) {
+    // Rows that were removed by the queued changes have no path
+    GtkTreePath *path = [row rowPath];
+
+    if (path != NULL) {
+      resolve_row (gailview, row, path);
+      gtk_tree_path_free (path);
+    }
+  }
+}
+
+static ACAccessibilityTreeRowElement *
+make_row_for_placeholder (GailTreeView *gailview,
+                          ACAccessibilityTreeRowElement *parent,
+                          int index)
+{
+  ACAccessibilityTreeRowElement *rowElement;
+  GtkTreeView *treeview;
+  GtkTreePath *path;
+
+  if (gailview->tree_model == NULL) {
+    return nil;
+  }
+
+  treeview = GTK_TREE_VIEW (ac_element_get_owner (AC_ELEMENT (gailview)));
+
+  rowElement = (ACAccessibilityTreeRowElement *) make_accessibility_element_for_row (treeview, gailview);
+  [rowElement setAccessibilityTopLevelUIElement:[rowElement accessibilityWindow]];
+
+  // The element only needs its place in the row tree, the model is asked once it has caught up
+  if (!rows_match_model (gailview)) {
+    if (gailview->unresolvedRows == NULL) {
+      gailview->unresolvedRows = (void *)CFBridgingRetain ([NSHashTable weakObjectsHashTable]);
+    }
+    [UNRESOLVED_ROWS (gailview) addObject:rowElement];
+
+    return rowElement;
+  }
+
+  // The root node has no path
+  path = [parent rowPath] ?: gtk_tree_path_new ();
+  gtk_tree_path_append_index (path, index);
+
+  if (!resolve_row (gailview, rowElement, path)) {
+    rowElement = nil;
+  }
+  gtk_tree_path_free (path);
+
+  return rowElement;
+}
+
+void
+gail_treeview_ensure_rows (GailTreeView *gailview)
+{
+  ACAccessibilityTreeRowElement *root;
+  GtkTreeView *treeview;
+  GtkTreeIter iter;
+
+  if (gailview->rowRootNode != NULL) {
+    flush_pending_row_ops (gailview);
+    return;
+  }
+
+  // We make a tree from the ACAccessibilityTreeRowElements that matches the GtkTreeModel
+  // so we can quickly access the appropriate element given a row path. Using an array is too slow
+  // with large tables, and a hashtable isn't feasible due to how GtkTreeModel works
+  root = [[ACAccessibilityTreeRowElement alloc] initWithDelegate:NULL
+                                                         treeRow:NULL
+                                                        treeView:NULL];
+  gailview->rowRootNode = (__bridge_retained void *)root;
+
+  treeview = GTK_TREE_VIEW(ac_element_get_owner(AC_ELEMENT(gailview)));
+
+  if (gailview->tree_model == NULL || !gtk_tree_model_get_iter_first(gailview->tree_model, &iter)) {
+    return;
+  }
+
+  if (gailview->lazyRows) {
+    [root setRowFactory:^ACAccessibilityTreeRowElement *(ACAccessibilityTreeRowElement *parent, int index) {
+      return make_row_for_placeholder (gailview, parent, index);
+    }];
+
+    if (gtk_tree_model_get_flags (gailview->tree_model) & GTK_TREE_MODEL_LIST_ONLY) {
+      // No row can be expanded, so there's no need to look at the rows at all
+      [root insertPlaceholderChildrenAtIndex:0 count:gtk_tree_model_iter_n_children (gailview->tree_model, NULL)];
+    } else {
+      add_iter_rows_lazy (gailview, treeview, root, &iter);
+    }
+  } else {
+    add_iter_rows_recursive(gailview, treeview, &iter);
+  }
+
+  // Now the tree is built, the selection can be worked out
+  invalidate_selected_rows (gailview);
+}
+
+/* Flattening the whole tree is O(rows), so this is only for callers that need every row.
+ * gail_treeview_get_rows looks them up as they are accessed instead */
 void
 gail_treeview_add_rows (GailTreeView *gailview,
                         NSMutableArray *a)
 {
-  NSMutableArray *rows;
+  AC_PROFILE_SCOPE (TREEWIDGET, "gail_treeview_add_rows");
 
-  if (gailview->rowRootNode == NULL) {
-    // We make a tree from the ACAccessibilityTreeRowElements that matches the GtkTreeModel
-    // so we can quickly access the appropriate element given a row path. Using an array is too slow
-    // with large tables, and a hashtable isn't feasible due to how GtkTreeModel works
+  gail_treeview_ensure_rows (gailview);
+  [ROOT_NODE (gailview) flattenTreeInto:a];
+}
 
-    gailview->rowRootNode = (__bridge_retained void *)[[ACAccessibilityTreeRowElement alloc] initWithDelegate:NULL
-                                                                                                      treeRow:NULL
-                                                                                                     treeView:NULL];
-    rows = [NSMutableArray array];
-    gailview->rowCache = (__bridge_retained void *)rows;
+/* The row tree is the only copy of the flattened rows in either mode. Looking a row up by its
+ * flattened index is O(log n), with lazy rows given their element as they are reached */
+NSArray *
+gail_treeview_get_rows (GailTreeView *gailview)
+{
+  gail_treeview_ensure_rows (gailview);
+  return [[ACAccessibilityTreeRowArray alloc] initWithRootRow:ROOT_NODE (gailview)];
+}
 
-    GtkTreeView *treeview = GTK_TREE_VIEW(ac_element_get_owner(AC_ELEMENT(gailview)));
-    GtkTreeIter iter;
+/* The cells of a column are looked up row by row through the row's own cell for that column,
+ * so no other column's cells are made and no rows outside of the range are touched */
+void
+gail_treeview_add_column_elements_in_range (GailTreeView *gailview,
+                                            ACAccessibilityTreeColumnElement *columnElement,
+                                            NSRange range,
+                                            NSMutableArray *a)
+{
+  ACAccessibilityTreeRowElement *root;
+  NSUInteger i, end;
 
-    if (!gtk_tree_model_get_iter_first(gailview->tree_model, &iter)) {
-      return;
-    }
+  gail_treeview_ensure_rows (gailview);
 
-    add_iter_rows_recursive(gailview, treeview, &iter, rows);
+  root = ROOT_NODE (gailview);
+  if (root == nil) {
+    return;
+  }
 
-    // Now the tree is built, trigger a selection update
-    gail_tree_view_changed_gtk(gtk_tree_view_get_selection(treeview), gailview);
-    gailview->treeIsDirty = FALSE;
-  } else {
-    rows = (NSMutableArray *)ROW_CACHE(gailview);
-    if (gailview->treeIsDirty) {
-      [rows removeAllObjects];
-      [ROOT_NODE(gailview) flattenTreeInto:rows];
-      gailview->treeIsDirty = FALSE;
+  end = MIN (NSMaxRange (range), (NSUInteger)[root descendantCount]);
+  for (i = range.location; i < end; i++) {
+    ACAccessibilityTreeRowElement *row = [root rowAtFlattenedIndex:(int)i];
+    ACAccessibilityTreeCellElement *cell = [row cellForColumn:columnElement];
+
+    if (cell) {
+      [a addObject:cell];
     }
   }
-
-  [a addObjectsFromArray:rows];
 }
 
 void
@@ -1579,34 +2535,103 @@ gail_treeview_add_column_elements (GailTreeView *gailview,
                                    ACAccessibilityTreeColumnElement *columnElement,
                                    NSMutableArray *a)
 {
-  ACAccessibilityElement *element = ac_element_get_accessibility_element (AC_ELEMENT (gailview));
-  NSArray *rows = [element accessibilityRows];
-  NSInteger index = [columnElement accessibilityIndex];
+  GtkTreeView *treeview = GTK_TREE_VIEW (ac_element_get_owner (AC_ELEMENT (gailview)));
+  ACAccessibilityTreeRowElement *startRow, *endRow;
+  GtkTreePath *startPath, *endPath;
+
+  if (!gtk_tree_view_get_visible_range (treeview, &startPath, &endPath)) {
+    return;
+  }
+
+  startRow = gail_treeview_row_for_path (gailview, startPath);
+  endRow = gail_treeview_row_for_path (gailview, endPath);
+
+  gtk_tree_path_free (startPath);
+  gtk_tree_path_free (endPath);
+
+  if (startRow == nil || endRow == nil) {
+    return;
+  }
+
+  gail_treeview_add_column_elements_in_range (gailview, columnElement,
+                                              NSMakeRange ([startRow accessibilityIndex],
+                                                           [endRow accessibilityIndex] - [startRow accessibilityIndex] + 1),
+                                              a);
+}
+
+NSArray *
+gail_treeview_get_column_elements (GailTreeView *gailview,
+                                   ACAccessibilityTreeColumnElement *columnElement)
+{
+  GList *renderers;
 
-  for (id<NSAccessibility> r in rows) {
-    NSArray *children = [r accessibilityChildren];
-    [a addObject:children[index]];
+  renderers = gtk_cell_layout_get_cells (GTK_CELL_LAYOUT ([columnElement column]));
+  if (renderers == NULL) {
+    return @[];
   }
+  g_list_free (renderers);
+
+  return [[ACAccessibilityTreeColumnCellArray alloc] initWithRows:gail_treeview_get_rows (gailview)
+                                                     columnElement:columnElement];
 }
 
-void
-gail_treeview_add_row_elements (GailTreeView *gailview,
-                                ACAccessibilityTreeRowElement *rowElement,
-                                NSMutableArray *a)
+ACAccessibilityTreeCellElement *
+gail_treeview_make_row_cell (GailTreeView *gailview,
+                             ACAccessibilityTreeRowElement *rowElement,
+                             ACAccessibilityTreeColumnElement *columnElement)
 {
   GtkTreeView *treeview = GTK_TREE_VIEW(ac_element_get_owner(AC_ELEMENT(gailview)));
-  GList *c, *columns, *e, *elements;
+  GtkTreeViewColumn *column = [columnElement column];
+  ACAccessibilityTreeCellElement *cell;
+  GList *renderers;
   GtkTreePath *path;
 
+  if (column == NULL) {
+    return nil;
+  }
+
+  renderers = gtk_cell_layout_get_cells (GTK_CELL_LAYOUT (column));
+  if (renderers == NULL) {
+    return nil;
+  }
+  g_list_free (renderers);
+
   path = [rowElement rowPath];
   if (path == NULL) {
-    return;
+    return nil;
   }
 
+  cell = make_accessibility_cell_for_column (gailview->tree_model, treeview, gailview, path, column, rowElement, columnElement);
+  gtk_tree_path_free (path);
+
+  // Remember the row so its cells can be recycled when it scrolls out of view
+  if (gailview->cellRows == NULL) {
+    gailview->cellRows = (void *)CFBridgingRetain ([NSHashTable weakObjectsHashTable]);
+  }
+  [CELL_ROWS (gailview) addObject:rowElement];
+
+  return cell;
+}
+
+void
+gail_treeview_add_row_elements (GailTreeView *gailview,
+                                ACAccessibilityTreeRowElement *rowElement,
+                                NSMutableArray *a)
+{
+  GtkTreeView *treeview = GTK_TREE_VIEW(ac_element_get_owner(AC_ELEMENT(gailview)));
+  GList *c, *columns;
+
 //  columns = g_hash_table_get_keys(gailview->columnMap);
   columns = gtk_tree_view_get_columns(treeview);
   for (c = columns; c; c = c->next) {
-    ACAccessibilityTreeColumnElement *columnElement = find_column_element_for_column (gailview, c->data);
+    ACAccessibilityTreeColumnElement *columnElement;
+
+    // Hidden columns don't have an element
+    if (!gtk_tree_view_column_get_visible (c->data)) {
+      continue;
+    }
+
+    columnElement = find_column_element_for_column (gailview, c->data);
 
     GList *renderers = gtk_cell_layout_get_cells(GTK_CELL_LAYOUT(c->data));
     if (renderers == NULL) {
@@ -1619,11 +2644,13 @@ gail_treeview_add_row_elements (GailTreeView *gailview,
       continue;
     }
 
-    NSAccessibilityElement *cell = make_accessibility_cell_for_column (gailview->tree_model, treeview, gailview, path, c->data, rowElement, columnElement);
-    [a addObject:cell];
+    // Cells that were already made for a single column are reused
+    ACAccessibilityTreeCellElement *cell = [rowElement cellForColumn:columnElement];
+    if (cell) {
+      [a addObject:cell];
+    }
   }
 
-  gtk_tree_path_free(path);
   g_list_free (columns);
 }
 
@@ -1702,6 +2729,7 @@ gail_treeview_add_renderer_elements (GailTreeView *gailview,
     }
 
     gailCell = GAIL_CELL (child);
+    gail_renderer_cell_share_renderer (GAIL_RENDERER_CELL (child), column);
 
     // Set the parent as far as ATK understands to the GtkTreeView
     // because ATK doesn't understand the NSAccessibility parents for the AxCell
@@ -1727,9 +2755,6 @@ gail_treeview_add_renderer_elements (GailTreeView *gailview,
 
     if (rowHasData && GAIL_IS_RENDERER_CELL (child) && GAIL_RENDERER_CELL (child)->renderer) {
       GailRendererCell *renderer_cell = GAIL_RENDERER_CELL (child);
-      GtkCellRendererClass *gtk_cell_renderer_class = GTK_CELL_RENDERER_GET_CLASS (renderer_cell->renderer);
-      GailRendererCellClass *gail_renderer_cell_class = GAIL_RENDERER_CELL_GET_CLASS (child);
-      char **prop_list = gail_renderer_cell_class->property_list;
 
       gtk_tree_view_column_cell_set_cell_data (column, model, &rowIter, isExpanderColumn, is_expanded);
 
@@ -1745,26 +2770,7 @@ gail_treeview_add_renderer_elements (GailTreeView *gailview,
         [visibleChildren addObject:renderer_element ?: (NSAccessibilityElement *)gail_cell_get_real_cell(gailCell)];
       }
 
-      while (*prop_list) {
-        GParamSpec *spec;
-
-        spec = g_object_class_find_property (G_OBJECT_GET_CLASS (renderer), *prop_list);
-
-        if (spec != NULL) {
-          GValue value = { 0, };
-
-          g_value_init (&value, spec->value_type);
-          g_object_get_property (G_OBJECT (renderer), *prop_list, &value);
-          g_object_set_property (G_OBJECT (renderer_cell->renderer),
-                                 *prop_list, &value);
-          g_value_unset(&value);
-        } else {
-          // Invalid properties are quite common with managed types because we don't know the parent type
-          // so everything is defaulting to GtkCellRendererText at the moment.
-          //g_warning ("Invalid property: %s\n", *prop_list);
-        }
-        prop_list++;
-      }
+      transfer_renderer_properties (gailview, G_OBJECT (renderer), renderer_cell);
 
       gail_renderer_cell_update_cache (renderer_cell, FALSE);
     }
@@ -1786,12 +2792,15 @@ gail_treeview_add_columns (GailTreeView *gailview,
     // If there are no renderers for the column, then we skip it
     GList *renderers = gtk_cell_layout_get_cells(GTK_CELL_LAYOUT(c->data));
     if (renderers == NULL) {
-      return;
+      continue;
     }
     g_list_free (renderers);
 
+    // Hidden columns don't have an element
     id<NSAccessibility> element = find_column_element_for_column(gailview, c->data);
-    [a addObject:element];
+    if (element != nil) {
+      [a addObject:element];
+    }
   }
   g_list_free(columns);
 }
@@ -1806,46 +2815,14 @@ void
 gail_treeview_add_selected_rows (GailTreeView *gailview,
                                  NSMutableArray *a)
 {
-  GtkTreeView *tree_view;
-  GtkWidget *widget;
-  GList *selected;
-  GtkTreeSelection *selection;
-  GtkTreeModel *selectionModel;
-
-  if (gailview->rowRootNode == NULL) {
-    return;
-  }
-
-  widget = GTK_ACCESSIBLE (gailview)->widget;
-  if (widget == NULL) {
-    return;
-  }
-  tree_view = GTK_TREE_VIEW (widget);
-
-  selection = gtk_tree_view_get_selection(tree_view);
-  selected = gtk_tree_selection_get_selected_rows(selection, &selectionModel);
-
-  for (GList *l = selected; l; l = l->next) {
-    GtkTreePath *p = l->data;
-    ACAccessibilityTreeRowElement *row = get_row_from_row_map(gailview, p);
-
-    if (row != nil) {
-      [a addObject:row];
-    }
-  }
-
-  g_list_foreach(selected, (GFunc)gtk_tree_path_free, NULL);
-  g_list_free (selected);
+  [a addObjectsFromArray:gail_treeview_get_selected_rows (gailview)];
 }
 
 ACAccessibilityTreeRowElement *
 gail_treeview_row_for_path (GailTreeView *gailview,
                             GtkTreePath *path)
 {
-  if (gailview->treeIsDirty) {
-    gail_treeview_add_rows(gailview, nil);
-    gail_treeview_add_columns(gailview, nil);
-  }
+  gail_treeview_ensure_rows (gailview);
 
   return get_row_from_row_map(gailview, path);
 }
@@ -1861,63 +2838,150 @@ gail_treeview_get_column_element (GailTreeView *gailview,
   return (__bridge ACAccessibilityTreeColumnElement *) g_hash_table_lookup(gailview->columnMap, column);
 }
 
-void
-iterate_rows_until (GailTreeView *gailview,
-                    GtkTreeView *treeview,
-                    GtkTreeIter *iter,
-                    GtkTreePath *endPath,
-                    NSMutableArray *a)
+/* The visible rows are kept between calls, along with the flattened index of the first of them
+ * and the vertical scroll position they were worked out for. Scrolling marks them as stale and
+ * the rows still in view are carried over into the new window. Any change to the rows themselves
+ * moves the indices, so then the window is looked up again from scratch.
+ * A row that can't be made keeps its place in the window as an NSNull, so the window always
+ * lines up with the flattened indices it is carried over by. */
+static void
+set_visible_rows (GailTreeView *gailview,
+                  NSArray *rows,
+                  NSArray *elements)
 {
-  do {
-    ACAccessibilityTreeRowElement *rowElement;
-    GtkTreePath *path;
-    gboolean expanded;
-    int compare;
+  if (gailview->visibleRows) {
+    CFBridgingRelease (gailview->visibleRows);
+    gailview->visibleRows = NULL;
+  }
+  if (gailview->visibleRowElements) {
+    CFBridgingRelease (gailview->visibleRowElements);
+    gailview->visibleRowElements = NULL;
+  }
 
-    path = gtk_tree_model_get_path (gailview->tree_model, iter);
+  if (rows) {
+    gailview->visibleRows = (void *)CFBridgingRetain (rows);
+    gailview->visibleRowElements = (void *)CFBridgingRetain (elements);
+  }
+}
 
-    if (gtk_tree_path_compare(path, endPath) != 1) {
-      break;
-    }
+static void
+invalidate_visible_rows (GailTreeView *gailview,
+                         gboolean rows_moved)
+{
+  gailview->visibleRowsDirty = TRUE;
+  if (rows_moved) {
+    gailview->visibleRowsStart = -1;
+  }
+}
 
-    rowElement = (ACAccessibilityTreeRowElement *) make_accessibility_element_for_row(gailview->tree_model, treeview, gailview, iter);
+static gboolean
+get_visible_row_indices (GailTreeView *gailview,
+                         GtkTreeView *treeview,
+                         int *start,
+                         int *end)
+{
+  ACAccessibilityTreeRowElement *startRow, *endRow;
+  GtkTreePath *startPath, *endPath;
 
-    // Need to do this before add_row_to_row_map_with_path as it alters path.
-    expanded = gtk_tree_view_row_expanded (treeview, path);
+  if (!gtk_tree_view_get_visible_range (treeview, &startPath, &endPath)) {
+    return FALSE;
+  }
 
-    [a addObject:rowElement];
-    add_row_to_row_map_with_path(gailview, path, rowElement);
+  startRow = gail_treeview_row_for_path (gailview, startPath);
+  endRow = gail_treeview_row_for_path (gailview, endPath);
 
-    gtk_tree_path_free (path);
+  gtk_tree_path_free (startPath);
+  gtk_tree_path_free (endPath);
 
-    if (gtk_tree_model_iter_has_child(gailview->tree_model, iter)) {
-      if (expanded) {
-        GtkTreeIter childIter;
+  if (startRow == nil || endRow == nil) {
+    return FALSE;
+  }
 
-        if (gtk_tree_model_iter_children(gailview->tree_model, &childIter, iter)) {
-          iterate_rows_until(gailview, treeview, &childIter, endPath, a);
-        }
-      }
-    }
-  } while (gtk_tree_model_iter_next(gailview->tree_model, iter));
+  *start = (int)[startRow accessibilityIndex];
+  *end = (int)[endRow accessibilityIndex];
+
+  return *start >= 0 && *end >= *start;
 }
 
-void
-gail_treeview_add_visible_rows (GailTreeView *gailview,
-                                NSMutableArray *rows)
+NSArray *
+gail_treeview_get_visible_rows (GailTreeView *gailview)
 {
   GtkTreeView *treeview = GTK_TREE_VIEW (ac_element_get_owner(AC_ELEMENT (gailview)));
-  GtkTreePath *startPath, *endPath;
-  GtkTreeIter startIter;
+  ACAccessibilityTreeRowElement *root;
+  NSArray *oldRows;
+  NSMutableArray *rows, *elements;
+  gdouble value;
+  int start, end, oldStart, oldEnd, i, reused = 0;
+
+  // The window is still right as long as nothing has scrolled and no changes are waiting,
+  // so there's no need to flush or to look anything up
+  value = gailview->old_vadj ? gtk_adjustment_get_value (gailview->old_vadj) : 0.0;
+  if (gailview->visibleRows != NULL && !gailview->visibleRowsDirty && value == gailview->visibleRowsValue &&
+      rows_match_model (gailview)) {
+    return VISIBLE_ROW_ELEMENTS (gailview);
+  }
 
-  gtk_tree_view_get_visible_range(treeview, &startPath, &endPath);
+  gail_treeview_ensure_rows (gailview);
 
-  if (!gtk_tree_model_get_iter(gailview->tree_model, &startIter, startPath)) {
-    return;
+  root = ROOT_NODE (gailview);
+  if (root == nil) {
+    return @[];
   }
 
-  iterate_rows_until (gailview, treeview, &startIter, endPath, rows);
+  // Flushing the changes may have moved the rows
+  if (gailview->visibleRows != NULL && !gailview->visibleRowsDirty && value == gailview->visibleRowsValue) {
+    return VISIBLE_ROW_ELEMENTS (gailview);
+  }
 
-  gtk_tree_path_free (startPath);
-  gtk_tree_path_free (endPath);
+  oldRows = VISIBLE_ROWS (gailview);
+  oldStart = oldRows ? gailview->visibleRowsStart : -1;
+  oldEnd = oldStart + (int)[oldRows count] - 1;
+
+  rows = [NSMutableArray array];
+  elements = rows;
+  if (get_visible_row_indices (gailview, treeview, &start, &end)) {
+    for (i = start; i <= end; i++) {
+      id row = nil;
+
+      // Only the rows that have scrolled into view need to be looked up, and any that couldn't be made before
+      if (oldStart >= 0 && i >= oldStart && i <= oldEnd && oldRows[i - oldStart] != [NSNull null]) {
+        row = oldRows[i - oldStart];
+        reused++;
+      } else {
+        row = [root rowAtFlattenedIndex:i];
+      }
+
+      if (row == nil) {
+        // The rows before this one were all made, so the handed out rows only start to differ here
+        if (elements == rows) {
+          elements = [rows mutableCopy];
+        }
+        [rows addObject:[NSNull null]];
+        continue;
+      }
+
+      [rows addObject:row];
+      if (elements != rows) {
+        [elements addObject:row];
+      }
+    }
+  } else {
+    start = -1;
+  }
+
+  AC_NOTE (TREEWIDGET, g_print ("Visible rows %d to %d, %d reused\n", start, end, reused));
+
+  set_visible_rows (gailview, rows, elements);
+  gailview->visibleRowsStart = start;
+  gailview->visibleRowsValue = value;
+  gailview->visibleRowsDirty = FALSE;
+
+  return elements;
+}
+
+void
+gail_treeview_add_visible_rows (GailTreeView *gailview,
+                                NSMutableArray *rows)
+{
+  [rows addObjectsFromArray:gail_treeview_get_visible_rows (gailview)];
 }
@@ -112,6 +112,7 @@
 
 - (id)atkcocoa_accessibilityHitTest:(NSPoint)point
 {
+  AC_PROFILE_SCOPE (HITTEST, "-[NSWindow accessibilityHitTest:]");
   id retval = [self atkcocoa_accessibilityHitTest:point];
 
   if (retval != self) {
@@ -0,0 +1,611 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Synthetic workloads for the parts of AtkCocoa that only need GLib and GTK:
+ * the row mirror's index tree driven by a GtkTreeStore, GailTextUtil and the
+ * gailmisc attribute code driven by a GtkTextBuffer and a PangoLayout.
+ *
+ * Some workloads also check their results against a simpler implementation,
+ * and the bench exits with 1 if any of them disagree.
+ *
+ * Usage: atkcocoa-bench [--rows N] [--filter SUBSTRING]
+ */
+
+#include <string.h>
+#include <gtk/gtk.h>
+#include <pango/pangocairo.h>
+#include "atk-cocoa/gailtextutil.h"
+#include "atk-cocoa/acoffsetindex.h"
+#include "atk-cocoa/gailmisc.h"
+#include "bench.h"
+
+typedef void (*BenchFunc) (int n);
+
+static int n_rows = 10000;
+static char *filter = NULL;
+static gboolean check_failed = FALSE;
+
+static GOptionEntry entries[] = {
+  { "rows", 'n', 0, G_OPTION_ARG_INT, &n_rows, "Size of the workloads", "N" },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run the benchmarks whose name contains SUBSTRING", "SUBSTRING" },
+  { NULL }
+};
+
+static void
+bench_row_append (int n)
+{
+  BenchResult result;
+  BenchRow *root = bench_row_new_root ();
+  int i;
+
+  bench_begin (&result, "row-tree/append", n);
+  for (i = 0; i < n; i++) {
+    bench_row_insert (root, i);
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  bench_row_free (root);
+}
+
+static void
+bench_row_insert_many_middle (int n)
+{
+  BenchResult result;
+  BenchRow *root = bench_row_new_root ();
+
+  bench_row_insert_many (root, 0, n);
+
+  bench_begin (&result, "row-tree/insert-many-middle", n);
+  bench_row_insert_many (root, n / 2, n);
+  bench_end (&result);
+  bench_report (&result);
+
+  bench_row_free (root);
+}
+
+static void
+bench_row_random_churn (int n)
+{
+  BenchResult result;
+  BenchRow *root = bench_row_new_root ();
+  GRand *rand = g_rand_new_with_seed (42);
+  int i;
+
+  bench_row_insert_many (root, 0, n);
+
+  bench_begin (&result, "row-tree/random-insert-delete", n);
+  for (i = 0; i < n; i++) {
+    int length = bench_row_get_n_children (root);
+
+    if (g_rand_boolean (rand) || length == 0) {
+      bench_row_insert (root, g_rand_int_range (rand, 0, length + 1));
+    } else {
+      bench_row_remove (bench_row_get_nth_child (root, g_rand_int_range (rand, 0, length)));
+    }
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  g_rand_free (rand);
+  bench_row_free (root);
+}
+
+static void
+bench_row_reverse (int n)
+{
+  BenchResult result;
+  BenchRow *root = bench_row_new_root ();
+  int *new_order = g_new (int, n);
+  int i;
+
+  bench_row_insert_many (root, 0, n);
+  for (i = 0; i < n; i++) {
+    new_order[i] = n - 1 - i;
+  }
+
+  bench_begin (&result, "row-tree/reorder-reverse", n);
+  bench_row_reorder (root, new_order);
+  bench_end (&result);
+  bench_report (&result);
+
+  g_free (new_order);
+  bench_row_free (root);
+}
+
+/* Walks a GtkTreeStore and mirrors it the way the lazy row tree does, one bulk insert per parent */
+static void
+mirror_store_children (GtkTreeModel *model,
+                       GtkTreeIter *parent_iter,
+                       BenchRow *parent)
+{
+  GtkTreeIter iter;
+  int n_children, i;
+
+  n_children = gtk_tree_model_iter_n_children (model, parent_iter);
+  if (n_children == 0) {
+    return;
+  }
+
+  bench_row_insert_many (parent, 0, n_children);
+
+  if (!gtk_tree_model_iter_children (model, &iter, parent_iter)) {
+    return;
+  }
+
+  i = 0;
+  do {
+    if (gtk_tree_model_iter_has_child (model, &iter)) {
+      mirror_store_children (model, &iter, bench_row_get_nth_child (parent, i));
+    }
+    i++;
+  } while (gtk_tree_model_iter_next (model, &iter));
+}
+
+static GtkTreeStore *
+make_tree_store (int n,
+                 int fanout)
+{
+  GtkTreeStore *store = gtk_tree_store_new (1, G_TYPE_STRING);
+  GtkTreeIter parent, child;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (i % fanout == 0) {
+      gtk_tree_store_append (store, &parent, NULL);
+      gtk_tree_store_set (store, &parent, 0, "Parent", -1);
+    } else {
+      gtk_tree_store_append (store, &child, &parent);
+      gtk_tree_store_set (store, &child, 0, "Child", -1);
+    }
+  }
+
+  return store;
+}
+
+static void
+bench_tree_store_mirror (int n)
+{
+  BenchResult result;
+  GtkTreeStore *store = make_tree_store (n, 10);
+  BenchRow *root = bench_row_new_root ();
+
+  bench_begin (&result, "tree-store/mirror", n);
+  mirror_store_children (GTK_TREE_MODEL (store), NULL, root);
+  bench_end (&result);
+  bench_report (&result);
+
+  bench_row_free (root);
+  g_object_unref (store);
+}
+
+static void
+bench_tree_store_lookup (int n)
+{
+  BenchResult result;
+  GtkTreeStore *store = make_tree_store (n, 10);
+  BenchRow *root = bench_row_new_root ();
+  GRand *rand = g_rand_new_with_seed (42);
+  int i, total;
+  guint found = 0;
+
+  mirror_store_children (GTK_TREE_MODEL (store), NULL, root);
+  total = ac_index_tree_get_weight (root->children);
+
+  bench_begin (&result, "tree-store/path-and-flattened-lookup", n);
+  for (i = 0; i < n; i++) {
+    GtkTreeIter iter;
+    GtkTreePath *path;
+    BenchRow *row;
+
+    // Model path to row, like the model handlers do
+    if (!gtk_tree_model_iter_nth_child (GTK_TREE_MODEL (store), &iter, NULL,
+                                        g_rand_int_range (rand, 0, (n + 9) / 10))) {
+      continue;
+    }
+    path = gtk_tree_model_get_path (GTK_TREE_MODEL (store), &iter);
+    row = bench_row_for_indices (root, gtk_tree_path_get_indices (path), gtk_tree_path_get_depth (path));
+    gtk_tree_path_free (path);
+
+    // And flattened index to row, like the visible rows do
+    if (row && bench_row_at_flattened_index (root, bench_row_get_flattened_index (row)) == row) {
+      found++;
+    }
+    bench_row_at_flattened_index (root, g_rand_int_range (rand, 0, total));
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  if (found == 0) {
+    g_warning ("tree-store lookups found no rows");
+  }
+
+  g_rand_free (rand);
+  bench_row_free (root);
+  g_object_unref (store);
+}
+
+static char *
+make_text (int n_words)
+{
+  static const char *words[] = { "Lorem", "ipsum", "dolor", "sit", "amet,", "consectetur", "adipiscing", "elit.", "Ünïcödé", "—" };
+  GString *text = g_string_new (NULL);
+  int i;
+
+  for (i = 0; i < n_words; i++) {
+    g_string_append (text, words[i % G_N_ELEMENTS (words)]);
+    g_string_append_c (text, (i % 12) == 11 ? '\n' : ' ');
+  }
+
+  return g_string_free (text, FALSE);
+}
+
+static void
+bench_text_util_string (int n)
+{
+  BenchResult result;
+  GailTextUtil *textutil = gail_text_util_new ();
+  char *text = make_text (n);
+  GRand *rand = g_rand_new_with_seed (42);
+  int n_chars, i;
+
+  bench_begin (&result, "text-util/string-setup", 1);
+  gail_text_util_text_setup (textutil, text);
+  bench_end (&result);
+  bench_report (&result);
+
+  n_chars = gail_text_util_get_char_count (textutil);
+
+  bench_begin (&result, "text-util/string-word-at-offset", n);
+  for (i = 0; i < n; i++) {
+    int start, end;
+
+    g_free (gail_text_util_get_text (textutil, NULL, GAIL_AT_OFFSET, ATK_TEXT_BOUNDARY_WORD_START,
+                                     g_rand_int_range (rand, 0, n_chars), &start, &end));
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  bench_begin (&result, "text-util/string-substring", n);
+  for (i = 0; i < n; i++) {
+    int start = g_rand_int_range (rand, 0, n_chars);
+
+    g_free (gail_text_util_get_substring (textutil, start, MIN (start + 32, n_chars)));
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  g_rand_free (rand);
+  g_free (text);
+  g_object_unref (textutil);
+}
+
+static void
+bench_offset_index (int n)
+{
+  BenchResult result;
+  char *text = make_text (n);
+  GRand *rand = g_rand_new_with_seed (42);
+  AcOffsetIndex *offsets;
+  int n_utf16, i;
+
+  bench_begin (&result, "offset-index/build", 1);
+  offsets = ac_offset_index_new (text, -1);
+  bench_end (&result);
+  bench_report (&result);
+
+  n_utf16 = ac_offset_index_get_length (offsets, AC_OFFSET_UTF16);
+
+  bench_begin (&result, "offset-index/utf16-to-bytes", n);
+  for (i = 0; i < n; i++)
+    ac_offset_index_convert (offsets, g_rand_int_range (rand, 0, n_utf16), AC_OFFSET_UTF16, AC_OFFSET_BYTES);
+  bench_end (&result);
+  bench_report (&result);
+
+  /* Typing in the middle of the text, a character at a time with the odd backspace */
+  bench_begin (&result, "offset-index/typing", n);
+  for (i = 0; i < n; i++) {
+    int offset = ac_offset_index_get_length (offsets, AC_OFFSET_CHARS) / 2;
+
+    if (i % 8 == 7)
+      ac_offset_index_delete (offsets, offset - 1, offset);
+    else
+      ac_offset_index_insert (offsets, offset, "ü", -1);
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  ac_offset_index_free (offsets);
+  g_rand_free (rand);
+  g_free (text);
+}
+
+/* Checks that two conversions agree, reporting the first few that don't */
+static gboolean
+check_conversion (const char *what,
+                  int edit,
+                  int offset,
+                  int expected,
+                  int got)
+{
+  static int n_reported = 0;
+
+  if (expected == got)
+    return TRUE;
+
+  if (n_reported++ < 10)
+    g_printerr ("utf16-index: %s of %d after edit %d is %d, the offset index has %d\n",
+                what, offset, edit, got, expected);
+  check_failed = TRUE;
+
+  return FALSE;
+}
+
+/* Mirrors random edits into an AcUtf16Index and an AcOffsetIndex, which walks the text
+ * itself, and checks that they convert every position the same way. The text is mostly
+ * characters outside the BMP, so the UTF-16 positions land on both halves of surrogate pairs */
+static void
+bench_utf16_index (int n)
+{
+  static const char *pieces[] = { "a", "\xc3\xbc", "\xf0\x9f\x98\x80", "a\xf0\x9f\x98\x80b",
+                                  "\xf0\x9f\x98\x80\xf0\x9f\x98\x80", "\xe2\x80\x94\n" };
+  BenchResult result;
+  GRand *rand = g_rand_new_with_seed (42);
+  AcOffsetIndex *reference = ac_offset_index_new ("", 0);
+  AcUtf16Index *index = ac_utf16_index_new ("", 0);
+  int i;
+
+  bench_begin (&result, "utf16-index/random-edits-checked", n);
+  for (i = 0; i < n; i++) {
+    int n_chars = ac_offset_index_get_length (reference, AC_OFFSET_CHARS);
+    int n_utf16, j;
+
+    if (n_chars > 0 && g_rand_int_range (rand, 0, 3) == 0) {
+      int start = g_rand_int_range (rand, 0, n_chars);
+      int end = MIN (n_chars, start + g_rand_int_range (rand, 1, 8));
+
+      ac_offset_index_delete (reference, start, end);
+      ac_utf16_index_delete (index, start, end);
+    } else {
+      const char *piece = pieces[g_rand_int_range (rand, 0, G_N_ELEMENTS (pieces))];
+      int offset = g_rand_int_range (rand, 0, n_chars + 1);
+
+      ac_offset_index_insert (reference, offset, piece, -1);
+      ac_utf16_index_insert (index, offset, piece, -1);
+    }
+
+    n_chars = ac_offset_index_get_length (reference, AC_OFFSET_CHARS);
+    n_utf16 = ac_offset_index_get_length (reference, AC_OFFSET_UTF16);
+    if (!check_conversion ("character length", i, 0, n_chars, ac_utf16_index_get_length (index, AC_OFFSET_CHARS)) ||
+        !check_conversion ("UTF-16 length", i, 0, n_utf16, ac_utf16_index_get_length (index, AC_OFFSET_UTF16))) {
+      break;
+    }
+
+    /* A few positions after each edit, including ones just out of range to check the clamping,
+     * and every position from time to time */
+    for (j = 0; j < ((i % 1000) == 999 ? n_utf16 + 2 : 8); j++) {
+      int utf16 = (i % 1000) == 999 ? j - 1 : g_rand_int_range (rand, -1, n_utf16 + 2);
+      int chars = g_rand_int_range (rand, -1, n_chars + 2);
+
+      check_conversion ("UTF-16 to characters", i, utf16,
+                        ac_offset_index_convert (reference, utf16, AC_OFFSET_UTF16, AC_OFFSET_CHARS),
+                        ac_utf16_index_convert (index, utf16, AC_OFFSET_UTF16, AC_OFFSET_CHARS));
+      check_conversion ("characters to UTF-16", i, chars,
+                        ac_offset_index_convert (reference, chars, AC_OFFSET_CHARS, AC_OFFSET_UTF16),
+                        ac_utf16_index_convert (index, chars, AC_OFFSET_CHARS, AC_OFFSET_UTF16));
+    }
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  ac_utf16_index_free (index);
+  ac_offset_index_free (reference);
+  g_rand_free (rand);
+}
+
+static GtkTextBuffer *
+make_tagged_buffer (int n)
+{
+  GtkTextBuffer *buffer = gtk_text_buffer_new (NULL);
+  GtkTextTag *bold, *italic;
+  GtkTextIter start, end;
+  char *text = make_text (n);
+  int n_chars, i;
+
+  gtk_text_buffer_set_text (buffer, text, -1);
+  g_free (text);
+
+  bold = gtk_text_buffer_create_tag (buffer, "bold", "weight", PANGO_WEIGHT_BOLD, NULL);
+  italic = gtk_text_buffer_create_tag (buffer, "italic", "style", PANGO_STYLE_ITALIC, "foreground", "red", NULL);
+
+  // A run boundary every few words
+  n_chars = gtk_text_buffer_get_char_count (buffer);
+  for (i = 0; i + 20 < n_chars; i += 40) {
+    gtk_text_buffer_get_iter_at_offset (buffer, &start, i);
+    gtk_text_buffer_get_iter_at_offset (buffer, &end, i + 20);
+    gtk_text_buffer_apply_tag (buffer, (i / 40) % 2 ? bold : italic, &start, &end);
+  }
+
+  return buffer;
+}
+
+static void
+bench_text_util_buffer (int n)
+{
+  BenchResult result;
+  GailTextUtil *textutil = gail_text_util_new ();
+  GtkTextBuffer *buffer = make_tagged_buffer (n);
+  GRand *rand = g_rand_new_with_seed (42);
+  int n_chars, i;
+
+  gail_text_util_buffer_setup (textutil, buffer);
+  n_chars = gtk_text_buffer_get_char_count (buffer);
+
+  bench_begin (&result, "text-util/buffer-line-at-offset", n);
+  for (i = 0; i < n; i++) {
+    int start, end;
+
+    g_free (gail_text_util_get_text (textutil, NULL, GAIL_AT_OFFSET, ATK_TEXT_BOUNDARY_LINE_START,
+                                     g_rand_int_range (rand, 0, n_chars), &start, &end));
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  bench_begin (&result, "text-util/buffer-sentence-after-offset", n);
+  for (i = 0; i < n; i++) {
+    int start, end;
+
+    g_free (gail_text_util_get_text (textutil, NULL, GAIL_AFTER_OFFSET, ATK_TEXT_BOUNDARY_SENTENCE_START,
+                                     g_rand_int_range (rand, 0, n_chars), &start, &end));
+  }
+  bench_end (&result);
+  bench_report (&result);
+
+  g_rand_free (rand);
+  g_object_unref (textutil);
+  g_object_unref (buffer);
+}
+
+static void
+bench_buffer_run_attributes (int n)
+{
+  BenchResult result;
+  GtkTextBuffer *buffer = make_tagged_buffer (n);
+  int n_chars, offset, n_runs = 0;
+
+  n_chars = gtk_text_buffer_get_char_count (buffer);
+
+  // Walk every run from the start of the buffer, like a screen reader reading attributes
+  bench_begin (&result, "misc/buffer-run-attributes-walk", 0);
+  for (offset = 0; offset < n_chars; n_runs++) {
+    AtkAttributeSet *attrs;
+    int start, end;
+
+    attrs = gail_misc_buffer_get_run_attributes (buffer, offset, &start, &end);
+    atk_attribute_set_free (attrs);
+
+    offset = end > offset ? end : offset + 1;
+  }
+  result.n_ops = n_runs;
+  bench_end (&result);
+  bench_report (&result);
+
+  g_object_unref (buffer);
+}
+
+static void
+bench_layout_run_attributes (int n)
+{
+  BenchResult result;
+  PangoFontMap *font_map = pango_cairo_font_map_get_default ();
+  PangoContext *context = pango_font_map_create_context (font_map);
+  PangoLayout *layout = pango_layout_new (context);
+  PangoAttrList *attrs = pango_attr_list_new ();
+  char *text = make_text (n);
+  int n_chars, offset, n_runs = 0;
+
+  pango_layout_set_text (layout, text, -1);
+  n_chars = g_utf8_strlen (text, -1);
+
+  for (offset = 0; offset + 20 < (int)strlen (text); offset += 40) {
+    PangoAttribute *attr = pango_attr_weight_new (PANGO_WEIGHT_BOLD);
+
+    attr->start_index = offset;
+    attr->end_index = offset + 20;
+    pango_attr_list_insert (attrs, attr);
+  }
+  pango_layout_set_attributes (layout, attrs);
+
+  bench_begin (&result, "misc/layout-run-attributes-walk", 0);
+  for (offset = 0; offset < n_chars; n_runs++) {
+    AtkAttributeSet *set;
+    int start, end;
+
+    set = gail_misc_layout_get_run_attributes (NULL, layout, text, offset, &start, &end);
+    atk_attribute_set_free (set);
+
+    offset = end > offset ? end : offset + 1;
+  }
+  result.n_ops = n_runs;
+  bench_end (&result);
+  bench_report (&result);
+
+  pango_attr_list_unref (attrs);
+  g_free (text);
+  g_object_unref (layout);
+  g_object_unref (context);
+}
+
+static const struct {
+  const char *name;
+  BenchFunc func;
+} benchmarks[] = {
+  { "row-tree/append", bench_row_append },
+  { "row-tree/insert-many-middle", bench_row_insert_many_middle },
+  { "row-tree/random-insert-delete", bench_row_random_churn },
+  { "row-tree/reorder-reverse", bench_row_reverse },
+  { "tree-store/mirror", bench_tree_store_mirror },
+  { "tree-store/path-and-flattened-lookup", bench_tree_store_lookup },
+  { "text-util/string", bench_text_util_string },
+  { "text-util/buffer", bench_text_util_buffer },
+  { "offset-index", bench_offset_index },
+  { "utf16-index", bench_utf16_index },
+  { "misc/buffer-run-attributes-walk", bench_buffer_run_attributes },
+  { "misc/layout-run-attributes-walk", bench_layout_run_attributes },
+};
+
+int
+main (int argc,
+      char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  guint i;
+
+  bench_init ();
+
+  context = g_option_context_new ("- benchmark the GLib level parts of AtkCocoa");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  // None of the workloads draw, so they run without a display
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  if (!bench_allocations_counted ()) {
+    g_printerr ("Allocations are only counted with glibc\n");
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (benchmarks); i++) {
+    if (filter && strstr (benchmarks[i].name, filter) == NULL) {
+      continue;
+    }
+
+    benchmarks[i].func (n_rows);
+  }
+
+  return check_failed ? 1 : 0;
+}
@@ -0,0 +1,423 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include "bench.h"
+
+typedef struct {
+  double ns_per_op;
+  double allocs_per_op;
+  long peak_rss_kb;
+} BenchLimits;
+
+static guint64 n_allocs;
+static guint64 n_alloc_bytes;
+
+#ifdef __GLIBC__
+/* glibc exports its allocator under these names, so the replacements below don't
+ * need dlsym, which allocates itself */
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n_members, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+#define COUNT_ALLOCATION(size) G_STMT_START {                           \
+    __atomic_add_fetch (&n_allocs, 1, __ATOMIC_RELAXED);                \
+    __atomic_add_fetch (&n_alloc_bytes, (size), __ATOMIC_RELAXED);      \
+  } G_STMT_END
+
+void *
+malloc (size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n_members,
+        size_t size)
+{
+  COUNT_ALLOCATION (n_members * size);
+  return __libc_calloc (n_members, size);
+}
+
+void *
+realloc (void *ptr,
+         size_t size)
+{
+  COUNT_ALLOCATION (size);
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+void
+bench_init (void)
+{
+  // GSlice hands out memory from its own magazines, which would hide most of the allocations
+  setenv ("G_SLICE", "always-malloc", TRUE);
+}
+
+gboolean
+bench_allocations_counted (void)
+{
+#ifdef __GLIBC__
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/* The high water mark of the whole process, so it only tells a benchmark apart
+ * from the ones before it when each runs in a process of its own */
+static long
+bench_get_peak_rss_kb (void)
+{
+  struct rusage usage;
+
+  if (getrusage (RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+void
+bench_begin (BenchResult *result,
+             const char *name,
+             guint n_ops)
+{
+  result->name = name;
+  result->n_ops = n_ops;
+  result->start_allocs = __atomic_load_n (&n_allocs, __ATOMIC_RELAXED);
+  result->start_bytes = __atomic_load_n (&n_alloc_bytes, __ATOMIC_RELAXED);
+  result->start_time = g_get_monotonic_time ();
+}
+
+void
+bench_end (BenchResult *result)
+{
+  result->elapsed_us = g_get_monotonic_time () - result->start_time;
+  result->allocs = __atomic_load_n (&n_allocs, __ATOMIC_RELAXED) - result->start_allocs;
+  result->bytes = __atomic_load_n (&n_alloc_bytes, __ATOMIC_RELAXED) - result->start_bytes;
+  result->peak_rss_kb = bench_get_peak_rss_kb ();
+}
+
+double
+bench_result_ns_per_op (const BenchResult *result)
+{
+  return result->elapsed_us * 1000.0 / MAX (result->n_ops, 1);
+}
+
+double
+bench_result_allocs_per_op (const BenchResult *result)
+{
+  return (double)result->allocs / MAX (result->n_ops, 1);
+}
+
+void
+bench_report (const BenchResult *result)
+{
+  printf ("%-40s %9u ops %12.1f ns/op %9.2f allocs/op %11.1f bytes/op %8ld KiB peak\n",
+          result->name, result->n_ops,
+          bench_result_ns_per_op (result),
+          bench_result_allocs_per_op (result),
+          (double)result->bytes / MAX (result->n_ops, 1),
+          result->peak_rss_kb);
+}
+
+static void
+free_limits (gpointer data)
+{
+  g_slice_free (BenchLimits, data);
+}
+
+GHashTable *
+bench_baseline_load (const char *path,
+                     GError **error)
+{
+  GHashTable *baseline;
+  char *contents, **lines;
+  int i;
+
+  if (!g_file_get_contents (path, &contents, NULL, error)) {
+    return NULL;
+  }
+
+  baseline = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, free_limits);
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i]; i++) {
+    BenchLimits limits;
+    char name[256];
+
+    if (lines[i][0] == '#' || lines[i][0] == '\0') {
+      continue;
+    }
+
+    if (sscanf (lines[i], "%255s %lf %lf %ld", name, &limits.ns_per_op,
+                &limits.allocs_per_op, &limits.peak_rss_kb) != 4) {
+      g_printerr ("%s:%d: Ignoring malformed line\n", path, i + 1);
+      continue;
+    }
+
+    g_hash_table_insert (baseline, g_strdup (name), g_slice_dup (BenchLimits, &limits));
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+
+  return baseline;
+}
+
+gboolean
+bench_baseline_write (const char *path,
+                      const BenchResult *results,
+                      guint n_results,
+                      GError **error)
+{
+  GString *contents = g_string_new ("# name ns/op allocs/op peak-rss-KiB\n");
+  gboolean ret;
+  guint i;
+
+  for (i = 0; i < n_results; i++) {
+    g_string_append_printf (contents, "%s %.1f %.2f %ld\n", results[i].name,
+                            bench_result_ns_per_op (&results[i]),
+                            bench_result_allocs_per_op (&results[i]),
+                            results[i].peak_rss_kb);
+  }
+
+  ret = g_file_set_contents (path, contents->str, contents->len, error);
+  g_string_free (contents, TRUE);
+
+  return ret;
+}
+
+static gboolean
+check_limit (const char *name,
+             const char *what,
+             double value,
+             double limit,
+             double threshold)
+{
+  if (limit <= 0 || value <= limit * (1.0 + threshold / 100.0)) {
+    return TRUE;
+  }
+
+  printf ("REGRESSION %s: %s %.2f is more than %.0f%% over the baseline %.2f\n",
+          name, what, value, threshold, limit);
+  return FALSE;
+}
+
+gboolean
+bench_check_regression (const BenchResult *result,
+                        GHashTable *baseline,
+                        double threshold)
+{
+  BenchLimits *limits = g_hash_table_lookup (baseline, result->name);
+  gboolean ok = TRUE;
+
+  // New benchmarks have nothing to regress from
+  if (limits == NULL) {
+    return TRUE;
+  }
+
+  ok &= check_limit (result->name, "ns/op", bench_result_ns_per_op (result), limits->ns_per_op, threshold);
+  ok &= check_limit (result->name, "allocs/op", bench_result_allocs_per_op (result), limits->allocs_per_op, threshold);
+  ok &= check_limit (result->name, "peak KiB", result->peak_rss_kb, limits->peak_rss_kb, threshold);
+
+  return ok;
+}
+
+static void
+bench_row_destroy (gpointer data)
+{
+  BenchRow *row = data;
+
+  ac_index_tree_free (row->children);
+  g_slice_free (BenchRow, row);
+}
+
+static BenchRow *
+bench_row_new (BenchRow *parent)
+{
+  BenchRow *row = g_slice_new0 (BenchRow);
+
+  row->parent = parent;
+  row->children = ac_index_tree_new (bench_row_destroy);
+
+  return row;
+}
+
+/* A row's weight is 1 + the number of its descendants, so every ancestor changes with it */
+static void
+adjust_weights (BenchRow *row,
+                int delta)
+{
+  for (; row->node; row = row->parent) {
+    ac_index_tree_node_set_weight (row->node, ac_index_tree_node_get_weight (row->node) + delta);
+  }
+}
+
+BenchRow *
+bench_row_new_root (void)
+{
+  return bench_row_new (NULL);
+}
+
+void
+bench_row_free (BenchRow *root)
+{
+  bench_row_destroy (root);
+}
+
+BenchRow *
+bench_row_insert (BenchRow *parent,
+                  int position)
+{
+  BenchRow *row = bench_row_new (parent);
+
+  row->node = ac_index_tree_insert (parent->children, position, row, 1);
+  adjust_weights (parent, 1);
+
+  return row;
+}
+
+void
+bench_row_insert_many (BenchRow *parent,
+                       int position,
+                       int n_rows)
+{
+  gpointer *rows = g_new (gpointer, n_rows);
+  AcIndexTreeNode **nodes = g_new (AcIndexTreeNode *, n_rows);
+  int i;
+
+  for (i = 0; i < n_rows; i++) {
+    rows[i] = bench_row_new (parent);
+  }
+
+  ac_index_tree_insert_many (parent->children, position, rows, NULL, n_rows, nodes);
+
+  for (i = 0; i < n_rows; i++) {
+    ((BenchRow *)rows[i])->node = nodes[i];
+  }
+  adjust_weights (parent, n_rows);
+
+  g_free (rows);
+  g_free (nodes);
+}
+
+void
+bench_row_remove (BenchRow *row)
+{
+  BenchRow *parent = row->parent;
+  int weight = ac_index_tree_node_get_weight (row->node);
+
+  // Frees row and everything under it
+  ac_index_tree_remove (parent->children, row->node);
+  adjust_weights (parent, -weight);
+}
+
+void
+bench_row_remove_children (BenchRow *row)
+{
+  int weight = ac_index_tree_get_weight (row->children);
+
+  ac_index_tree_free (row->children);
+  row->children = ac_index_tree_new (bench_row_destroy);
+  adjust_weights (row, -weight);
+}
+
+void
+bench_row_reorder (BenchRow *parent,
+                   const int *new_order)
+{
+  ac_index_tree_reorder (parent->children, new_order);
+}
+
+int
+bench_row_get_n_children (BenchRow *row)
+{
+  return ac_index_tree_get_length (row->children);
+}
+
+BenchRow *
+bench_row_get_nth_child (BenchRow *row,
+                         int position)
+{
+  AcIndexTreeNode *node = ac_index_tree_get_nth (row->children, position);
+
+  return node ? ac_index_tree_node_get_data (node) : NULL;
+}
+
+BenchRow *
+bench_row_for_indices (BenchRow *root,
+                       const int *indices,
+                       int depth)
+{
+  BenchRow *row = root;
+  int i;
+
+  for (i = 0; i < depth && row; i++) {
+    row = bench_row_get_nth_child (row, indices[i]);
+  }
+
+  return row;
+}
+
+int
+bench_row_get_flattened_index (BenchRow *row)
+{
+  int index = ac_index_tree_node_get_offset (row->node);
+
+  for (row = row->parent; row->node; row = row->parent) {
+    index += ac_index_tree_node_get_offset (row->node) + 1;
+  }
+
+  return index;
+}
+
+BenchRow *
+bench_row_at_flattened_index (BenchRow *root,
+                              int index)
+{
+  BenchRow *row = root;
+
+  while (TRUE) {
+    AcIndexTreeNode *node;
+    int node_offset;
+
+    node = ac_index_tree_find_offset (row->children, index, &node_offset);
+    if (node == NULL) {
+      return NULL;
+    }
+
+    row = ac_index_tree_node_get_data (node);
+    if (node_offset == index) {
+      return row;
+    }
+
+    // Skip the row itself and look in its children
+    index -= node_offset + 1;
+  }
+}
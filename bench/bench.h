@@ -0,0 +1,115 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __AC_BENCH_H__
+#define __AC_BENCH_H__
+
+#include <glib.h>
+#include "atk-cocoa/acindextree.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Timing and allocation counting for the headless benchmarks. Allocations are counted
+ * by replacing malloc and friends in the benchmark binary, so they include the ones
+ * made by GLib, GTK and Pango on our behalf.
+ */
+typedef struct _BenchResult BenchResult;
+
+struct _BenchResult {
+  const char *name;
+  guint n_ops;
+
+  gint64 start_time;
+  guint64 start_allocs;
+  guint64 start_bytes;
+
+  gint64 elapsed_us;
+  guint64 allocs;
+  guint64 bytes;
+  long peak_rss_kb;
+};
+
+void bench_init (void);
+gboolean bench_allocations_counted (void);
+
+void bench_begin (BenchResult *result,
+                  const char *name,
+                  guint n_ops);
+void bench_end (BenchResult *result);
+void bench_report (const BenchResult *result);
+
+double bench_result_ns_per_op (const BenchResult *result);
+double bench_result_allocs_per_op (const BenchResult *result);
+
+/*
+ * A baseline file has one line per benchmark: its name, ns/op, allocs/op and
+ * peak RSS in KiB. A result regresses when any of them is more than threshold
+ * percent above the baseline.
+ */
+GHashTable *bench_baseline_load (const char *path,
+                                 GError **error);
+gboolean bench_baseline_write (const char *path,
+                               const BenchResult *results,
+                               guint n_results,
+                               GError **error);
+gboolean bench_check_regression (const BenchResult *result,
+                                 GHashTable *baseline,
+                                 double threshold);
+
+/*
+ * BenchRow is a C copy of the row mirror that ACAccessibilityTreeRowElement keeps:
+ * every row holds its children in an AcIndexTree weighted by the size of the subtree
+ * they head, so positions and flattened indices are found the same way. The model
+ * handlers and batching that feed it are the real ones, from AcRowOps.
+ */
+typedef struct _BenchRow BenchRow;
+
+struct _BenchRow {
+  BenchRow *parent;
+  AcIndexTreeNode *node; /* NULL for the root */
+  AcIndexTree *children;
+};
+
+BenchRow *bench_row_new_root (void);
+void bench_row_free (BenchRow *root);
+
+BenchRow *bench_row_insert (BenchRow *parent,
+                            int position);
+void bench_row_insert_many (BenchRow *parent,
+                            int position,
+                            int n_rows);
+void bench_row_remove (BenchRow *row);
+void bench_row_remove_children (BenchRow *row);
+void bench_row_reorder (BenchRow *parent,
+                        const int *new_order);
+
+int bench_row_get_n_children (BenchRow *row);
+BenchRow *bench_row_get_nth_child (BenchRow *row,
+                                   int position);
+BenchRow *bench_row_for_indices (BenchRow *root,
+                                 const int *indices,
+                                 int depth);
+int bench_row_get_flattened_index (BenchRow *row);
+BenchRow *bench_row_at_flattened_index (BenchRow *root,
+                                        int index);
+
+G_END_DECLS
+
+#endif /* __AC_BENCH_H__ */
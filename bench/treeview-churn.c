@@ -0,0 +1,721 @@
+/*
+ * AtkCocoa
+ * Copyright 2016 Microsoft Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Churn scenarios for the tree view bridge. Each scenario drives a realized GtkTreeView
+ * whose model and selection signals go through the same AcRowOps handlers and batching
+ * that gailtreeview.c uses, and the batches are applied to a C copy of the row mirror.
+ * Every scenario runs in a process of its own so that its peak RSS is its own.
+ *
+ * It needs a display, so on a build machine run it under a virtual one:
+ *   xvfb-run -a treeview-churn [--rows N] [--baseline FILE] [--threshold PERCENT]
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <gtk/gtk.h>
+#include "atk-cocoa/acrowops.h"
+#include "bench.h"
+
+typedef struct {
+  GtkWidget *window;
+  GtkTreeView *view;
+  GtkTreeModel *model;
+  BenchRow *root;
+  AcRowOps *ops;
+
+  guint selection_changes;
+} ChurnView;
+
+typedef void (*ChurnFunc) (BenchResult *result, int n);
+
+static int n_rows = 10000;
+static char *filter = NULL;
+static char *baseline_path = NULL;
+static char *write_baseline_path = NULL;
+static double threshold = 25.0;
+
+static GOptionEntry entries[] = {
+  { "rows", 'n', 0, G_OPTION_ARG_INT, &n_rows, "Size of the workloads", "N" },
+  { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run the scenarios whose name contains SUBSTRING", "SUBSTRING" },
+  { "baseline", 'b', 0, G_OPTION_ARG_FILENAME, &baseline_path, "Fail when a scenario regresses from FILE", "FILE" },
+  { "threshold", 't', 0, G_OPTION_ARG_DOUBLE, &threshold, "Allowed regression in percent, 25 by default", "PERCENT" },
+  { "write-baseline", 'w', 0, G_OPTION_ARG_FILENAME, &write_baseline_path, "Write the results to FILE as a new baseline", "FILE" },
+  { NULL }
+};
+
+static void
+flush_events (void)
+{
+  while (gtk_events_pending ()) {
+    gtk_main_iteration_do (FALSE);
+  }
+}
+
+static BenchRow *
+row_for_path (ChurnView *churn,
+              GtkTreePath *path)
+{
+  return bench_row_for_indices (churn->root, gtk_tree_path_get_indices (path), gtk_tree_path_get_depth (path));
+}
+
+static BenchRow *
+parent_for_path (ChurnView *churn,
+                 GtkTreePath *path)
+{
+  GtkTreePath *parent_path;
+  BenchRow *parent;
+
+  if (gtk_tree_path_get_depth (path) == 1) {
+    return churn->root;
+  }
+
+  parent_path = gtk_tree_path_copy (path);
+  gtk_tree_path_up (parent_path);
+  parent = row_for_path (churn, parent_path);
+  gtk_tree_path_free (parent_path);
+
+  return parent;
+}
+
+/* The model handlers are gailtreeview.c's, minus its profiling */
+static void
+model_row_changed (GtkTreeModel *model,
+                   GtkTreePath *path,
+                   GtkTreeIter *iter,
+                   gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_row_changed (churn->ops, model, path, iter);
+}
+
+static void
+model_row_inserted (GtkTreeModel *model,
+                    GtkTreePath *path,
+                    GtkTreeIter *iter,
+                    gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_row_inserted (churn->ops, model, path, iter);
+}
+
+static void
+model_row_deleted (GtkTreeModel *model,
+                   GtkTreePath *path,
+                   gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_row_deleted (churn->ops, model, path);
+}
+
+static void
+model_row_has_child_toggled (GtkTreeModel *model,
+                             GtkTreePath *path,
+                             GtkTreeIter *iter,
+                             gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_row_has_child_toggled (churn->ops, model, path, iter);
+}
+
+static void
+model_rows_reordered (GtkTreeModel *model,
+                      GtkTreePath *path,
+                      GtkTreeIter *iter,
+                      gint *new_order,
+                      gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_rows_reordered (churn->ops, model, path, iter, new_order);
+}
+
+static void
+selection_changed (GtkTreeSelection *selection,
+                   gpointer user_data)
+{
+  ChurnView *churn = user_data;
+
+  ac_row_ops_selection_changed (churn->ops);
+}
+
+/* The batches are applied to the mirror the way gailtreeview.c applies them to the row tree */
+static void
+apply_row_changed (GtkTreePath *path,
+                   gpointer data)
+{
+  row_for_path (data, path);
+}
+
+static gboolean
+apply_row_inserted (GtkTreePath *path,
+                    gpointer element,
+                    gpointer data)
+{
+  BenchRow *parent = parent_for_path (data, path);
+
+  if (parent == NULL) {
+    return FALSE;
+  }
+
+  bench_row_insert (parent, gtk_tree_path_get_indices (path)[gtk_tree_path_get_depth (path) - 1]);
+  return TRUE;
+}
+
+static gboolean
+apply_row_deleted (GtkTreePath *path,
+                   gpointer data)
+{
+  BenchRow *row = row_for_path (data, path);
+
+  if (row == NULL) {
+    return FALSE;
+  }
+
+  bench_row_remove (row);
+  return TRUE;
+}
+
+static void
+apply_rows_reordered (GtkTreePath *path,
+                      gint *new_order,
+                      gpointer data)
+{
+  ChurnView *churn = data;
+  BenchRow *parent = gtk_tree_path_get_depth (path) == 0 ? churn->root : row_for_path (churn, path);
+
+  if (parent && bench_row_get_n_children (parent) > 0) {
+    bench_row_reorder (parent, new_order);
+  }
+}
+
+static void
+apply_row_child_toggled (GtkTreePath *path,
+                         gboolean has_child,
+                         gpointer data)
+{
+  row_for_path (data, path);
+}
+
+static void
+add_selected_row (GtkTreeModel *model,
+                  GtkTreePath *path,
+                  GtkTreeIter *iter,
+                  gpointer data)
+{
+  ChurnView *churn = data;
+  BenchRow *row = row_for_path (churn, path);
+
+  if (row) {
+    bench_row_get_flattened_index (row);
+  }
+}
+
+/* The selection is rescanned into flattened indices, as a client asking for it after the batch would */
+static void
+row_ops_flushed (const AcRowOpsBatch *batch,
+                 gpointer data)
+{
+  ChurnView *churn = data;
+
+  if (batch->n_selection_changes == 0) {
+    return;
+  }
+
+  churn->selection_changes += batch->n_selection_changes;
+  gtk_tree_selection_selected_foreach (gtk_tree_view_get_selection (churn->view), add_selected_row, churn);
+}
+
+static const AcRowOpsFuncs churn_row_ops_funcs = {
+  NULL,
+  NULL,
+  apply_row_changed,
+  apply_row_inserted,
+  apply_row_deleted,
+  apply_rows_reordered,
+  apply_row_child_toggled,
+  row_ops_flushed
+};
+
+/* Like gail_tree_view_expand_row_gtk and gail_tree_view_collapse_row_gtk, the queue is
+ * applied first as the handlers change the mirror themselves */
+static void
+view_row_expanded (GtkTreeView *view,
+                   GtkTreeIter *iter,
+                   GtkTreePath *path,
+                   gpointer user_data)
+{
+  ChurnView *churn = user_data;
+  BenchRow *row;
+  int n_children;
+
+  ac_row_ops_flush (churn->ops);
+
+  // The children are attached in one go, their own children when they are expanded
+  row = row_for_path (churn, path);
+  if (row == NULL || bench_row_get_n_children (row) > 0) {
+    return;
+  }
+
+  n_children = gtk_tree_model_iter_n_children (churn->model, iter);
+  if (n_children > 0) {
+    bench_row_insert_many (row, 0, n_children);
+  }
+}
+
+static void
+view_row_collapsed (GtkTreeView *view,
+                    GtkTreeIter *iter,
+                    GtkTreePath *path,
+                    gpointer user_data)
+{
+  ChurnView *churn = user_data;
+  BenchRow *row;
+
+  ac_row_ops_flush (churn->ops);
+
+  row = row_for_path (churn, path);
+  if (row) {
+    bench_row_remove_children (row);
+  }
+}
+
+static void
+churn_view_init (ChurnView *churn,
+                 GtkTreeModel *model)
+{
+  GtkWidget *scrolled;
+  GtkCellRenderer *renderer;
+  GtkTreeIter iter;
+  int n_children;
+
+  memset (churn, 0, sizeof (ChurnView));
+
+  churn->window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_default_size (GTK_WINDOW (churn->window), 400, 600);
+
+  scrolled = gtk_scrolled_window_new (NULL, NULL);
+  gtk_container_add (GTK_CONTAINER (churn->window), scrolled);
+
+  churn->view = GTK_TREE_VIEW (gtk_tree_view_new ());
+  renderer = gtk_cell_renderer_text_new ();
+  gtk_tree_view_insert_column_with_attributes (churn->view, -1, "Name", renderer, "text", 0, NULL);
+  gtk_container_add (GTK_CONTAINER (scrolled), GTK_WIDGET (churn->view));
+
+  churn->model = model;
+  gtk_tree_view_set_model (churn->view, model);
+
+  // The top level is mirrored up front, like the lazy row tree does
+  churn->root = bench_row_new_root ();
+  churn->ops = ac_row_ops_new (churn->view, &churn_row_ops_funcs, churn);
+  n_children = gtk_tree_model_iter_n_children (model, NULL);
+  if (n_children > 0 && gtk_tree_model_get_iter_first (model, &iter)) {
+    bench_row_insert_many (churn->root, 0, n_children);
+  }
+
+  g_signal_connect (model, "row-changed", G_CALLBACK (model_row_changed), churn);
+  g_signal_connect (model, "row-inserted", G_CALLBACK (model_row_inserted), churn);
+  g_signal_connect (model, "row-deleted", G_CALLBACK (model_row_deleted), churn);
+  g_signal_connect (model, "row-has-child-toggled", G_CALLBACK (model_row_has_child_toggled), churn);
+  g_signal_connect (model, "rows-reordered", G_CALLBACK (model_rows_reordered), churn);
+  g_signal_connect (churn->view, "row-expanded", G_CALLBACK (view_row_expanded), churn);
+  g_signal_connect (churn->view, "row-collapsed", G_CALLBACK (view_row_collapsed), churn);
+  g_signal_connect (gtk_tree_view_get_selection (churn->view), "changed", G_CALLBACK (selection_changed), churn);
+
+  gtk_widget_show_all (churn->window);
+  flush_events ();
+}
+
+static void
+churn_view_destroy (ChurnView *churn)
+{
+  // Destroying the view unsets its model and selection, which must not reach the freed queue
+  g_signal_handlers_disconnect_by_data (churn->model, churn);
+  g_signal_handlers_disconnect_by_data (churn->view, churn);
+  g_signal_handlers_disconnect_by_data (gtk_tree_view_get_selection (churn->view), churn);
+  ac_row_ops_free (churn->ops);
+
+  gtk_widget_destroy (churn->window);
+  g_object_unref (churn->model);
+  bench_row_free (churn->root);
+}
+
+static GtkListStore *
+make_list_store (int n,
+                 GRand *rand)
+{
+  GtkListStore *store = gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_INT);
+  int i;
+
+  for (i = 0; i < n; i++) {
+    gtk_list_store_insert_with_values (store, NULL, i, 0, "Row", 1, rand ? g_rand_int (rand) : i, -1);
+  }
+
+  return store;
+}
+
+/* fanout children per row, down to depth levels */
+static void
+fill_tree_store (GtkTreeStore *store,
+                 GtkTreeIter *parent,
+                 int fanout,
+                 int depth)
+{
+  GtkTreeIter iter;
+  int i;
+
+  for (i = 0; i < fanout; i++) {
+    gtk_tree_store_insert_with_values (store, &iter, parent, i, 0, "Row", -1);
+    if (depth > 1) {
+      fill_tree_store (store, &iter, fanout, depth - 1);
+    }
+  }
+}
+
+static GtkTreeStore *
+make_deep_tree_store (int n)
+{
+  GtkTreeStore *store = gtk_tree_store_new (1, G_TYPE_STRING);
+  int depth = 1, total = 4;
+
+  // A fanout of 4, as deep as n rows allows
+  while (total * 4 + 4 <= n) {
+    total = total * 4 + 4;
+    depth++;
+  }
+
+  fill_tree_store (store, NULL, 4, depth);
+
+  return store;
+}
+
+static void
+churn_list_append (BenchResult *result,
+                   int n)
+{
+  ChurnView churn;
+  int i;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (gtk_list_store_new (2, G_TYPE_STRING, G_TYPE_INT)));
+
+  bench_begin (result, "list-store/bulk-append", n);
+  for (i = 0; i < n; i++) {
+    gtk_list_store_insert_with_values (GTK_LIST_STORE (churn.model), NULL, i, 0, "Row", 1, i, -1);
+  }
+  flush_events ();
+  bench_end (result);
+
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_list_random (BenchResult *result,
+                   int n)
+{
+  ChurnView churn;
+  GRand *rand = g_rand_new_with_seed (42);
+  int i;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_list_store (n, NULL)));
+
+  bench_begin (result, "list-store/random-insert-delete", n);
+  for (i = 0; i < n; i++) {
+    GtkTreeModel *model = churn.model;
+    int length = gtk_tree_model_iter_n_children (model, NULL);
+    GtkTreeIter iter;
+
+    if (g_rand_boolean (rand) || length == 0) {
+      gtk_list_store_insert_with_values (GTK_LIST_STORE (model), NULL, g_rand_int_range (rand, 0, length + 1),
+                                         0, "Row", 1, i, -1);
+    } else if (gtk_tree_model_iter_nth_child (model, &iter, NULL, g_rand_int_range (rand, 0, length))) {
+      gtk_list_store_remove (GTK_LIST_STORE (model), &iter);
+    }
+  }
+  flush_events ();
+  bench_end (result);
+
+  g_rand_free (rand);
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_list_sort (BenchResult *result,
+                 int n)
+{
+  ChurnView churn;
+  GRand *rand = g_rand_new_with_seed (42);
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_list_store (n, rand)));
+
+  // One rows-reordered for the whole list each way
+  bench_begin (result, "list-store/sort", n);
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (churn.model), 1, GTK_SORT_ASCENDING);
+  flush_events ();
+  gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (churn.model), 1, GTK_SORT_DESCENDING);
+  flush_events ();
+  bench_end (result);
+
+  g_rand_free (rand);
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_tree_expand_all (BenchResult *result,
+                       int n)
+{
+  ChurnView churn;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_deep_tree_store (n)));
+
+  bench_begin (result, "tree-store/expand-all", n);
+  gtk_tree_view_expand_all (churn.view);
+  flush_events ();
+  bench_end (result);
+
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_tree_collapse_all (BenchResult *result,
+                         int n)
+{
+  ChurnView churn;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_deep_tree_store (n)));
+  gtk_tree_view_expand_all (churn.view);
+  flush_events ();
+
+  bench_begin (result, "tree-store/collapse-all", n);
+  gtk_tree_view_collapse_all (churn.view);
+  flush_events ();
+  bench_end (result);
+
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_select_all (BenchResult *result,
+                  int n)
+{
+  ChurnView churn;
+  GtkTreeSelection *selection;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_list_store (n, NULL)));
+  selection = gtk_tree_view_get_selection (churn.view);
+  gtk_tree_selection_set_mode (selection, GTK_SELECTION_MULTIPLE);
+
+  bench_begin (result, "list-store/select-all", n);
+  gtk_tree_selection_select_all (selection);
+  flush_events ();
+  gtk_tree_selection_unselect_all (selection);
+  flush_events ();
+  bench_end (result);
+
+  churn_view_destroy (&churn);
+}
+
+static void
+churn_scroll_by_page (BenchResult *result,
+                      int n)
+{
+  ChurnView churn;
+  GtkAdjustment *vadj;
+  int pages = 0;
+
+  churn_view_init (&churn, GTK_TREE_MODEL (make_list_store (n, NULL)));
+  vadj = gtk_tree_view_get_vadjustment (churn.view);
+
+  bench_begin (result, "list-store/scroll-by-page", 0);
+  while (gtk_adjustment_get_value (vadj) + gtk_adjustment_get_page_size (vadj) < gtk_adjustment_get_upper (vadj)) {
+    GtkTreePath *start, *end;
+
+    gtk_adjustment_set_value (vadj, gtk_adjustment_get_value (vadj) + gtk_adjustment_get_page_size (vadj));
+    flush_events ();
+    pages++;
+
+    // Look up the rows in view, like the visible rows do after a scroll once anything queued is applied
+    ac_row_ops_flush (churn.ops);
+    if (gtk_tree_view_get_visible_range (churn.view, &start, &end)) {
+      BenchRow *first = row_for_path (&churn, start);
+      BenchRow *last = row_for_path (&churn, end);
+
+      if (first && last) {
+        int i, from = bench_row_get_flattened_index (first), to = bench_row_get_flattened_index (last);
+
+        for (i = from; i <= to; i++) {
+          bench_row_at_flattened_index (churn.root, i);
+        }
+      }
+
+      gtk_tree_path_free (start);
+      gtk_tree_path_free (end);
+    }
+  }
+  result->n_ops = pages;
+  bench_end (result);
+
+  churn_view_destroy (&churn);
+}
+
+static const struct {
+  const char *name;
+  ChurnFunc func;
+} scenarios[] = {
+  { "list-store/bulk-append", churn_list_append },
+  { "list-store/random-insert-delete", churn_list_random },
+  { "list-store/sort", churn_list_sort },
+  { "tree-store/expand-all", churn_tree_expand_all },
+  { "tree-store/collapse-all", churn_tree_collapse_all },
+  { "list-store/select-all", churn_select_all },
+  { "list-store/scroll-by-page", churn_scroll_by_page },
+};
+
+/* Runs the scenario in a child process and reads its result back through a pipe */
+static gboolean
+run_scenario (int index,
+              BenchResult *result)
+{
+  struct rusage usage;
+  int fds[2], status;
+  pid_t pid;
+  ssize_t n_read;
+
+  if (pipe (fds) != 0) {
+    return FALSE;
+  }
+
+  pid = fork ();
+  if (pid < 0) {
+    close (fds[0]);
+    close (fds[1]);
+    return FALSE;
+  }
+
+  if (pid == 0) {
+    BenchResult child_result;
+
+    close (fds[0]);
+
+    if (!gtk_init_check (NULL, NULL)) {
+      g_printerr ("Cannot open a display, run under xvfb-run\n");
+      _exit (2);
+    }
+
+    memset (&child_result, 0, sizeof (BenchResult));
+    scenarios[index].func (&child_result, n_rows);
+
+    if (write (fds[1], &child_result, sizeof (BenchResult)) != sizeof (BenchResult)) {
+      _exit (1);
+    }
+    _exit (0);
+  }
+
+  close (fds[1]);
+  n_read = read (fds[0], result, sizeof (BenchResult));
+  close (fds[0]);
+
+  if (wait4 (pid, &status, 0, &usage) < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0 ||
+      n_read != sizeof (BenchResult)) {
+    return FALSE;
+  }
+
+  result->name = scenarios[index].name;
+#ifdef __APPLE__
+  result->peak_rss_kb = usage.ru_maxrss / 1024;
+#else
+  result->peak_rss_kb = usage.ru_maxrss;
+#endif
+
+  return TRUE;
+}
+
+int
+main (int argc,
+      char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GHashTable *baseline = NULL;
+  GArray *results;
+  gboolean ok = TRUE;
+  guint i;
+
+  bench_init ();
+
+  context = g_option_context_new ("- churn the tree view bridge");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (baseline_path) {
+    baseline = bench_baseline_load (baseline_path, &error);
+    if (baseline == NULL) {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return 1;
+    }
+  }
+
+  results = g_array_new (FALSE, TRUE, sizeof (BenchResult));
+
+  for (i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    BenchResult result;
+
+    if (filter && strstr (scenarios[i].name, filter) == NULL) {
+      continue;
+    }
+
+    if (!run_scenario (i, &result)) {
+      printf ("FAILED %s\n", scenarios[i].name);
+      ok = FALSE;
+      continue;
+    }
+
+    bench_report (&result);
+    g_array_append_val (results, result);
+
+    if (baseline && !bench_check_regression (&result, baseline, threshold)) {
+      ok = FALSE;
+    }
+  }
+
+  if (write_baseline_path &&
+      !bench_baseline_write (write_baseline_path, (BenchResult *)results->data, results->len, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    ok = FALSE;
+  }
+
+  g_array_free (results, TRUE);
+  if (baseline) {
+    g_hash_table_destroy (baseline);
+  }
+
+  return ok ? 0 : 1;
+}